@@ -0,0 +1,203 @@
+/**
+ * Entrypoint for the benchmarks.
+ *
+ * Runs every registered benchmark, or only the ones whose name is given in the command line.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+#include "varray.h"
+
+
+/** Registered benchmark. */
+struct bench {
+    /** Benchmark function. */
+    bench_func_t *func;
+    /** Benchmark name. */
+    const char *name;
+    /** File where the benchmark is defined. */
+    const char *file;
+};
+
+/** Registered benchmarks (var array). */
+static struct bench *_benchs = NULL;
+
+
+void bench_register( bench_func_t *func, const char *name, const char *file ) {
+    if( _benchs == NULL ) {
+        varray_init( _benchs, 16 );
+    }
+    struct bench b = { .func = func, .name = name, .file = file };
+    varray_push( _benchs, b );
+}
+
+double bench_now( void ) {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void bench_report( const char *label, size_t bytes, double seconds ) {
+    printf( "  %-40s %10.1f MB/s %8.2f ns/byte\n", label, bytes / seconds / 1e6, seconds * 1e9 / bytes );
+}
+
+
+/* malloc, calloc and realloc are wrapped at link time (see the Makefile) to count the heap allocations */
+void *__real_malloc( size_t size );
+void *__real_calloc( size_t num, size_t size );
+void *__real_realloc( void *ptr, size_t size );
+
+/** Number of calls to malloc, calloc and realloc, from any thread. */
+static size_t _allocations = 0;
+
+void *__wrap_malloc( size_t size ) {
+    __atomic_add_fetch( &_allocations, 1, __ATOMIC_RELAXED );
+    return __real_malloc( size );
+}
+
+void *__wrap_calloc( size_t num, size_t size ) {
+    __atomic_add_fetch( &_allocations, 1, __ATOMIC_RELAXED );
+    return __real_calloc( num, size );
+}
+
+void *__wrap_realloc( void *ptr, size_t size ) {
+    __atomic_add_fetch( &_allocations, 1, __ATOMIC_RELAXED );
+    return __real_realloc( ptr, size );
+}
+
+/** Returns the number of heap allocations made so far, reallocations included. */
+size_t bench_allocations( void ) {
+    return __atomic_load_n( &_allocations, __ATOMIC_RELAXED );
+}
+
+void bench_report_allocations( const char *label, size_t bytes, size_t allocations ) {
+    printf( "  %-40s %10zu allocs %8.1f allocs/KB\n", label, allocations, allocations * 1e3 / bytes );
+}
+
+
+/** Appends a C string to a var array of characters. */
+static void _append( char **s, const char *cstr ) {
+    while( *cstr ) {
+        varray_push( *s, *cstr++ );
+    }
+}
+
+/** Appends a new line and the indentation for \c level (if indenting). */
+static void _newline( char **s, bool indent, int level ) {
+    if( !indent ) {
+        return;
+    }
+    varray_push( *s, '\n' );
+    for( int i = 0; i < level * 4; i++ ) {
+        varray_push( *s, ' ' );
+    }
+}
+
+bench_corpus_t bench_corpus_generate( size_t min_len, bool indent ) {
+    static const char *words[] = { "request", "served", "from", "cache", "upstream", "timeout", "user", "session" };
+    char *s;
+    char tmp[64];
+    unsigned seed = 1;
+
+    varray_init( s, min_len + 1024 );
+    varray_push( s, '[' );
+    for( int record = 0; varray_len( s ) < min_len; record++ ) {
+        if( record > 0 ) {
+            varray_push( s, ',' );
+        }
+        _newline( &s, indent, 1 );
+        _append( &s, "{" );
+
+        _newline( &s, indent, 2 );
+        snprintf( tmp, sizeof( tmp ), "\"id\": %d,", record );
+        _append( &s, tmp );
+
+        _newline( &s, indent, 2 );
+        _append( &s, "\"message\": \"" );
+        for( int i = 0; i < 12; i++ ) {
+            seed = seed * 1103515245 + 12345;
+            _append( &s, words[( seed >> 16 ) % 8] );
+            varray_push( s, ' ' );
+        }
+        _append( &s, "\\\"done\\\"\"," );
+
+        _newline( &s, indent, 2 );
+        seed = seed * 1103515245 + 12345;
+        snprintf( tmp, sizeof( tmp ), "\"latency\": %u.%03u,", ( seed >> 16 ) % 1000, ( seed >> 4 ) % 1000 );
+        _append( &s, tmp );
+
+        _newline( &s, indent, 2 );
+        _append( &s, "\"cached\": " );
+        _append( &s, ( seed & 1 ) ? "true," : "false," );
+
+        _newline( &s, indent, 2 );
+        _append( &s, "\"parent\": null," );
+
+        _newline( &s, indent, 2 );
+        _append( &s, "\"codes\": [" );
+        for( int i = 0; i < 6; i++ ) {
+            snprintf( tmp, sizeof( tmp ), i == 0 ? "%d" : ", %d", ( record * 7 + i * 131 ) % 100000 );
+            _append( &s, tmp );
+        }
+        _append( &s, "]" );
+
+        _newline( &s, indent, 1 );
+        _append( &s, "}" );
+    }
+    _newline( &s, indent, 0 );
+    varray_push( s, ']' );
+
+    bench_corpus_t corpus = { .data = s, .len = varray_len( s ) };
+    return corpus;
+}
+
+void bench_corpus_release( bench_corpus_t *corpus ) {
+    varray_release( corpus->data );
+}
+
+
+/** Checks if the benchmark was selected in the command line (or if nothing was selected). */
+static bool _selected( const char *name, int argc, const char *argv[] ) {
+    if( argc <= 1 ) {
+        return true;
+    }
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp( argv[i], name ) == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Writes a corpus of \c argv[2] MiB to STDOUT, indented if \c argv[3] is "--indent" (see buffer_sweep.sh). */
+static int _write_corpus( int argc, const char *argv[] ) {
+    bool indent = argc > 3 && strcmp( argv[3], "--indent" ) == 0;
+    bench_corpus_t corpus = bench_corpus_generate( ( size_t )atoi( argv[2] ) << 20, indent );
+    size_t written = fwrite( corpus.data, 1, corpus.len, stdout );
+    bench_corpus_release( &corpus );
+    return written == corpus.len ? 0 : 1;
+}
+
+int main( int argc, const char *argv[] ) {
+    if( argc > 2 && strcmp( argv[1], "--corpus" ) == 0 ) {
+        return _write_corpus( argc, argv );
+    }
+    if( _benchs == NULL ) {
+        return 0;
+    }
+
+    for( size_t i = 0; i < varray_len( _benchs ); i++ ) {
+        if( _selected( _benchs[i].name, argc, argv ) ) {
+            printf( "[ %s ] (%s)\n", _benchs[i].name, _benchs[i].file );
+            _benchs[i].func();
+        }
+    }
+
+    varray_release( _benchs );
+    return 0;
+}
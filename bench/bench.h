@@ -0,0 +1,70 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+
+/** Defines a benchmark with the given ID. A block is expected next. */
+#define BENCH( id ) \
+    static void bench__##id( void ); \
+    __attribute__( ( constructor ) ) void bench__##id##_reg( void ) { bench_register( bench__##id, #id, __FILE__ ); } \
+    static void bench__##id( void )
+
+/** Runs \c block repeatedly in \c BENCH_TRIALS trials of at least \c BENCH_MIN_SECONDS each and reports the
+ *  throughput over \c bytes of the fastest trial. */
+#define BENCH_RUN( label, bytes, block ) \
+    do { \
+        double _best = 0; \
+        for( int _trial = 0; _trial < BENCH_TRIALS; _trial++ ) { \
+            size_t _iterations = 0; \
+            double _start = bench_now(), _elapsed; \
+            do { \
+                block; \
+                _iterations += 1; \
+            } while( ( _elapsed = bench_now() - _start ) < BENCH_MIN_SECONDS ); \
+            if( _trial == 0 || _elapsed / _iterations < _best ) { \
+                _best = _elapsed / _iterations; \
+            } \
+        } \
+        bench_report( label, ( bytes ), _best ); \
+    } while( 0 )
+
+/** Runs \c block once and reports the number of heap allocations it made (see \c bench_allocations). */
+#define BENCH_ALLOCATIONS( label, bytes, block ) \
+    do { \
+        size_t _before = bench_allocations(); \
+        block; \
+        bench_report_allocations( label, ( bytes ), bench_allocations() - _before ); \
+    } while( 0 )
+
+/** Number of times each measurement is repeated. */
+#define BENCH_TRIALS 5
+
+/** Minimum time spent on each trial. */
+#define BENCH_MIN_SECONDS 0.2
+
+
+/** Benchmark function type. */
+typedef void bench_func_t( void );
+
+/** In memory JSON document used as benchmark input. */
+typedef struct {
+    /** Document data. */
+    char *data;
+    /** Document length. */
+    size_t len;
+} bench_corpus_t;
+
+
+void bench_register( bench_func_t *func, const char *name, const char *file );
+double bench_now( void );
+void bench_report( const char *label, size_t bytes, double seconds );
+size_t bench_allocations( void );
+void bench_report_allocations( const char *label, size_t bytes, size_t allocations );
+
+bench_corpus_t bench_corpus_generate( size_t min_len, bool indent );
+void bench_corpus_release( bench_corpus_t *corpus );
+
+#endif
@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+#
+# Measures the throughput of the json tool for different input buffer sizes.
+#
+# Usage: bench/buffer_sweep.sh [CORPUS_MIB] [SIZES...]
+#
+# Generates a corpus with the benchmarks binary, then parses it from a file, from a pipe and from the file with
+# io_uring (4 reads in flight) with each buffer size, reporting the best of a few runs. The file is also parsed
+# through a memory mapping as a reference.
+
+set -e
+
+cd "$( dirname "$0" )/.."
+
+CORPUS_MIB=${1:-64}
+shift || true
+SIZES=${*:-1K 4K 16K 64K 256K 1M 4M}
+RUNS=5
+
+make -s target/json target/bench
+
+CORPUS=$( mktemp )
+trap 'rm -f "$CORPUS"' EXIT
+./target/bench --corpus "$CORPUS_MIB" > "$CORPUS"
+BYTES=$( stat -c %s "$CORPUS" )
+
+# prints the best wall time of $RUNS runs of the given command
+best_time() {
+    local best=""
+    for _ in $( seq $RUNS ); do
+        local start end
+        start=$( date +%s.%N )
+        "$@" > /dev/null || true
+        end=$( date +%s.%N )
+        best=$( echo "$start $end $best" | awk '{ t = $2 - $1; if( $3 == "" || t < $3 ) print t; else print $3 }' )
+    done
+    echo "$best"
+}
+
+printf "corpus: %d bytes\n" "$BYTES"
+mmap_time=$( best_time ./target/json "$CORPUS" )
+awk -v bytes="$BYTES" -v t="$mmap_time" 'BEGIN { printf "mmap: %.1f MB/s\n", bytes / t / 1e6 }'
+printf "%-8s %12s %12s %12s\n" "buffer" "file MB/s" "pipe MB/s" "uring MB/s"
+for size in $SIZES; do
+    file_time=$( best_time sh -c "./target/json -b $size < '$CORPUS'" )
+    pipe_time=$( best_time sh -c "cat '$CORPUS' | ./target/json -b $size" )
+    uring_time=$( best_time ./target/json -b "$size" -u 4 "$CORPUS" )
+    awk -v size="$size" -v bytes="$BYTES" -v file="$file_time" -v pipe="$pipe_time" -v uring="$uring_time" \
+        'BEGIN { printf "%-8s %12.1f %12.1f %12.1f\n", size, bytes / file / 1e6, bytes / pipe / 1e6, bytes / uring / 1e6 }'
+done
@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+#
+# Compares parsing compressed input with the json tool (json -z) against decompressing it in a pipe.
+#
+# Usage: bench/decompress.sh [CORPUS_MIB]
+#
+# Generates a corpus with the benchmarks binary and compresses it with gzip (and zstd, if the command is installed),
+# then parses it decoded in the parser from the file, from STDIN and with read-ahead, and through "zcat |", reporting
+# the best of a few runs in MB/s of uncompressed JSON. zstd is skipped when the tool was built without libzstd.
+
+set -e
+
+cd "$( dirname "$0" )/.."
+
+CORPUS_MIB=${1:-64}
+RUNS=5
+
+make -s target/json target/bench
+
+CORPUS=$( mktemp )
+trap 'rm -f "$CORPUS" "$CORPUS.gz" "$CORPUS.zst"' EXIT
+./target/bench --corpus "$CORPUS_MIB" > "$CORPUS"
+BYTES=$( stat -c %s "$CORPUS" )
+gzip -k -c "$CORPUS" > "$CORPUS.gz"
+
+# prints the best wall time of $RUNS runs of the given command
+best_time() {
+    local best=""
+    for _ in $( seq $RUNS ); do
+        local start end
+        start=$( date +%s.%N )
+        "$@" > /dev/null || true
+        end=$( date +%s.%N )
+        best=$( echo "$start $end $best" | awk '{ t = $2 - $1; if( $3 == "" || t < $3 ) print t; else print $3 }' )
+    done
+    echo "$best"
+}
+
+# prints a row with the throughput of the given command
+report() {
+    local name=$1
+    shift
+    local t
+    t=$( best_time "$@" )
+    awk -v name="$name" -v bytes="$BYTES" -v t="$t" 'BEGIN { printf "%-24s %10.1f\n", name, bytes / t / 1e6 }'
+}
+
+printf "corpus: %d bytes, gzip: %d bytes\n" "$BYTES" "$( stat -c %s "$CORPUS.gz" )"
+printf "%-24s %10s\n" "input" "MB/s"
+report "plain file" ./target/json "$CORPUS"
+report "gzip, zcat |" sh -c "zcat '$CORPUS.gz' | ./target/json"
+report "gzip, file" ./target/json -z "$CORPUS.gz"
+report "gzip, stdin" sh -c "./target/json -z < '$CORPUS.gz'"
+report "gzip, stdin read-ahead" sh -c "./target/json -z -r 4 < '$CORPUS.gz'"
+
+if command -v zstd > /dev/null; then
+    zstd -q -c "$CORPUS" > "$CORPUS.zst"
+    report "zstd, zstdcat |" sh -c "zstd -q -d -c '$CORPUS.zst' | ./target/json"
+    if ./target/json -z "$CORPUS.zst" | grep -q "Unsupported"; then
+        echo "zstd: json built without libzstd"
+    else
+        report "zstd, file" ./target/json -z "$CORPUS.zst"
+        report "zstd, stdin read-ahead" sh -c "./target/json -z -r 4 < '$CORPUS.zst'"
+    fi
+fi
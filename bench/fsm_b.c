@@ -0,0 +1,106 @@
+#include <string.h>
+#include "bench.h"
+#include "fsm.h"
+
+
+#define ASIZE( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
+
+
+/** States of a reduced JSON lexer used to compare the FSM engines. */
+enum {
+    lex_state_init = FSM_INITIAL_STATE,
+    lex_state_end = FSM_END_STATE,
+    lex_state_string,
+    lex_state_escape,
+    lex_state_number,
+    lex_state_literal,
+
+    lex_state_last
+};
+
+static bool _count( size_t *ctx, char c ) {
+    *ctx += 1;
+    return true;
+}
+
+static bool _count_span( size_t *ctx, const uint8_t *data, size_t data_len ) {
+    *ctx += data_len;
+    return true;
+}
+
+#define T( _values, _next, _action ) \
+    { .values = _values, .values_len = sizeof( _values ) - 1, .next_state = lex_state_##_next, .action = ( transition_action_cb_t )_action }
+#define T_SPAN( _values, _next, _action ) \
+    { .values = _values, .values_len = sizeof( _values ) - 1, .next_state = lex_state_##_next, .action = ( transition_action_cb_t )_action, .span_action = ( transition_span_action_cb_t )_count_span }
+#define T_ANY_SPAN( _next, _action ) \
+    { .values = ANY, .next_state = lex_state_##_next, .action = ( transition_action_cb_t )_action, .span_action = ( transition_span_action_cb_t )_count_span }
+#define T_ANY( _next, _action ) \
+    { .values = ANY, .next_state = lex_state_##_next, .action = ( transition_action_cb_t )_action }
+#define S( name, ... ) \
+    [lex_state_##name] = { \
+        .transitions = ( transition_t[] ){ __VA_ARGS__ }, \
+        .num_transitions = ASIZE( ( ( transition_t[] ){ __VA_ARGS__ } ) ), \
+    }
+
+/** Same transition layout as the tokenizer's states. */
+static const state_t _states[lex_state_last] = {
+    S( init,
+        T( "\r\n\t ", init, NULL ),
+        T( "{", init, _count ),
+        T( "}", init, _count ),
+        T( "[", init, _count ),
+        T( "]", init, _count ),
+        T( ":", init, _count ),
+        T( ",", init, _count ),
+        T( "\"", string, _count ),
+        T( "0123456789", number, _count ),
+        T( "f", literal, _count ),
+        T( "t", literal, _count ),
+        T( "n", literal, _count ) ),
+    S( string,
+        T( "\\", escape, NULL ),
+        T( "\"", init, _count ),
+        T( "\n\r", end, NULL ),
+        T_ANY_SPAN( string, _count ) ),
+    S( escape,
+        T( "nt\\rbf/", string, _count ),
+        T_ANY_SPAN( string, _count ) ),
+    S( number,
+        T_SPAN( "0123456789", number, _count ),
+        T( ".", number, _count ),
+        T_ANY( init, _count ) ),
+    S( literal,
+        T( "aelrsu", literal, _count ),
+        T_ANY( init, _count ) ),
+};
+
+
+BENCH( fsm_step ) {
+    bench_corpus_t corpus = bench_corpus_generate( 1 << 20, false );
+    const uint8_t *data = ( const uint8_t * )corpus.data;
+    size_t ctx = 0;
+
+    BENCH_RUN( "linear transition scan", corpus.len, {
+        state_id_t state = FSM_INITIAL_STATE;
+        for( size_t i = 0; i < corpus.len && state >= 0; i++ ) {
+            state = fsm_step( &_states[state], data[i], state, &ctx );
+        }
+    } );
+
+    fsm_t fsm;
+    fsm_compile( &fsm, _states, ASIZE( _states ) );
+    BENCH_RUN( "compiled byte class table", corpus.len, {
+        state_id_t state = FSM_INITIAL_STATE;
+        for( size_t i = 0; i < corpus.len && state >= 0; i++ ) {
+            state = fsm_step_compiled( &fsm, state, data[i], &ctx );
+        }
+    } );
+    BENCH_RUN( "compiled, skipping loops", corpus.len, {
+        state_id_t state = FSM_INITIAL_STATE;
+        fsm_run_span( &fsm, &state, data, data + corpus.len, &ctx );
+    } );
+    printf( "  (%zu byte classes, %zu bytes of table)\n", fsm.num_classes, fsm.num_classes * fsm.num_states * sizeof( fsm_entry_t ) );
+
+    fsm_release( &fsm );
+    bench_corpus_release( &corpus );
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "json_utf8.h"
+#include "parser.h"
+#include "varray.h"
+
+
+#define MIN( x, y ) ( ( x ) < ( y ) ? ( x ) : ( y ) )
+
+
+struct buffer {
+    const char *data;
+    size_t data_len;
+    const char *ptr;
+};
+
+static ssize_t _read_buffer( struct buffer *b, void *data, size_t data_len ) {
+    size_t bytes_to_output = MIN( data_len, b->data_len - ( b->ptr - b->data ) );
+    memcpy( data, b->ptr, bytes_to_output );
+    b->ptr += bytes_to_output;
+    return bytes_to_output;
+}
+
+/** Counts the events of the parser and the bytes of the strings. */
+struct counters {
+    size_t events;
+    size_t string_bytes;
+};
+
+static void _error( void *ctx, const char *error_msg, int line, int column ) {
+}
+static bool _event( void *ctx ) {
+    ( ( struct counters * )ctx )->events += 1;
+    return true;
+}
+static bool _string( void *ctx, const char *string ) {
+    ( ( struct counters * )ctx )->string_bytes += strlen( string );
+    return _event( ctx );
+}
+static bool _integer( void *ctx, integer_t integer ) {
+    return _event( ctx );
+}
+static bool _fraction( void *ctx, fraction_t fraction ) {
+    return _event( ctx );
+}
+static bool _boolean( void *ctx, bool boolean ) {
+    return _event( ctx );
+}
+static bool _number( void *ctx, const json_number_t *number ) {
+    return _event( ctx );
+}
+static bool _number_converted( void *ctx, const json_number_t *number ) {
+    int64_t integer;
+    double fraction;
+    if( !json_number_as_i64( number, &integer ) && !json_number_as_double( number, &fraction ) ) {
+        return false;
+    }
+    return _event( ctx );
+}
+
+/** Parses the whole corpus with \c options and returns the number of events. */
+static size_t _parse_ex( const bench_corpus_t *corpus, const json_options_t *options ) {
+    struct buffer buffer = { .data = corpus->data, .data_len = corpus->len, .ptr = corpus->data };
+    struct counters counters = { 0 };
+    json_handler_t handler = HANDLER_INIT( &counters, _error, _event, _string, _event, _event, _event, _integer,
+                                           _fraction, _string, _event, _boolean );
+    json_parse_ex( &handler, ( json_read_cb_t )_read_buffer, &buffer, options );
+    return counters.events;
+}
+
+static size_t _parse( const bench_corpus_t *corpus ) {
+    return _parse_ex( corpus, NULL );
+}
+
+/** Parses the whole corpus with lazy numbers, converting them all if \c convert is \c true. */
+static size_t _parse_lazy( const bench_corpus_t *corpus, bool convert ) {
+    struct buffer buffer = { .data = corpus->data, .data_len = corpus->len, .ptr = corpus->data };
+    struct counters counters = { 0 };
+    json_handler_t handler = HANDLER_INIT( &counters, _error, _event, _string, _event, _event, _event, _integer,
+                                           _fraction, _string, _event, _boolean );
+    handler.number = convert ? _number_converted : _number;
+    const json_options_t options = { .lazy_numbers = true };
+    json_parse_ex( &handler, ( json_read_cb_t )_read_buffer, &buffer, &options );
+    return counters.events;
+}
+
+/** Validates the whole corpus before parsing it, like a separate validator would. */
+static size_t _validate_then_parse( const bench_corpus_t *corpus ) {
+    json_utf8_state_t state = { 0 };
+    if( json_utf8_validate( &state, ( const uint8_t * )corpus->data, corpus->len ) != corpus->len ) {
+        return 0;
+    }
+    return _parse( corpus );
+}
+
+/** Generates an array of objects with a text in several scripts, like user generated content. */
+static bench_corpus_t _generate_texts( size_t min_len ) {
+    static const char *words[] = {
+        "the ", "quick ", "caf\xc3\xa9 ", "\xc3\xbc" "ber ", "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 ",
+        "\xe4\xbd\xa0\xe5\xa5\xbd ", "\xf0\x9f\x98\x80 ", "\xce\xba\xce\xb1\xce\xbb\xce\xb7\xce\xbc\xce\xad\xcf\x81\xce\xb1 ",
+    };
+    static const char *open = "{\"id\": 1, \"text\": \"";
+    char *s;
+    unsigned seed = 1;
+
+    varray_init( s, min_len + 512 );
+    varray_push( s, '[' );
+    while( varray_len( s ) < min_len ) {
+        if( varray_len( s ) > 1 ) {
+            varray_push( s, ',' );
+        }
+        varray_extend( s, open, strlen( open ) );
+        for( int word = 0; word < 32; word++ ) {
+            seed = seed * 1103515245 + 12345;
+            const char *w = words[( seed >> 16 ) % 8];
+            varray_extend( s, w, strlen( w ) );
+        }
+        varray_extend( s, "\"}", 2 );
+    }
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+/** Generates an array of samples with mostly numeric fields, like metrics or coordinates. */
+static bench_corpus_t _generate_numbers( size_t min_len ) {
+    char *s;
+    char sample[256];
+    unsigned seed = 1;
+
+    varray_init( s, min_len + 512 );
+    varray_push( s, '[' );
+    for( int id = 0; varray_len( s ) < min_len; id++ ) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = seed >> 8;
+        int len = snprintf( sample, sizeof( sample ),
+                            "%s{\"id\": %d, \"timestamp\": %u%06u, \"lat\": %d.%06u, \"lon\": -%u.%06u, "
+                            "\"value\": %u.%02ue%d, \"count\": %u}",
+                            id > 0 ? "," : "", id, 1700000000 + r % 100000, r % 1000000, ( int )( r % 180 ) - 90,
+                            r % 999983, r % 180, r % 999979, r % 10, r % 100, ( int )( r % 20 ) - 10, r % 65536 );
+        varray_extend( s, sample, len );
+    }
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+
+BENCH( parser ) {
+    bench_corpus_t minified = bench_corpus_generate( 4 << 20, false );
+    BENCH_RUN( "minified corpus", minified.len, _parse( &minified ) );
+    BENCH_ALLOCATIONS( "minified corpus", minified.len, _parse( &minified ) );
+    bench_corpus_release( &minified );
+
+    const json_options_t validate = { .validate_utf8 = true };
+    bench_corpus_t texts = _generate_texts( 4 << 20 );
+    BENCH_RUN( "UTF-8 texts", texts.len, _parse( &texts ) );
+    BENCH_RUN( "UTF-8 texts, validated while parsing", texts.len, _parse_ex( &texts, &validate ) );
+    BENCH_RUN( "UTF-8 texts, validated before parsing", texts.len, _validate_then_parse( &texts ) );
+    bench_corpus_release( &texts );
+
+    bench_corpus_t numbers = _generate_numbers( 4 << 20 );
+    BENCH_RUN( "numbers", numbers.len, _parse( &numbers ) );
+    BENCH_RUN( "numbers, lazy", numbers.len, _parse_lazy( &numbers, false ) );
+    BENCH_RUN( "numbers, lazy and all converted", numbers.len, _parse_lazy( &numbers, true ) );
+    bench_corpus_release( &numbers );
+}
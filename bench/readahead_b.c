@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench.h"
+#include "json_tokenizer.h"
+
+
+/** Latency added to every read from the pipe, about the time the tokenizer takes to go through one buffer. */
+#define READ_LATENCY_NS 400000
+
+
+/** Pipe fed by a writer thread whose reads take \c READ_LATENCY_NS, like a slow device. */
+struct throttled_pipe {
+    const bench_corpus_t *corpus;
+    int fds[2];
+    pthread_t writer;
+};
+
+static void *_write_corpus( void *arg ) {
+    struct throttled_pipe *p = arg;
+    const char *data = p->corpus->data;
+    size_t left = p->corpus->len;
+    while( left > 0 ) {
+        ssize_t written = write( p->fds[1], data, left );
+        if( written <= 0 ) {
+            break;
+        }
+        data += written;
+        left -= written;
+    }
+    close( p->fds[1] );
+    return NULL;
+}
+
+/** Fills \c data from the pipe after waiting for the read latency. */
+static ssize_t _read_throttled( struct throttled_pipe *p, void *data, size_t data_len ) {
+    struct timespec latency = { .tv_sec = 0, .tv_nsec = READ_LATENCY_NS };
+    nanosleep( &latency, NULL );
+
+    size_t total = 0;
+    while( total < data_len ) {
+        ssize_t bytes_read = read( p->fds[0], ( char * )data + total, data_len - total );
+        if( bytes_read < 0 ) {
+            return -1;
+        } else if( bytes_read == 0 ) {
+            break;
+        }
+        total += bytes_read;
+    }
+    return total;
+}
+
+/** Tokenizes the corpus read through a throttled pipe and returns the number of tokens. */
+static size_t _tokenize( const bench_corpus_t *corpus, size_t read_ahead ) {
+    struct throttled_pipe p = { .corpus = corpus };
+    if( pipe( p.fds ) != 0 || pthread_create( &p.writer, NULL, _write_corpus, &p ) != 0 ) {
+        return 0;
+    }
+
+    stream_t s;
+    if( read_ahead > 0 ) {
+        stream_init_readahead( &s, ( stream_read_cb_t )_read_throttled, &p, 0, read_ahead );
+    } else {
+        STREAM_INIT( &s, _read_throttled, &p );
+    }
+
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+
+    size_t num_tokens = 0;
+    for( ;; ) {
+        json_token_t token = tokenizer_get_next( &tokenizer );
+        if( token.type == json_token_eof || token.type == json_token_error ) {
+            break;
+        }
+        token_release( &token );
+        num_tokens += 1;
+    }
+
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+    close( p.fds[0] );
+    pthread_join( p.writer, NULL );
+    return num_tokens;
+}
+
+
+BENCH( readahead ) {
+    bench_corpus_t corpus = bench_corpus_generate( 4 << 20, false );
+    BENCH_RUN( "throttled pipe, direct", corpus.len, _tokenize( &corpus, 0 ) );
+    BENCH_RUN( "throttled pipe, read-ahead 4", corpus.len, _tokenize( &corpus, 4 ) );
+    bench_corpus_release( &corpus );
+}
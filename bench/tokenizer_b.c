@@ -0,0 +1,307 @@
+#include <string.h>
+#include "bench.h"
+#include "json_tokenizer.h"
+#include "varray.h"
+
+
+#define MIN( x, y ) ( ( x ) < ( y ) ? ( x ) : ( y ) )
+
+
+struct buffer {
+    const char *data;
+    size_t data_len;
+    const char *ptr;
+};
+
+static ssize_t _read_buffer( struct buffer *b, void *data, size_t data_len ) {
+    size_t bytes_to_output = MIN( data_len, b->data_len - ( b->ptr - b->data ) );
+    memcpy( data, b->ptr, bytes_to_output );
+    b->ptr += bytes_to_output;
+    return bytes_to_output;
+}
+
+/** Tokenizes the whole corpus and returns the number of tokens, skipping loops with the vector kernels if \c vector
+ *  (see \c fsm_t.scan) and reading operators and plain strings from the structural index if \c use_index. */
+static size_t _tokenize_with( const bench_corpus_t *corpus, bool vector, bool use_index ) {
+    struct buffer buffer = { .data = corpus->data, .data_len = corpus->len, .ptr = corpus->data };
+    stream_t s;
+    STREAM_INIT( &s, _read_buffer, &buffer );
+
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+    if( !vector ) {
+        tokenizer.fsm.scan = NULL;
+    }
+    tokenizer.use_index = use_index;
+
+    size_t num_tokens = 0;
+    for( ;; ) {
+        json_token_t token = tokenizer_get_next( &tokenizer );
+        if( token.type == json_token_eof || token.type == json_token_error ) {
+            break;
+        }
+        token_release( &token );
+        num_tokens += 1;
+    }
+
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+    return num_tokens;
+}
+
+static size_t _tokenize( const bench_corpus_t *corpus ) {
+    return _tokenize_with( corpus, true, true );
+}
+
+static size_t _tokenize_scan( const bench_corpus_t *corpus, bool vector ) {
+    return _tokenize_with( corpus, vector, true );
+}
+
+/** Tokenizes the whole corpus in batches of up to \c cap tokens (see \c tokenizer_get_batch). */
+static size_t _tokenize_batch( const bench_corpus_t *corpus, size_t cap ) {
+    struct buffer buffer = { .data = corpus->data, .data_len = corpus->len, .ptr = corpus->data };
+    stream_t s;
+    STREAM_INIT( &s, _read_buffer, &buffer );
+
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+
+    size_t num_tokens = 0;
+    json_token_t tokens[64];
+    for( ;; ) {
+        size_t n = tokenizer_get_batch( &tokenizer, tokens, MIN( cap, sizeof( tokens ) / sizeof( tokens[0] ) ) );
+        json_token_type_t last = tokens[n - 1].type;
+        for( size_t i = 0; i < n; i++ ) {
+            token_release( &tokens[i] );
+        }
+        if( last == json_token_eof || last == json_token_error ) {
+            num_tokens += n - 1;
+            break;
+        }
+        num_tokens += n;
+    }
+
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+    return num_tokens;
+}
+
+/** Generates an array of objects with a message string of about \c string_len characters, like log records. */
+static bench_corpus_t _generate_messages( size_t min_len, size_t string_len ) {
+    static const char *words[] = { "request ", "served ", "from ", "cache ", "upstream ", "timeout ", "user ", "session " };
+    static const char *open = "{\"message\": \"";
+    char *s;
+    unsigned seed = 1;
+
+    varray_init( s, min_len + 2 * string_len );
+    varray_push( s, '[' );
+    while( varray_len( s ) < min_len ) {
+        if( varray_len( s ) > 1 ) {
+            varray_push( s, ',' );
+        }
+        varray_extend( s, open, strlen( open ) );
+        for( size_t start = varray_len( s ); varray_len( s ) - start < string_len; ) {
+            seed = seed * 1103515245 + 12345;
+            const char *word = words[( seed >> 16 ) % 8];
+            varray_extend( s, word, strlen( word ) );
+        }
+        varray_extend( s, "\"}", 2 );
+    }
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+/** Generates an array of integers of 1 to 19 digits, half of them negative. */
+static bench_corpus_t _generate_integers( size_t min_len ) {
+    char *s;
+    char tmp[32];
+    uint64_t seed = 1;
+
+    varray_init( s, min_len + 32 );
+    varray_push( s, '[' );
+    while( varray_len( s ) < min_len ) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        /* the top bits pick the number of digits */
+        int digits = 1 + ( seed >> 59 ) % 19;
+        uint64_t value = ( seed >> 1 ) % 10000000000000000000ULL;
+        for( int i = digits; i < 19; i++ ) {
+            value /= 10;
+        }
+        snprintf( tmp, sizeof( tmp ), "%s%s%llu", varray_len( s ) > 1 ? "," : "", ( seed & 1 ) ? "-" : "",
+                  ( unsigned long long )value );
+        varray_extend( s, tmp, strlen( tmp ) );
+    }
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+/** Generates an array of points with a longitude and a latitude with 6 decimals and a reading in scientific
+ *  notation, like the tracks of a sensor. */
+static bench_corpus_t _generate_coordinates( size_t min_len ) {
+    char *s;
+    char tmp[96];
+    uint64_t seed = 1;
+
+    varray_init( s, min_len + 96 );
+    varray_push( s, '[' );
+    while( varray_len( s ) < min_len ) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        double longitude = ( double )( seed >> 11 ) / ( 1ULL << 53 ) * 360.0 - 180.0;
+        double latitude = ( double )( ( seed >> 20 ) & 0xffffffff ) / 0xffffffff * 180.0 - 90.0;
+        double reading = ( double )( seed & 0xfffff ) * 1.7e-9;
+        snprintf( tmp, sizeof( tmp ), "%s[%.6f,%.6f,%.4e]", varray_len( s ) > 1 ? "," : "", longitude, latitude,
+                  reading );
+        varray_extend( s, tmp, strlen( tmp ) );
+    }
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+/** Generates rows of booleans and nulls, like the nullable columns of a table. */
+static bench_corpus_t _generate_literals( size_t min_len ) {
+    static const char *literals[] = { "true", "false", "null", "false" };
+    char *s;
+    unsigned seed = 1;
+
+    varray_init( s, min_len + 64 );
+    varray_push( s, '[' );
+    while( varray_len( s ) < min_len ) {
+        varray_extend( s, varray_len( s ) > 1 ? ",\n[" : "\n[", varray_len( s ) > 1 ? 3 : 2 );
+        for( int column = 0; column < 8; column++ ) {
+            seed = seed * 1103515245 + 12345;
+            const char *literal = literals[( seed >> 16 ) % 4];
+            if( column > 0 ) {
+                varray_extend( s, ", ", 2 );
+            }
+            varray_extend( s, literal, strlen( literal ) );
+        }
+        varray_push( s, ']' );
+    }
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+/** Generates an array of strings of text with every non ASCII character escaped, like the output of encoders that
+ *  only write ASCII. A quarter of the words are emoji, escaped as surrogate pairs. */
+static bench_corpus_t _generate_escapes( size_t min_len ) {
+    static const char *words[] = {
+        "\\u041f\\u0440\\u0438\\u0432\\u0435\\u0442 ",
+        "\\u4f60\\u597d\\u4e16\\u754c ",
+        "caf\\u00e9 ",
+        "\\ud83d\\ude00\\ud83c\\udf89 ",
+        "\\u03ba\\u03b1\\u03bb\\u03b7\\u03bc\\u03ad\\u03c1\\u03b1 ",
+        "\\u00fcber\\n",
+        "\\u3053\\u3093\\u306b\\u3061\\u306f ",
+        "\\ud83d\\udc4d ",
+    };
+    char *s;
+    unsigned seed = 1;
+
+    varray_init( s, min_len + 256 );
+    varray_push( s, '[' );
+    while( varray_len( s ) < min_len ) {
+        varray_extend( s, varray_len( s ) > 1 ? ",\"" : "\"", varray_len( s ) > 1 ? 2 : 1 );
+        for( int word = 0; word < 6; word++ ) {
+            seed = seed * 1103515245 + 12345;
+            const char *w = words[( seed >> 16 ) % 8];
+            varray_extend( s, w, strlen( w ) );
+        }
+        varray_push( s, '"' );
+    }
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+/** Appends a new line indented to \c level with 4 spaces per level. */
+static void _indent( char **s, int level ) {
+    varray_push( *s, '\n' );
+    for( int i = 0; i < level * 4; i++ ) {
+        varray_push( *s, ' ' );
+    }
+}
+
+/** Generates an array of objects nested \c depth levels deep and pretty-printed, so most of it is indentation (three
+ *  quarters for 8 levels). */
+static bench_corpus_t _generate_nested( size_t min_len, int depth ) {
+    char *s;
+    char tmp[32];
+
+    varray_init( s, min_len + 1024 );
+    varray_push( s, '[' );
+    for( int record = 0; varray_len( s ) < min_len; record++ ) {
+        if( record > 0 ) {
+            varray_push( s, ',' );
+        }
+        _indent( &s, 1 );
+        for( int level = 1; level < depth; level++ ) {
+            varray_extend( s, "{", 1 );
+            _indent( &s, level + 1 );
+            snprintf( tmp, sizeof( tmp ), "\"id\": %d,", record * depth + level );
+            varray_extend( s, tmp, strlen( tmp ) );
+            _indent( &s, level + 1 );
+            varray_extend( s, "\"child\": ", 9 );
+        }
+        varray_extend( s, "null", 4 );
+        for( int level = depth - 1; level >= 1; level-- ) {
+            _indent( &s, level );
+            varray_push( s, '}' );
+        }
+    }
+    _indent( &s, 0 );
+    varray_push( s, ']' );
+    return ( bench_corpus_t ){ .data = s, .len = varray_len( s ) };
+}
+
+
+BENCH( tokenizer ) {
+    bench_corpus_t minified = bench_corpus_generate( 4 << 20, false );
+    BENCH_RUN( "minified corpus", minified.len, _tokenize( &minified ) );
+    BENCH_RUN( "minified corpus, batches of 64 tokens", minified.len, _tokenize_batch( &minified, 64 ) );
+    BENCH_RUN( "minified corpus, without structural index", minified.len, _tokenize_with( &minified, true, false ) );
+    BENCH_ALLOCATIONS( "minified corpus", minified.len, _tokenize( &minified ) );
+    bench_corpus_release( &minified );
+
+    bench_corpus_t indented = bench_corpus_generate( 4 << 20, true );
+    BENCH_RUN( "indented corpus", indented.len, _tokenize( &indented ) );
+    BENCH_RUN( "indented corpus, without structural index", indented.len, _tokenize_with( &indented, true, false ) );
+    BENCH_ALLOCATIONS( "indented corpus", indented.len, _tokenize( &indented ) );
+    bench_corpus_release( &indented );
+
+    bench_corpus_t messages = _generate_messages( 4 << 20, 4096 );
+    BENCH_RUN( "4 KB strings, vector scan", messages.len, _tokenize_scan( &messages, true ) );
+    BENCH_RUN( "4 KB strings, byte map scan", messages.len, _tokenize_scan( &messages, false ) );
+    BENCH_RUN( "4 KB strings, without structural index", messages.len, _tokenize_with( &messages, true, false ) );
+    bench_corpus_release( &messages );
+
+    bench_corpus_t minified_scan = bench_corpus_generate( 4 << 20, false );
+    BENCH_RUN( "minified corpus, byte map scan", minified_scan.len, _tokenize_scan( &minified_scan, false ) );
+    bench_corpus_release( &minified_scan );
+
+    /* the whitespace between tokens is skipped by the vector loops too */
+    bench_corpus_t indented_scan = bench_corpus_generate( 4 << 20, true );
+    BENCH_RUN( "indented corpus, byte map scan", indented_scan.len, _tokenize_scan( &indented_scan, false ) );
+    bench_corpus_release( &indented_scan );
+
+    bench_corpus_t integers = _generate_integers( 4 << 20 );
+    BENCH_RUN( "integers", integers.len, _tokenize( &integers ) );
+    BENCH_RUN( "integers, batches of 64 tokens", integers.len, _tokenize_batch( &integers, 64 ) );
+    bench_corpus_release( &integers );
+
+    bench_corpus_t coordinates = _generate_coordinates( 4 << 20 );
+    BENCH_RUN( "coordinates", coordinates.len, _tokenize( &coordinates ) );
+    BENCH_RUN( "coordinates, batches of 64 tokens", coordinates.len, _tokenize_batch( &coordinates, 64 ) );
+    bench_corpus_release( &coordinates );
+
+    bench_corpus_t literals = _generate_literals( 4 << 20 );
+    BENCH_RUN( "booleans and nulls", literals.len, _tokenize( &literals ) );
+    bench_corpus_release( &literals );
+
+    bench_corpus_t escapes = _generate_escapes( 4 << 20 );
+    BENCH_RUN( "escaped unicode strings", escapes.len, _tokenize( &escapes ) );
+    bench_corpus_release( &escapes );
+
+    bench_corpus_t nested = _generate_nested( 4 << 20, 8 );
+    BENCH_RUN( "nested indented corpus, vector scan", nested.len, _tokenize_scan( &nested, true ) );
+    BENCH_RUN( "nested indented corpus, byte map scan", nested.len, _tokenize_scan( &nested, false ) );
+    bench_corpus_release( &nested );
+}
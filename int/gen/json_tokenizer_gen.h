@@ -0,0 +1,736 @@
+/* Generated by tool/fsmgen.c from json_tokenizer_states.h, do not edit. */
+
+static state_id_t _fsm_run_generated( stream_t *stream, struct fsm_ctx *ctx, bool refill ) {
+    const uint8_t *data;
+    size_t data_len;
+    size_t handled;
+    state_id_t state = FSM_INITIAL_STATE;
+
+    if( !refill && stream->bytes_left == 0 ) {
+        return FSM_BUFFER_END;
+    }
+    while( stream_peek_span( stream, &data, &data_len ) ) {
+        const uint8_t *p = data;
+        while( p < data + data_len ) {
+            uint8_t c = *p++;
+            switch( state ) {
+                case state_id_init:
+                    switch( c ) {
+                        case 0x0d:
+                        case 0x0a:
+                        case 0x09:
+                        case 0x20:
+                            continue;
+                        case 0x7b:
+                            if( !_action_token_object_open( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        case 0x7d:
+                            if( !_action_token_object_close( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        case 0x5b:
+                            if( !_action_token_array_open( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        case 0x5d:
+                            if( !_action_token_array_close( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        case 0x3a:
+                            if( !_action_token_colon( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        case 0x2c:
+                            if( !_action_token_comma( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        case 0x22:
+                            if( !_action_string_init( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_string;
+                            continue;
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_numeric_init( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_numeric;
+                            continue;
+                        case 0x2d:
+                            if( !_action_numeric_minus( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_minus;
+                            continue;
+                        case 0x66:
+                            if( !_action_boolean_false_init( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_false;
+                            continue;
+                        case 0x74:
+                            if( !_action_boolean_true_init( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_true;
+                            continue;
+                        case 0x6e:
+                            state = state_id_null_start;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_string:
+                    switch( c ) {
+                        case 0x5c:
+                            if( !_action_string_escape( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_escape;
+                            continue;
+                        case 0x22:
+                            if( !_action_token_string( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        case 0x00:
+                        case 0x01:
+                        case 0x02:
+                        case 0x03:
+                        case 0x04:
+                        case 0x05:
+                        case 0x06:
+                        case 0x07:
+                        case 0x08:
+                        case 0x09:
+                        case 0x0a:
+                        case 0x0b:
+                        case 0x0c:
+                        case 0x0d:
+                        case 0x0e:
+                        case 0x0f:
+                        case 0x10:
+                        case 0x11:
+                        case 0x12:
+                        case 0x13:
+                        case 0x14:
+                        case 0x15:
+                        case 0x16:
+                        case 0x17:
+                        case 0x18:
+                        case 0x19:
+                        case 0x1a:
+                        case 0x1b:
+                        case 0x1c:
+                        case 0x1d:
+                        case 0x1e:
+                        case 0x1f:
+                            if( !_action_error_invalid_control_character( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_error;
+                        default:
+                            if( !_action_string_store_span( ctx, p - 1, 1 ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            continue;
+                    }
+                case state_id_escape:
+                    if( ( handled = _fast_path_escapes( ctx, p - 1, data + data_len - ( p - 1 ) ) ) > 0 ) {
+                        p += handled - 1;
+                        state = state_id_string;
+                        continue;
+                    }
+                    switch( c ) {
+                        case 0x6e:
+                        case 0x74:
+                        case 0x5c:
+                        case 0x72:
+                        case 0x62:
+                        case 0x66:
+                        case 0x2f:
+                            if( !_action_string_do_escape( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_string;
+                            continue;
+                        case 0x75:
+                            if( !_action_unicode_init( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_unicode_1;
+                            continue;
+                        default:
+                            if( !_action_string_store( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_string;
+                            continue;
+                    }
+                case state_id_unicode_1:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                        case 0x61:
+                        case 0x62:
+                        case 0x63:
+                        case 0x64:
+                        case 0x65:
+                        case 0x66:
+                        case 0x41:
+                        case 0x42:
+                        case 0x43:
+                        case 0x44:
+                        case 0x45:
+                        case 0x46:
+                            if( !_action_unicode_digit( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_unicode_2;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_unicode_2:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                        case 0x61:
+                        case 0x62:
+                        case 0x63:
+                        case 0x64:
+                        case 0x65:
+                        case 0x66:
+                        case 0x41:
+                        case 0x42:
+                        case 0x43:
+                        case 0x44:
+                        case 0x45:
+                        case 0x46:
+                            if( !_action_unicode_digit( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_unicode_3;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_unicode_3:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                        case 0x61:
+                        case 0x62:
+                        case 0x63:
+                        case 0x64:
+                        case 0x65:
+                        case 0x66:
+                        case 0x41:
+                        case 0x42:
+                        case 0x43:
+                        case 0x44:
+                        case 0x45:
+                        case 0x46:
+                            if( !_action_unicode_digit( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_unicode_4;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_unicode_4:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                        case 0x61:
+                        case 0x62:
+                        case 0x63:
+                        case 0x64:
+                        case 0x65:
+                        case 0x66:
+                        case 0x41:
+                        case 0x42:
+                        case 0x43:
+                        case 0x44:
+                        case 0x45:
+                        case 0x46:
+                            if( !_action_unicode_end( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_string;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_minus:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_integer_digit( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_numeric;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_numeric:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_integer_digits( ctx, p - 1, 1 ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            continue;
+                        case 0x2e:
+                            if( !_action_fraction( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_fraction_first_digit;
+                            continue;
+                        case 0x65:
+                        case 0x45:
+                            if( !_action_exponent( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_exponent_sign;
+                            continue;
+                        default:
+                            if( !_action_token_integer_and_unget( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                    }
+                case state_id_fraction_first_digit:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_fraction_digit( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_fraction;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_fraction:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_fraction_digits( ctx, p - 1, 1 ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            continue;
+                        case 0x65:
+                        case 0x45:
+                            if( !_action_exponent( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_exponent_sign;
+                            continue;
+                        default:
+                            if( !_action_token_fraction_and_unget( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                    }
+                case state_id_exponent_sign:
+                    switch( c ) {
+                        case 0x2b:
+                            if( !_action_exponent_plus( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_exponent_first_digit;
+                            continue;
+                        case 0x2d:
+                            if( !_action_exponent_minus( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_exponent_first_digit;
+                            continue;
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_exponent_digit( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_exponent;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_exponent_first_digit:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_exponent_digit( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            state = state_id_exponent;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_exponent:
+                    switch( c ) {
+                        case 0x30:
+                        case 0x31:
+                        case 0x32:
+                        case 0x33:
+                        case 0x34:
+                        case 0x35:
+                        case 0x36:
+                        case 0x37:
+                        case 0x38:
+                        case 0x39:
+                            if( !_action_exponent_digits( ctx, p - 1, 1 ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            continue;
+                        default:
+                            if( !_action_token_fraction_and_unget( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                    }
+                case state_id_true:
+                    switch( c ) {
+                        case 0x72:
+                        case 0x75:
+                            if( !_action_check_true( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            continue;
+                        case 0x65:
+                            if( !_action_token_true( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_false:
+                    switch( c ) {
+                        case 0x61:
+                        case 0x6c:
+                        case 0x73:
+                            if( !_action_check_false( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            continue;
+                        case 0x65:
+                            if( !_action_token_false( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_null_start:
+                    switch( c ) {
+                        case 0x75:
+                            state = state_id_null_read_l;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_null_read_l:
+                    switch( c ) {
+                        case 0x6c:
+                            state = state_id_null_end;
+                            continue;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                case state_id_null_end:
+                    switch( c ) {
+                        case 0x6c:
+                            if( !_action_token_null( ctx, c ) ) {
+                                stream_consume( stream, p - data );
+                                return FSM_ERROR_TRANSITION;
+                            }
+                            stream_consume( stream, p - data );
+                            return state_id_end;
+                        default:
+                            stream_consume( stream, p - data );
+                            return FSM_ERROR_NO_MATCH;
+                    }
+                default:
+                    stream_consume( stream, p - data );
+                    return FSM_ERROR_STATE;
+            }
+        }
+        if( !refill ) {
+            return FSM_BUFFER_END;
+        }
+        stream_consume( stream, data_len );
+    }
+
+    if( stream->error ) {
+        return FSM_ERROR_STREAM;
+    }
+
+    /* executes the end of file transition */
+    switch( state ) {
+        case state_id_init:
+            if( !_action_token_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_end;
+        case state_id_string:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_escape:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_unicode_1:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_unicode_2:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_unicode_3:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_unicode_4:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_minus:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_numeric:
+            if( !_action_token_integer( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_end;
+        case state_id_fraction_first_digit:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_fraction:
+            if( !_action_token_fraction( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_end;
+        case state_id_exponent_sign:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_exponent_first_digit:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_exponent:
+            if( !_action_token_fraction( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_end;
+        case state_id_true:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_false:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_null_start:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_null_read_l:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        case state_id_null_end:
+            if( !_action_error_eof( ctx ) ) {
+                return FSM_ERROR_TRANSITION;
+            }
+            return state_id_error;
+        default:
+            return FSM_ERROR_STATE;
+    }
+}
@@ -1,5 +1,16 @@
+#include <assert.h>
 #include <string.h>
 #include "fsm.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef FSM_SCAN_AVX2
+#include <immintrin.h>
+#endif
+
+
+/** Value used in the match matrix when no transition matches a byte. */
+#define NO_TRANSITION -1
 
 
 state_id_t fsm_step( const state_t *state, uint8_t c, state_id_t current, void *ctx ) {
@@ -19,12 +30,376 @@ state_id_t fsm_step( const state_t *state, uint8_t c, state_id_t current, void *
 }
 
 
-state_id_t fsm_run( const state_t *states, stream_t *stream, void *ctx ) {
-    uint8_t c;
+/** Fills \c row with the index of the transition taken by each byte in \c state. */
+static void _match_row( const state_t *state, int *row ) {
+    for( size_t b = 0; b < 256; b++ ) {
+        row[b] = NO_TRANSITION;
+    }
+
+    /* goes backwards so the first transition that matches a byte is the one that stays */
+    for( size_t i = state->num_transitions; i-- > 0; ) {
+        const transition_t *transition = &state->transitions[i];
+        if( transition->values == ANY ) {
+            for( size_t b = 0; b < 256; b++ ) {
+                row[b] = i;
+            }
+        } else {
+            for( size_t j = 0; j < transition->values_len; j++ ) {
+                row[( uint8_t )transition->values[j]] = i;
+            }
+        }
+    }
+}
+
+/** Checks if bytes \c a and \c b take the same transitions in every state. */
+static bool _same_class( const int *match, size_t num_states, uint8_t a, uint8_t b ) {
+    for( size_t s = 0; s < num_states; s++ ) {
+        if( match[s * 256 + a] != match[s * 256 + b] ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Finds the transition of \c state that loops back to it and can be skipped (or -1).
+ *
+ *  A loop can be skipped if its action doesn't need to be called per byte, either because there's no action or
+ *  because there's a span action to call for the whole run.
+ */
+static int _find_loop( const state_t *state, state_id_t id ) {
+    for( size_t i = 0; i < state->num_transitions; i++ ) {
+        const transition_t *transition = &state->transitions[i];
+        if( transition->next_state == id && ( transition->action == NULL || transition->span_action != NULL ) ) {
+            return i;
+        }
+    }
+    return NO_TRANSITION;
+}
+
+/** Fills \c bytes with the \c num_bytes found, repeating the first one, and marks \c loop as vector. */
+static void _set_vector_bytes( fsm_loop_t *loop, const uint8_t *bytes, size_t num_bytes ) {
+    for( size_t i = 0; i < FSM_LOOP_MAX_BYTES; i++ ) {
+        loop->bytes[i] = bytes[i < num_bytes ? i : 0];
+    }
+    loop->vector = true;
+}
+
+/** Checks if the bytes that leave \c loop are a range at the start of the byte values plus a few others, or if only a
+ *  few bytes stay in it, and sets it up for the vector kernels if so. */
+static void _compile_vector_loop( fsm_loop_t *loop ) {
+    uint8_t stays[FSM_LOOP_MAX_BYTES];
+    size_t num_stays = 0;
+    for( size_t b = 0; b < 256 && num_stays <= FSM_LOOP_MAX_BYTES; b++ ) {
+        if( loop->stays[b] && num_stays++ < FSM_LOOP_MAX_BYTES ) {
+            stays[num_stays - 1] = b;
+        }
+    }
+    if( num_stays > 0 && num_stays <= FSM_LOOP_MAX_BYTES ) {
+        loop->inverted = true;
+        loop->stop_below = 0;
+        _set_vector_bytes( loop, stays, num_stays );
+        return;
+    }
+
+    size_t b = 0;
+    while( b < 256 && !loop->stays[b] ) {
+        b++;
+    }
+    loop->stop_below = b;
+
+    uint8_t stops[FSM_LOOP_MAX_BYTES];
+    size_t num_stops = 0;
+    for( ; b < 256; b++ ) {
+        if( !loop->stays[b] ) {
+            if( num_stops == FSM_LOOP_MAX_BYTES ) {
+                return;
+            }
+            stops[num_stops++] = b;
+        }
+    }
+
+    /* the kernels always compare every byte, so the unused ones repeat a byte that already leaves the loop */
+    if( num_stops == 0 ) {
+        if( loop->stop_below == 0 ) {
+            return;
+        }
+        stops[num_stops++] = 0;
+    }
+    _set_vector_bytes( loop, stops, num_stops );
+}
+
+/** Builds the loops of a compiled FSM from the match matrix. */
+static bool _compile_loops( fsm_t *fsm, const int *match ) {
+    fsm->loops = calloc( fsm->num_states, sizeof( *fsm->loops ) );
+    fsm->loop_maps = calloc( fsm->num_states, 256 );
+    if( fsm->loops == NULL || fsm->loop_maps == NULL ) {
+        return false;
+    }
+
+    for( size_t s = 0; s < fsm->num_states; s++ ) {
+        int loop = _find_loop( &fsm->states[s], s );
+        if( loop == NO_TRANSITION ) {
+            continue;
+        }
+
+        uint8_t *stays = &fsm->loop_maps[s * 256];
+        for( size_t b = 0; b < 256; b++ ) {
+            stays[b] = ( match[s * 256 + b] == loop );
+        }
+        fsm->loops[s].stays = stays;
+        fsm->loops[s].span_action = fsm->states[s].transitions[loop].span_action;
+        _compile_vector_loop( &fsm->loops[s] );
+#ifdef JAYSON_FSM_PROFILE
+        fsm->loops[s].transition = loop;
+#endif
+    }
+    return true;
+}
+
+bool fsm_compile( fsm_t *fsm, const state_t *states, size_t num_states ) {
+    memset( fsm, 0, sizeof( *fsm ) );
+    fsm->states = states;
+    fsm->num_states = num_states;
+
+    /* matrix with the transition taken in each state for each byte */
+    int *match = malloc( num_states * 256 * sizeof( *match ) );
+    if( match == NULL ) {
+        return false;
+    }
+    for( size_t s = 0; s < num_states; s++ ) {
+        _match_row( &states[s], &match[s * 256] );
+    }
+
+    /* hashes the column of each byte so most class comparisons are a single integer compare */
+    uint64_t hash[256];
+    for( size_t b = 0; b < 256; b++ ) {
+        hash[b] = 14695981039346656037ull;
+        for( size_t s = 0; s < num_states; s++ ) {
+            hash[b] = ( hash[b] ^ ( uint32_t )match[s * 256 + b] ) * 1099511628211ull;
+        }
+    }
+
+    /* groups bytes that behave the same into classes */
+    uint8_t representative[256];
+    for( size_t b = 0; b < 256; b++ ) {
+        size_t k;
+        for( k = 0; k < fsm->num_classes; k++ ) {
+            uint8_t r = representative[k];
+            if( hash[r] == hash[b] && _same_class( match, num_states, r, b ) ) {
+                break;
+            }
+        }
+        if( k == fsm->num_classes ) {
+            representative[fsm->num_classes++] = b;
+        }
+        fsm->byte_class[b] = k;
+    }
+
+    /* builds the dense table */
+    fsm->table = malloc( num_states * fsm->num_classes * sizeof( *fsm->table ) );
+    if( fsm->table == NULL ) {
+        free( match );
+        fsm_release( fsm );
+        return false;
+    }
+    for( size_t s = 0; s < num_states; s++ ) {
+        for( size_t k = 0; k < fsm->num_classes; k++ ) {
+            fsm_entry_t *entry = &fsm->table[s * fsm->num_classes + k];
+            int i = match[s * 256 + representative[k]];
+#ifdef JAYSON_FSM_PROFILE
+            entry->transition = i;
+#endif
+            if( i == NO_TRANSITION ) {
+                entry->next_state = FSM_ERROR_NO_MATCH;
+                entry->action = NULL;
+            } else {
+                entry->next_state = states[s].transitions[i].next_state;
+                entry->action = states[s].transitions[i].action;
+            }
+        }
+    }
+
+    /* finds the loops that can be skipped */
+    if( !_compile_loops( fsm, match ) ) {
+        free( match );
+        fsm_release( fsm );
+        return false;
+    }
+#ifdef __SSE2__
+    fsm->scan = fsm_scan_sse2;
+#endif
+#ifdef FSM_SCAN_AVX2
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        fsm->scan = fsm_scan_avx2;
+    }
+#endif
+
+    free( match );
+    return true;
+}
+
+void fsm_release( fsm_t *fsm ) {
+    free( fsm->table );
+    free( fsm->loops );
+    free( fsm->loop_maps );
+    fsm->table = NULL;
+    fsm->loops = NULL;
+    fsm->loop_maps = NULL;
+}
+
+
+#ifdef __SSE2__
+/** Finds the first byte that leaves a vector loop 16 bytes at a time, the tail is left to the caller. */
+const uint8_t *fsm_scan_sse2( const fsm_loop_t *loop, const uint8_t *begin, const uint8_t *end ) {
+    const __m128i below = _mm_set1_epi8( loop->stop_below );
+    const __m128i byte0 = _mm_set1_epi8( loop->bytes[0] );
+    const __m128i byte1 = _mm_set1_epi8( loop->bytes[1] );
+    const __m128i byte2 = _mm_set1_epi8( loop->bytes[2] );
+    const __m128i byte3 = _mm_set1_epi8( loop->bytes[3] );
+    const unsigned inverted = loop->inverted ? 0xffff : 0;
+
+    const uint8_t *p = begin;
+    for( ; p + 16 <= end; p += 16 ) {
+        __m128i block = _mm_loadu_si128( ( const __m128i * )p );
+        /* max( block, below ) == block for the bytes that are not below the range */
+        __m128i in_range = _mm_cmpeq_epi8( _mm_max_epu8( block, below ), block );
+        __m128i bytes = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( block, byte0 ), _mm_cmpeq_epi8( block, byte1 ) ),
+                                      _mm_or_si128( _mm_cmpeq_epi8( block, byte2 ), _mm_cmpeq_epi8( block, byte3 ) ) );
+        unsigned mask = ( _mm_movemask_epi8( in_range ) ^ 0xffff ) | ( _mm_movemask_epi8( bytes ) ^ inverted );
+        if( mask != 0 ) {
+            return p + __builtin_ctz( mask );
+        }
+    }
+    return p;
+}
+#endif
+
+#ifdef FSM_SCAN_AVX2
+/** Same as \c fsm_scan_sse2 with 32 bytes at a time, only called if the CPU has AVX2. */
+__attribute__( ( target( "avx2" ) ) )
+const uint8_t *fsm_scan_avx2( const fsm_loop_t *loop, const uint8_t *begin, const uint8_t *end ) {
+    const __m256i below = _mm256_set1_epi8( loop->stop_below );
+    const __m256i byte0 = _mm256_set1_epi8( loop->bytes[0] );
+    const __m256i byte1 = _mm256_set1_epi8( loop->bytes[1] );
+    const __m256i byte2 = _mm256_set1_epi8( loop->bytes[2] );
+    const __m256i byte3 = _mm256_set1_epi8( loop->bytes[3] );
+    const uint32_t inverted = loop->inverted ? 0xffffffff : 0;
+
+    const uint8_t *p = begin;
+    for( ; p + 32 <= end; p += 32 ) {
+        __m256i block = _mm256_loadu_si256( ( const __m256i * )p );
+        __m256i in_range = _mm256_cmpeq_epi8( _mm256_max_epu8( block, below ), block );
+        __m256i bytes = _mm256_or_si256(
+            _mm256_or_si256( _mm256_cmpeq_epi8( block, byte0 ), _mm256_cmpeq_epi8( block, byte1 ) ),
+            _mm256_or_si256( _mm256_cmpeq_epi8( block, byte2 ), _mm256_cmpeq_epi8( block, byte3 ) ) );
+        uint32_t mask = ~( uint32_t )_mm256_movemask_epi8( in_range ) | ( ( uint32_t )_mm256_movemask_epi8( bytes ) ^ inverted );
+        if( mask != 0 ) {
+            return p + __builtin_ctz( mask );
+        }
+    }
+    return p;
+}
+#endif
+
+
+/** Returns the first byte in [\c p, \c end) that leaves \c loop, the run before \c p already stays in it. */
+static inline const uint8_t *_skip_run( const fsm_t *fsm, const fsm_loop_t *loop, const uint8_t *p,
+                                        const uint8_t *end ) {
+    /* runs of one byte, like the space after a colon, are not worth a kernel call */
+    if( loop->vector && fsm->scan != NULL && p < end && loop->stays[*p] ) {
+        p = fsm->scan( loop, p, end );
+    }
+    /* scalar scan of the tail the kernel left, or of the whole run */
+    while( p < end && loop->stays[*p] ) {
+        p++;
+    }
+    return p;
+}
+
+/** Skips the run of bytes at \c begin that keep the FSM in \c state, like \c fsm_run_span does, so a caller can look
+ *  past it (e.g. past the whitespace before a token). The loop of \c state must have no span action.
+ *
+ *  @return The first byte that leaves the loop (\c begin if the state has no loop to skip, or \c end).
+ */
+const uint8_t *fsm_skip_loop( const fsm_t *fsm, state_id_t state, const uint8_t *begin, const uint8_t *end ) {
+    const fsm_loop_t *loop = &fsm->loops[state];
+    assert( loop->span_action == NULL );
+    if( loop->stays == NULL || begin == end || !loop->stays[*begin] ) {
+        return begin;
+    }
+    const uint8_t *p = _skip_run( fsm, loop, begin + 1, end );
+#ifdef JAYSON_FSM_PROFILE
+    fsm_profile_count( fsm, state, loop->transition, p - begin );
+#endif
+    return p;
+}
+
+/** Runs a compiled FSM over a contiguous buffer.
+ *
+ *  Stops at the end of the buffer or as soon as the FSM reaches the end state or fails. Runs of bytes that loop
+ *  back to the same state are skipped at once (see \c fsm_loop_t), and states with a fast path handle what they can
+ *  before their transitions (see \c state_t).
+ *
+ *  @param fsm Compiled FSM.
+ *  @param state State to start from, set to the state the FSM stopped at.
+ *  @param begin First byte of the buffer.
+ *  @param end One past the last byte of the buffer.
+ *  @param ctx Context passed to the transition actions.
+ *  @return One past the last byte consumed.
+ */
+const uint8_t *fsm_run_span( const fsm_t *fsm, state_id_t *state, const uint8_t *begin, const uint8_t *end, void *ctx ) {
+    state_id_t current = *state;
+    const uint8_t *p = begin;
+
+    while( p < end ) {
+        /* skips the whole run of bytes that keep the FSM in the current state */
+        const fsm_loop_t *loop = &fsm->loops[current];
+        if( loop->stays != NULL && loop->stays[*p] ) {
+            const uint8_t *run = p;
+            p = _skip_run( fsm, loop, p + 1, end );
+#ifdef JAYSON_FSM_PROFILE
+            fsm_profile_count( fsm, current, loop->transition, p - run );
+#endif
+            if( loop->span_action != NULL && !loop->span_action( ctx, run, p - run ) ) {
+                current = FSM_ERROR_TRANSITION;
+                break;
+            }
+            continue;
+        }
+
+        /* lets the state handle as much input as it can in one go */
+        const state_t *st = &fsm->states[current];
+        if( st->fast_path != NULL ) {
+            size_t handled = st->fast_path( ctx, p, end - p );
+            if( handled > 0 ) {
+                p += handled;
+                current = st->fast_path_state;
+                if( current == FSM_END_STATE ) {
+                    break;
+                }
+                continue;
+            }
+        }
+
+        current = fsm_step_compiled( fsm, current, *p++, ctx );
+        if( current < 0 || current == FSM_END_STATE ) {
+            break;
+        }
+    }
+
+    *state = current;
+    return p;
+}
+
+state_id_t fsm_run( const fsm_t *fsm, stream_t *stream, void *ctx ) {
+    const uint8_t *data;
+    size_t data_len;
     state_id_t state = FSM_INITIAL_STATE;
+    const state_t *states = fsm->states;
 
-    while( stream_get( stream, &c ) ) {
-        state = fsm_step( &states[state], c, state, ctx );
+    while( stream_peek_span( stream, &data, &data_len ) ) {
+        const uint8_t *stop = fsm_run_span( fsm, &state, data, data + data_len, ctx );
+        stream_consume( stream, stop - data );
         if( state < 0 || state == FSM_END_STATE ) {
             return state;
         }
@@ -42,3 +417,126 @@ state_id_t fsm_run( const state_t *states, stream_t *stream, void *ctx ) {
     }
     return states[state].transition_eof.next_state;
 }
+
+/** Same as \c fsm_run over the input already in the stream buffer, without reading more.
+ *
+ *  @return The state \c fsm_run would return, or \c FSM_BUFFER_END if the buffer ends before the FSM stops, in which
+ *          case nothing is consumed (the actions of the transitions taken until then were executed anyway).
+ */
+state_id_t fsm_run_buffered( const fsm_t *fsm, stream_t *stream, void *ctx ) {
+    const uint8_t *data;
+    size_t data_len;
+    state_id_t state = FSM_INITIAL_STATE;
+
+    if( stream->bytes_left == 0 || !stream_peek_span( stream, &data, &data_len ) ) {
+        return FSM_BUFFER_END;
+    }
+    const uint8_t *stop = fsm_run_span( fsm, &state, data, data + data_len, ctx );
+    if( state >= 0 && state != FSM_END_STATE ) {
+        return FSM_BUFFER_END;
+    }
+    stream_consume( stream, stop - data );
+    return state;
+}
+
+
+#ifdef JAYSON_FSM_PROFILE
+/** Makes \c fsm update the counters in \c profile, allocating them the first time the profile is attached. */
+bool fsm_profile_attach( fsm_t *fsm, fsm_profile_t *profile ) {
+    if( profile->states == NULL ) {
+        size_t num_transitions = 0;
+        profile->first_transition = calloc( fsm->num_states, sizeof( *profile->first_transition ) );
+        if( profile->first_transition == NULL ) {
+            return false;
+        }
+        for( size_t s = 0; s < fsm->num_states; s++ ) {
+            profile->first_transition[s] = num_transitions;
+            num_transitions += fsm->states[s].num_transitions;
+        }
+
+        profile->visits = calloc( fsm->num_states, sizeof( *profile->visits ) );
+        profile->no_match = calloc( fsm->num_states, sizeof( *profile->no_match ) );
+        profile->taken = calloc( num_transitions + 1, sizeof( *profile->taken ) );
+        if( profile->visits == NULL || profile->no_match == NULL || profile->taken == NULL ) {
+            free( profile->first_transition );
+            free( profile->visits );
+            free( profile->no_match );
+            free( profile->taken );
+            return false;
+        }
+        profile->states = fsm->states;
+        profile->num_states = fsm->num_states;
+    }
+
+    fsm->profile = profile;
+    return true;
+}
+
+/** Prints the values of a transition escaping the ones that are not printable. */
+static void _dump_values( const transition_t *transition, FILE *out ) {
+    if( transition->values == ANY ) {
+        fprintf( out, "ANY" );
+        return;
+    }
+    fputc( '"', out );
+    for( size_t i = 0; i < transition->values_len; i++ ) {
+        uint8_t c = transition->values[i];
+        if( c >= 0x20 && c < 0x7f && c != '"' && c != '\\' ) {
+            fputc( c, out );
+        } else {
+            fprintf( out, "\\x%02x", c );
+        }
+    }
+    fputc( '"', out );
+}
+
+/** Returns a printable name for a state. */
+static const char *_state_name( const fsm_profile_t *profile, state_id_t id ) {
+    if( id >= 0 && ( size_t )id < profile->num_states && profile->states[id].name != NULL ) {
+        return profile->states[id].name;
+    }
+    switch( id ) {
+        case FSM_END_STATE:
+            return "end";
+        case FSM_ERROR_STATE:
+            return "error";
+        default:
+            return "?";
+    }
+}
+
+/** Prints the counters of a profile, with transitions in the order they are scanned. */
+void fsm_profile_dump( const fsm_profile_t *profile, const char *title, FILE *out ) {
+    uint64_t total = 0;
+    for( size_t s = 0; s < profile->num_states; s++ ) {
+        total += profile->visits[s];
+    }
+    fprintf( out, "%s: %llu inputs, %.2f transitions scanned per input\n",
+             title,
+             ( unsigned long long )total,
+             total ? ( double )profile->scanned / total : 0.0 );
+
+    for( size_t s = 0; s < profile->num_states; s++ ) {
+        const state_t *state = &profile->states[s];
+        uint64_t visits = profile->visits[s];
+        if( visits == 0 ) {
+            continue;
+        }
+        fprintf( out, "  %-24s %12llu visits (%5.1f%%)\n",
+                 _state_name( profile, s ),
+                 ( unsigned long long )visits,
+                 100.0 * visits / total );
+
+        for( size_t i = 0; i < state->num_transitions; i++ ) {
+            const transition_t *transition = &state->transitions[i];
+            uint64_t taken = profile->taken[profile->first_transition[s] + i];
+            fprintf( out, "    #%-2zu %12llu (%5.1f%%) ", i, ( unsigned long long )taken, 100.0 * taken / visits );
+            _dump_values( transition, out );
+            fprintf( out, " -> %s\n", _state_name( profile, transition->next_state ) );
+        }
+        if( profile->no_match[s] != 0 ) {
+            fprintf( out, "    no match %llu\n", ( unsigned long long )profile->no_match[s] );
+        }
+    }
+}
+#endif
@@ -15,6 +15,9 @@
 /** Value returned by the FSM if the input stream returned error. */
 #define FSM_ERROR_STREAM -3
 
+/** Value returned by \c fsm_run_buffered if the buffered input ends before the FSM stops. */
+#define FSM_BUFFER_END -2
+
 /** Value returned by the FSM indicating no transition matched an input. */
 #define FSM_ERROR_STATE -1
 
@@ -36,9 +39,18 @@ typedef int state_id_t;
 /** Callback executed when a transition is taken. */
 typedef bool ( *transition_action_cb_t )( void *ctx, char c );
 
+/** Callback executed once for a run of values that keep the FSM in the same state. */
+typedef bool ( *transition_span_action_cb_t )( void *ctx, const uint8_t *data, size_t data_len );
+
 /** Callback executed when a transition to the end of file state is taken. */
 typedef bool ( *transition_eof_action_cb_t )( void *ctx );
 
+/** Callback that handles the input of a state in one go when it can (see \c state_t).
+ *
+ *  @return Number of bytes of \c data handled, or 0 to leave them to the transitions of the state.
+ */
+typedef size_t ( *state_fast_path_cb_t )( void *ctx, const uint8_t *data, size_t data_len );
+
 /** Defines a transition to a new state. */
 typedef struct {
     /** Array of values that trigger the transition. */
@@ -49,6 +61,9 @@ typedef struct {
     state_id_t next_state;
     /** Action executed if the transition is taken (or \c NULL). */
     transition_action_cb_t action;
+    /** Action executed for a whole run of values if the transition loops to the same state (or \c NULL). Must
+     *  have the same effect as calling \c action for each value, and lets the FSM skip the run in one go. */
+    transition_span_action_cb_t span_action;
 } transition_t;
 
 /** Transition triggered by an end of file. */
@@ -61,17 +76,171 @@ typedef struct {
 
 /** FSM state. */
 typedef struct {
+    /** State name (used to report profiling data). */
+    const char *name;
     /** Array of transitions that compose the state. */
     transition_t *transitions;
     /** Number of transitions in \c transitions. */
     size_t num_transitions;
     /** Transition triggered if the end of file is reached. */
     transition_eof_t transition_eof;
+    /** Callback tried on the buffered input before the transitions when the FSM is in the state (or \c NULL). Must
+     *  have the same effect as the transitions it skips, which are left to handle errors and buffer boundaries. */
+    state_fast_path_cb_t fast_path;
+    /** State the FSM moves to after \c fast_path handles some input. */
+    state_id_t fast_path_state;
 } state_t;
 
+/** Entry of a compiled FSM table. */
+typedef struct {
+    /** Next state if the entry is taken (\c FSM_ERROR_NO_MATCH if no transition matched). */
+    state_id_t next_state;
+    /** Action executed if the entry is taken (or \c NULL). */
+    transition_action_cb_t action;
+#ifdef JAYSON_FSM_PROFILE
+    /** Index of the transition in its state (or -1 if no transition matched). */
+    int transition;
+#endif
+} fsm_entry_t;
+
+/** Maximum number of bytes compared by the vector scan of a loop (see \c fsm_loop_t). */
+#define FSM_LOOP_MAX_BYTES 4
+
+/** Loop of a compiled state that can be skipped in one go. */
+typedef struct {
+    /** Maps each byte to 1 if it keeps the FSM in the state (\c NULL if the state has no loop to skip). */
+    const uint8_t *stays;
+    /** Action executed for each run of bytes that keep the FSM in the state (or \c NULL). */
+    transition_span_action_cb_t span_action;
+    /** \c true if the loop can be skipped with a vector scan (see \c fsm_scan_t). The bytes that leave the loop
+     *  are the ones below \c stop_below plus the ones in \c bytes or, if \c inverted, the ones not in \c bytes. */
+    bool vector;
+    /** \c true if \c bytes are the ones that stay in the loop, like the whitespace between tokens. */
+    bool inverted;
+    /** Every byte below this value leaves the loop (0 if \c inverted). */
+    uint8_t stop_below;
+    /** Bytes compared by the vector scan, repeated to fill the array. */
+    uint8_t bytes[FSM_LOOP_MAX_BYTES];
+#ifdef JAYSON_FSM_PROFILE
+    /** Index of the loop transition in its state. */
+    int transition;
+#endif
+} fsm_loop_t;
+
+#ifdef JAYSON_FSM_PROFILE
+/** Counters collected by the FSMs attached to it.
+ *
+ *  A profile outlives the FSMs that are compiled for each run, so the counters add up over every run. Counters are
+ *  not updated atomically.
+ */
+typedef struct {
+    /** States the counters refer to. */
+    const state_t *states;
+    /** Number of states in \c states. */
+    size_t num_states;
+    /** Number of inputs processed in each state. */
+    uint64_t *visits;
+    /** Number of times each transition was taken, starting at \c first_transition[state] for each state. */
+    uint64_t *taken;
+    /** Index in \c taken of the first transition of each state. */
+    size_t *first_transition;
+    /** Number of inputs that matched no transition in each state. */
+    uint64_t *no_match;
+    /** Number of transitions a linear scan compares before finding a match (or giving up), over all inputs. */
+    uint64_t scanned;
+} fsm_profile_t;
+#endif
+
+/* the AVX2 kernel is compiled for x86-64 with GCC or clang and used if the CPU has AVX2 */
+#if defined( __x86_64__ ) && defined( __GNUC__ )
+#define FSM_SCAN_AVX2
+#endif
+
+/** Kernel that returns the first byte in [\c begin, \c end) that leaves a vector loop (or \c end). */
+typedef const uint8_t *( *fsm_scan_t )( const fsm_loop_t *loop, const uint8_t *begin, const uint8_t *end );
+
+/** FSM compiled into a dense table indexed by state and byte class. */
+typedef struct {
+    /** States the FSM was compiled from (used for the end of file transitions). */
+    const state_t *states;
+    /** Number of states in \c states. */
+    size_t num_states;
+    /** Maps each input byte to its byte class. Bytes in the same class behave the same in every state. */
+    uint8_t byte_class[256];
+    /** Number of different byte classes. */
+    size_t num_classes;
+    /** Table of \c num_states rows by \c num_classes entries. */
+    fsm_entry_t *table;
+    /** Loop of each state. */
+    fsm_loop_t *loops;
+    /** Storage for the \c stays maps of the loops. */
+    uint8_t *loop_maps;
+    /** Kernel for the vector loops, the widest the CPU supports (or \c NULL to scan them with \c stays). */
+    fsm_scan_t scan;
+#ifdef JAYSON_FSM_PROFILE
+    /** Profile updated by the FSM (or \c NULL). */
+    fsm_profile_t *profile;
+#endif
+} fsm_t;
+
+
+#ifdef JAYSON_FSM_PROFILE
+/** Counts \c count inputs processed in \c state that took \c transition (-1 if none matched). */
+static inline void fsm_profile_count( const fsm_t *fsm, state_id_t state, int transition, uint64_t count ) {
+    fsm_profile_t *profile = fsm->profile;
+    if( profile == NULL ) {
+        return;
+    }
+    profile->visits[state] += count;
+    if( transition < 0 ) {
+        profile->no_match[state] += count;
+        profile->scanned += count * profile->states[state].num_transitions;
+    } else {
+        profile->taken[profile->first_transition[state] + transition] += count;
+        profile->scanned += count * ( transition + 1 );
+    }
+}
+#endif
+
+
+/** Executes a single step of a compiled FSM.
+ *
+ *  @param fsm Compiled FSM.
+ *  @param current Current state.
+ *  @param c Input value.
+ *  @param ctx Context passed to the transition action.
+ *  @return The next state or an FSM error value.
+ */
+static inline state_id_t fsm_step_compiled( const fsm_t *fsm, state_id_t current, uint8_t c, void *ctx ) {
+    const fsm_entry_t *entry = &fsm->table[( size_t )current * fsm->num_classes + fsm->byte_class[c]];
+#ifdef JAYSON_FSM_PROFILE
+    fsm_profile_count( fsm, current, entry->transition, 1 );
+#endif
+    if( entry->action != NULL && !entry->action( ctx, c ) ) {
+        return FSM_ERROR_TRANSITION;
+    }
+    return entry->next_state;
+}
+
 
 state_id_t fsm_step( const state_t *state, uint8_t c, state_id_t current, void *ctx );
-state_id_t fsm_run( const state_t *states, stream_t *stream, void *ctx );
+bool fsm_compile( fsm_t *fsm, const state_t *states, size_t num_states );
+void fsm_release( fsm_t *fsm );
+const uint8_t *fsm_run_span( const fsm_t *fsm, state_id_t *state, const uint8_t *begin, const uint8_t *end, void *ctx );
+const uint8_t *fsm_skip_loop( const fsm_t *fsm, state_id_t state, const uint8_t *begin, const uint8_t *end );
+#ifdef __SSE2__
+const uint8_t *fsm_scan_sse2( const fsm_loop_t *loop, const uint8_t *begin, const uint8_t *end );
+#endif
+#ifdef FSM_SCAN_AVX2
+const uint8_t *fsm_scan_avx2( const fsm_loop_t *loop, const uint8_t *begin, const uint8_t *end );
+#endif
+state_id_t fsm_run( const fsm_t *fsm, stream_t *stream, void *ctx );
+state_id_t fsm_run_buffered( const fsm_t *fsm, stream_t *stream, void *ctx );
+
+#ifdef JAYSON_FSM_PROFILE
+bool fsm_profile_attach( fsm_t *fsm, fsm_profile_t *profile );
+void fsm_profile_dump( const fsm_profile_t *profile, const char *title, FILE *out );
+#endif
 
 
 #endif
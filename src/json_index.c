@@ -0,0 +1,202 @@
+#include "json_index.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef JSON_INDEX_AVX2
+#include <immintrin.h>
+#endif
+
+
+/** Bits of the bytes at even positions of a block. */
+#define EVEN_BITS 0x5555555555555555ULL
+
+
+bool json_index_init( json_index_t *index ) {
+    varray_init( index->offsets, 256 );
+    if( index->offsets == NULL ) {
+        return false;
+    }
+    index->offsets[0] = UINT32_MAX;
+    index->base = 0;
+    index->end = 0;
+    index->next = 0;
+    index->skipped = false;
+
+    index->classify = json_index_classify_scalar;
+#ifdef __SSE2__
+    index->classify = json_index_classify_sse2;
+#endif
+#ifdef JSON_INDEX_AVX2
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        index->classify = json_index_classify_avx2;
+    }
+#endif
+    return true;
+}
+
+void json_index_release( json_index_t *index ) {
+    varray_release( index->offsets );
+}
+
+/** Classifies a byte at a time, for CPUs without a vector kernel. */
+void json_index_classify_scalar( const uint8_t *block, json_index_masks_t *masks ) {
+    *masks = ( json_index_masks_t ){ 0 };
+    for( int i = 0; i < JSON_INDEX_BLOCK; i++ ) {
+        uint64_t bit = 1ULL << i;
+        switch( block[i] ) {
+            case '"':
+                masks->quote |= bit;
+                break;
+            case '\\':
+                masks->backslash |= bit;
+                break;
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',':
+                masks->op |= bit;
+                break;
+            default:
+                masks->control |= block[i] < 0x20 ? bit : 0;
+                break;
+        }
+    }
+}
+
+#ifdef __SSE2__
+/** Classifies 16 bytes at a time. */
+void json_index_classify_sse2( const uint8_t *block, json_index_masks_t *masks ) {
+    *masks = ( json_index_masks_t ){ 0 };
+    for( int i = 0; i < JSON_INDEX_BLOCK; i += 16 ) {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )&block[i] );
+        /* sets the bit that tells [ from { and ] from } */
+        __m128i lower = _mm_or_si128( v, _mm_set1_epi8( 0x20 ) );
+        __m128i op = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( lower, _mm_set1_epi8( '{' ) ),
+                                                 _mm_cmpeq_epi8( lower, _mm_set1_epi8( '}' ) ) ),
+                                   _mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( ':' ) ),
+                                                 _mm_cmpeq_epi8( v, _mm_set1_epi8( ',' ) ) ) );
+        __m128i control = _mm_cmpeq_epi8( _mm_min_epu8( v, _mm_set1_epi8( 0x1f ) ), v );
+
+        masks->quote |= ( uint64_t )_mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_set1_epi8( '"' ) ) ) << i;
+        masks->backslash |= ( uint64_t )_mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_set1_epi8( '\\' ) ) ) << i;
+        masks->op |= ( uint64_t )_mm_movemask_epi8( op ) << i;
+        masks->control |= ( uint64_t )_mm_movemask_epi8( control ) << i;
+    }
+}
+#endif
+
+#ifdef JSON_INDEX_AVX2
+/** Returns the bit mask of the bytes of \c v that are equal to \c c. */
+__attribute__( ( target( "avx2" ) ) )
+static inline uint64_t _eq_avx2( __m256i v, char c ) {
+    return ( uint32_t )_mm256_movemask_epi8( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( c ) ) );
+}
+
+/** Classifies 32 bytes at a time, only called if the CPU has AVX2. */
+__attribute__( ( target( "avx2" ) ) )
+void json_index_classify_avx2( const uint8_t *block, json_index_masks_t *masks ) {
+    *masks = ( json_index_masks_t ){ 0 };
+    for( int i = 0; i < JSON_INDEX_BLOCK; i += 32 ) {
+        __m256i v = _mm256_loadu_si256( ( const __m256i * )&block[i] );
+        /* sets the bit that tells [ from { and ] from } */
+        __m256i lower = _mm256_or_si256( v, _mm256_set1_epi8( 0x20 ) );
+        __m256i control = _mm256_cmpeq_epi8( _mm256_min_epu8( v, _mm256_set1_epi8( 0x1f ) ), v );
+
+        masks->quote |= _eq_avx2( v, '"' ) << i;
+        masks->backslash |= _eq_avx2( v, '\\' ) << i;
+        masks->op |= ( _eq_avx2( lower, '{' ) | _eq_avx2( lower, '}' ) | _eq_avx2( v, ':' ) | _eq_avx2( v, ',' ) ) << i;
+        masks->control |= ( uint64_t )( uint32_t )_mm256_movemask_epi8( control ) << i;
+    }
+}
+#endif
+
+/** Finds the bytes escaped by a backslash, the ones after an odd run of backslashes.
+ *
+ *  @param backslash Backslashes of the block.
+ *  @param carry 1 if the previous block ended with an odd run of backslashes, set for the next block.
+ */
+static inline uint64_t _escaped( uint64_t backslash, uint64_t *carry ) {
+    /* a run that starts at an even position escapes the byte after it if it ends at an odd one, and the other way
+     * around, which shows in the bits left by adding each run to its start (the carry goes one past the run) */
+    uint64_t starts = backslash & ~( backslash << 1 );
+    uint64_t even_start_mask = EVEN_BITS ^ *carry;
+    uint64_t even_carries = backslash + ( starts & even_start_mask );
+    uint64_t odd_carries = backslash + ( starts & ~even_start_mask );
+    bool ends_odd = odd_carries < backslash;
+    odd_carries |= *carry;
+    *carry = ends_odd;
+    return ( even_carries & ~backslash & ~EVEN_BITS ) | ( odd_carries & ~backslash & EVEN_BITS );
+}
+
+/** Sets each bit to the XOR of itself and every bit below it, so the bits between two quotes are set. */
+static inline uint64_t _prefix_xor( uint64_t bits ) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/** Indexes the structurals of the whole blocks at the start of \c data, replacing the window of \c index.
+ *
+ *  Bytes past the last whole block, or past \c JSON_INDEX_WINDOW bytes, are left out of the window.
+ *
+ *  @param index Index.
+ *  @param base Offset of \c data in the input, which must not be inside a string.
+ *  @param data First byte to index.
+ *  @param data_len Number of bytes in \c data.
+ */
+void json_index_build( json_index_t *index, size_t base, const uint8_t *data, size_t data_len ) {
+    size_t len = data_len < JSON_INDEX_WINDOW ? data_len : JSON_INDEX_WINDOW;
+    len -= len % JSON_INDEX_BLOCK;
+
+    /* all ones while inside a string */
+    uint64_t in_string = 0;
+    uint64_t escape_carry = 0;
+    varray_len( index->offsets ) = 0;
+    for( size_t i = 0; i < len; i += JSON_INDEX_BLOCK ) {
+        json_index_masks_t masks;
+        index->classify( &data[i], &masks );
+
+        /* the bits of the quotes and the bytes between an opening quote and its closing one, which only change in
+         * blocks with quotes (the middle of long strings has none) */
+        uint64_t quote = 0;
+        uint64_t string = in_string;
+        if( ( masks.quote | masks.backslash | escape_carry ) != 0 ) {
+            quote = masks.quote & ~_escaped( masks.backslash, &escape_carry );
+            string = _prefix_xor( quote ) ^ in_string;
+            in_string = ( uint64_t )( ( int64_t )string >> 63 );
+        }
+        uint64_t structural = ( masks.op & ~string ) | quote | ( ( masks.backslash | masks.control ) & string );
+
+        varray_reserve( index->offsets, JSON_INDEX_BLOCK + 1 );
+        uint32_t *out = &index->offsets[varray_len( index->offsets )];
+        while( structural != 0 ) {
+            *out++ = i + __builtin_ctzll( structural );
+            structural &= structural - 1;
+        }
+        varray_len( index->offsets ) = out - index->offsets;
+    }
+
+    varray_reserve( index->offsets, 1 );
+    index->offsets[varray_len( index->offsets )] = UINT32_MAX;
+    index->base = base;
+    index->end = base + len;
+    index->next = 0;
+    index->skipped = false;
+}
+
+/** Replaces the window of \c index with the \c len bytes from \c base without indexing them, so every structural
+ *  in them is left to the caller. */
+void json_index_skip( json_index_t *index, size_t base, size_t len ) {
+    varray_len( index->offsets ) = 0;
+    index->offsets[0] = UINT32_MAX;
+    index->base = base;
+    index->end = base + len;
+    index->next = 0;
+    index->skipped = true;
+}
@@ -0,0 +1,90 @@
+#ifndef JSON_INDEX_H
+#define JSON_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "varray.h"
+
+
+/** Number of bytes classified at once, one bit each. */
+#define JSON_INDEX_BLOCK 64
+
+/** Maximum number of bytes indexed by \c json_index_build, so a memory mapped file isn't indexed in one go. */
+#define JSON_INDEX_WINDOW ( 64 * 1024 )
+
+/* the AVX2 kernel is compiled for x86-64 with GCC or clang and used if the CPU has AVX2 */
+#if defined( __x86_64__ ) && defined( __GNUC__ )
+#define JSON_INDEX_AVX2
+#endif
+
+/** Bitmaps of the bytes of a block that the index looks at, bit \c i is set if byte \c i is in the class. */
+typedef struct {
+    /** Double quotes. */
+    uint64_t quote;
+    /** Backslashes. */
+    uint64_t backslash;
+    /** Operators: <tt>{ } [ ] : ,</tt>. */
+    uint64_t op;
+    /** Bytes below 0x20, which can't be in strings. */
+    uint64_t control;
+} json_index_masks_t;
+
+/** Kernel that classifies the \c JSON_INDEX_BLOCK bytes at \c block. */
+typedef void ( *json_index_classify_t )( const uint8_t *block, json_index_masks_t *masks );
+
+/** Offsets of the structural characters of a window of the input.
+ *
+ *  The structurals are the operators outside strings, the quotes that start and end strings, and the backslashes and
+ *  control characters inside strings. The tokenizer jumps from one to the next: a quote followed by a quote is a whole
+ *  string without escapes, anything else inside a string is left to the FSM.
+ */
+typedef struct {
+    /** Offset in the input of the first byte of the window. */
+    size_t base;
+    /** Offset in the input past the last byte of the window (\c base if there is no window). */
+    size_t end;
+    /** varray with the offsets from \c base of the structurals in the window, in order, and \c UINT32_MAX after
+     *  them. */
+    uint32_t *offsets;
+    /** Index in \c offsets of the first structural that wasn't passed yet (see \c json_index_seek). */
+    size_t next;
+    /** \c true if the window was skipped instead of indexed (see \c json_index_skip). */
+    bool skipped;
+    /** Kernel used to classify the bytes, the widest the CPU supports. */
+    json_index_classify_t classify;
+} json_index_t;
+
+
+bool json_index_init( json_index_t *index );
+void json_index_release( json_index_t *index );
+void json_index_build( json_index_t *index, size_t base, const uint8_t *data, size_t data_len );
+void json_index_skip( json_index_t *index, size_t base, size_t len );
+void json_index_classify_scalar( const uint8_t *block, json_index_masks_t *masks );
+#ifdef __SSE2__
+void json_index_classify_sse2( const uint8_t *block, json_index_masks_t *masks );
+#endif
+#ifdef JSON_INDEX_AVX2
+void json_index_classify_avx2( const uint8_t *block, json_index_masks_t *masks );
+#endif
+
+/** Moves the cursor of \c index to the first structural at or after \c offset in the input.
+ *
+ *  @return Index in \c index->offsets of the structural, or -1 if there is none before the end of the window (or
+ *          \c offset is outside of it).
+ */
+static inline long json_index_seek( json_index_t *index, size_t offset ) {
+    if( offset < index->base || offset >= index->end ) {
+        return -1;
+    }
+    uint32_t relative = offset - index->base;
+    size_t next = index->next;
+    while( index->offsets[next] < relative ) {
+        next += 1;
+    }
+    index->next = next;
+    return index->offsets[next] != UINT32_MAX ? ( long )next : -1;
+}
+
+
+#endif
@@ -0,0 +1,277 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_number.h"
+
+
+/** Range of the powers of 10 that can give a finite, non zero double from a 64 bit mantissa. */
+#define POW5_MIN_EXPONENT -342
+#define POW5_MAX_EXPONENT 308
+
+/** Bits of a double. */
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_INFINITE_EXPONENT 0x7ff
+#define DOUBLE_EXPONENT_BIAS 1023
+
+
+/** Powers of 5 truncated to 128 bits, indexed by exponent - \c POW5_MIN_EXPONENT. */
+static const uint64_t _pow5[][2] = {
+#include "json_number_pow5.h"
+};
+
+#if FLT_EVAL_METHOD == 0
+/** Powers of 10 that are exact in a double. */
+static const double _pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+#endif
+
+
+/** Computes the 128 bit product of \c a and \c b. */
+static inline void _multiply( uint64_t a, uint64_t b, uint64_t *high, uint64_t *low ) {
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 uint128_t;
+    uint128_t product = ( uint128_t )a * b;
+    *high = product >> 64;
+    *low = ( uint64_t )product;
+#else
+    uint64_t a_low = ( uint32_t )a, a_high = a >> 32;
+    uint64_t b_low = ( uint32_t )b, b_high = b >> 32;
+    uint64_t low_low = a_low * b_low;
+    uint64_t low_high = a_low * b_high;
+    uint64_t high_low = a_high * b_low;
+    uint64_t middle = ( low_low >> 32 ) + ( uint32_t )low_high + ( uint32_t )high_low;
+    *low = ( middle << 32 ) | ( uint32_t )low_low;
+    *high = a_high * b_high + ( low_high >> 32 ) + ( high_low >> 32 ) + ( middle >> 32 );
+#endif
+}
+
+/** Converts \c w * 10^q to the bits of the closest double with the Eisel-Lemire algorithm.
+ *
+ *  The product of \c w and the truncated power of 5 is exact enough to round in all but a few cases, which are
+ *  reported so the caller can take a slow path.
+ *
+ *  @return \c false if the result can't be rounded with certainty.
+ */
+static bool _eisel_lemire( uint64_t w, int64_t q, uint64_t *bits ) {
+    if( w == 0 || q < POW5_MIN_EXPONENT ) {
+        *bits = 0;
+        return true;
+    }
+    if( q > POW5_MAX_EXPONENT ) {
+        *bits = ( uint64_t )DOUBLE_INFINITE_EXPONENT << DOUBLE_MANTISSA_BITS;
+        return true;
+    }
+
+    int leading_zeros = __builtin_clzll( w );
+    w <<= leading_zeros;
+
+    /* only the top 55 bits are needed: the mantissa, the hidden bit and 2 bits to round */
+    const uint64_t *pow5 = _pow5[q - POW5_MIN_EXPONENT];
+    uint64_t high, low;
+    _multiply( w, pow5[0], &high, &low );
+    const uint64_t precision_mask = UINT64_MAX >> ( DOUBLE_MANTISSA_BITS + 3 );
+    if( ( high & precision_mask ) == precision_mask ) {
+        /* the low bits of the power can still carry into the top 55 bits */
+        uint64_t second_high, second_low;
+        _multiply( w, pow5[1], &second_high, &second_low );
+        low += second_high;
+        high += second_high > low;
+    }
+    if( low == UINT64_MAX && ( q < -27 || q > 55 ) ) {
+        return false;
+    }
+
+    int upper_bit = high >> 63;
+    int shift = upper_bit + 64 - DOUBLE_MANTISSA_BITS - 3;
+    uint64_t mantissa = high >> shift;
+    /* floor( q * log2( 10 ) ) + 63, with log2( 10 ) ~ 217706 / 2^16 */
+    int64_t power2 = ( ( 217706 * q ) >> 16 ) + 63 + upper_bit - leading_zeros + DOUBLE_EXPONENT_BIAS;
+
+    if( power2 <= 0 ) {
+        /* subnormal numbers */
+        if( -power2 + 1 >= 64 ) {
+            *bits = 0;
+            return true;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        /* rounding up can make it the smallest normal number, whose exponent bit is the hidden bit */
+        power2 = mantissa < ( 1ULL << DOUBLE_MANTISSA_BITS ) ? 0 : 1;
+        *bits = mantissa | ( uint64_t )power2 << DOUBLE_MANTISSA_BITS;
+        return true;
+    }
+
+    /* halfway between two doubles, which only happens for small exponents, rounds to even */
+    if( low <= 1 && q >= -4 && q <= 23 && ( mantissa & 3 ) == 1 && ( mantissa << shift ) == high ) {
+        mantissa &= ~( uint64_t )1;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if( mantissa >= ( 2ULL << DOUBLE_MANTISSA_BITS ) ) {
+        mantissa = 1ULL << DOUBLE_MANTISSA_BITS;
+        power2 += 1;
+    }
+    mantissa &= ~( 1ULL << DOUBLE_MANTISSA_BITS );
+    if( power2 >= DOUBLE_INFINITE_EXPONENT ) {
+        *bits = ( uint64_t )DOUBLE_INFINITE_EXPONENT << DOUBLE_MANTISSA_BITS;
+        return true;
+    }
+    *bits = mantissa | ( uint64_t )power2 << DOUBLE_MANTISSA_BITS;
+    return true;
+}
+
+/** Converts \c mantissa * 10^\c exponent to the closest double.
+ *
+ *  Mantissas up to 2^53 with small exponents are converted with one exact floating point operation (Clinger's fast
+ *  path), the rest with the Eisel-Lemire algorithm. Numbers too large for a double give infinity.
+ *
+ *  @param mantissa Decimal digits of the number.
+ *  @param exponent Power of 10 of the last digit of \c mantissa.
+ *  @param truncated \c true if \c mantissa is the start of a longer number, which is then between \c mantissa and
+ *                   \c mantissa + 1.
+ *  @param value Set to the double.
+ *  @return \c false for the rare numbers that need a slow exact conversion, like \c strtod.
+ */
+bool json_number_to_double( uint64_t mantissa, int64_t exponent, bool truncated, double *value ) {
+#if FLT_EVAL_METHOD == 0
+    /* both the mantissa and the power of 10 are exact, so the result is correctly rounded */
+    if( !truncated && mantissa <= ( 1ULL << 53 ) && exponent >= -22 && exponent <= 22 ) {
+        *value = exponent < 0 ? ( double )mantissa / _pow10[-exponent] : ( double )mantissa * _pow10[exponent];
+        return true;
+    }
+#endif
+
+    uint64_t bits;
+    if( !_eisel_lemire( mantissa, exponent, &bits ) ) {
+        return false;
+    }
+    if( truncated ) {
+        /* the digits that were dropped can only change the result if the next mantissa rounds differently */
+        uint64_t next_bits;
+        if( mantissa == UINT64_MAX || !_eisel_lemire( mantissa + 1, exponent, &next_bits ) || next_bits != bits ) {
+            return false;
+        }
+    }
+    memcpy( value, &bits, sizeof( *value ) );
+    return true;
+}
+
+/** Converts \c number to a 64 bit integer.
+ *
+ *  @return \c false if the number has a fraction part or an exponent, or doesn't fit in an \c int64_t.
+ */
+bool json_number_as_i64( const json_number_t *number, int64_t *value ) {
+    if( ( number->flags & ( JSON_NUMBER_FRACTION | JSON_NUMBER_EXPONENT ) ) != 0 ) {
+        return false;
+    }
+
+    /* the negative range has one more value */
+    bool negative = ( number->flags & JSON_NUMBER_NEGATIVE ) != 0;
+    uint64_t max = negative ? ( uint64_t )INT64_MAX + 1 : ( uint64_t )INT64_MAX;
+    uint64_t magnitude = 0;
+    for( size_t i = negative ? 1 : 0; i < number->len; i++ ) {
+        unsigned digit = number->data[i] - '0';
+        if( magnitude > ( max - digit ) / 10 ) {
+            return false;
+        }
+        magnitude = magnitude * 10 + digit;
+    }
+    /* -max can't be negated as an int64_t */
+    *value = negative && magnitude != 0 ? -( int64_t )( magnitude - 1 ) - 1 : ( int64_t )magnitude;
+    return true;
+}
+
+/** Converts the digits of \c number with \c strtod, which is exact, for the few that \c json_number_to_double can't
+ *  round. The digits are written without a decimal point, so the locale doesn't matter.
+ *
+ *  @return \c false if there is no memory for the digits.
+ */
+static bool _as_double_slow( const json_number_t *number, int64_t exponent, double *value ) {
+    char local[128];
+    size_t size = number->len + 32;
+    char *digits = size <= sizeof( local ) ? local : malloc( size );
+    if( digits == NULL ) {
+        return false;
+    }
+
+    size_t len = 0;
+    bool fraction = false;
+    for( size_t i = 0; i < number->len && number->data[i] != 'e' && number->data[i] != 'E'; i++ ) {
+        char c = number->data[i];
+        if( c == '.' ) {
+            fraction = true;
+        } else if( c != '-' ) {
+            digits[len++] = c;
+            exponent -= fraction ? 1 : 0;
+        }
+    }
+    snprintf( &digits[len], size - len, "e%lld", ( long long )exponent );
+    *value = strtod( digits, NULL );
+
+    if( digits != local ) {
+        free( digits );
+    }
+    return true;
+}
+
+/** Converts \c number to the closest double, the same way the tokenizer converts fractions.
+ *
+ *  @return \c false if the number is too large for a double (numbers too small for one are 0).
+ */
+bool json_number_as_double( const json_number_t *number, double *value ) {
+    const char *p = number->data;
+    const char *end = p + number->len;
+    bool negative = *p == '-';
+    p += negative ? 1 : 0;
+
+    /* the digits that don't fit in 64 bits only count for the scale, like in the tokenizer */
+    uint64_t mantissa = 0;
+    int64_t scale = 0;
+    bool truncated = false;
+    bool fraction = false;
+    for( ; p < end && *p != 'e' && *p != 'E'; p++ ) {
+        if( *p == '.' ) {
+            fraction = true;
+            continue;
+        }
+        unsigned digit = *p - '0';
+        if( truncated || mantissa > ( UINT64_MAX - digit ) / 10 ) {
+            truncated = true;
+            scale += fraction ? 0 : 1;
+        } else {
+            mantissa = mantissa * 10 + digit;
+            scale -= fraction ? 1 : 0;
+        }
+    }
+
+    int64_t exponent = 0;
+    bool exponent_negative = false;
+    if( p < end ) {
+        p += 1;
+        exponent_negative = *p == '-';
+        p += *p == '-' || *p == '+' ? 1 : 0;
+        for( ; p < end; p++ ) {
+            /* any larger exponent gives 0 or infinity, whatever the digits */
+            if( exponent < 1000000000000000 ) {
+                exponent = exponent * 10 + ( *p - '0' );
+            }
+        }
+    }
+    exponent = exponent_negative ? -exponent : exponent;
+
+    double result;
+    if( !json_number_to_double( mantissa, scale + exponent, truncated, &result ) &&
+        !_as_double_slow( number, exponent, &result ) ) {
+        return false;
+    }
+    if( isinf( result ) ) {
+        return false;
+    }
+    *value = negative ? -result : result;
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef JSON_NUMBER_H
+#define JSON_NUMBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Flags of a number that starts with a minus sign. */
+#define JSON_NUMBER_NEGATIVE ( 1 << 0 )
+/** Flags of a number with a fraction part. */
+#define JSON_NUMBER_FRACTION ( 1 << 1 )
+/** Flags of a number with an exponent. */
+#define JSON_NUMBER_EXPONENT ( 1 << 2 )
+
+/** Number kept as it was written in the input, which is only converted if asked (see \c json_options_t.lazy_numbers).
+ *
+ *  Like strings, numbers are views of the stream buffer unless they cross a refill of the buffer, in which case they
+ *  are copied to the scratch buffer of the tokenizer. Either way they are only valid until the next token is read.
+ */
+typedef struct {
+    /** First character of the number, which is not NUL terminated. */
+    const char *data;
+    /** Number of characters. */
+    size_t len;
+    /** \c JSON_NUMBER_* flags of the parts found in the number. */
+    uint8_t flags;
+    /** \c true if the number is in the scratch buffer of the tokenizer. */
+    bool copied;
+} json_number_t;
+
+
+bool json_number_to_double( uint64_t mantissa, int64_t exponent, bool truncated, double *value );
+bool json_number_as_i64( const json_number_t *number, int64_t *value );
+bool json_number_as_double( const json_number_t *number, double *value );
+
+/** Returns the characters of \c number as they were written in the input, with their count in \c len. */
+static inline const char *json_number_raw( const json_number_t *number, size_t *len ) {
+    *len = number->len;
+    return number->data;
+}
+
+
+#endif
@@ -1,8 +1,11 @@
 #include <string.h>
 #include <assert.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include <errno.h>
+#include <stdint.h>
 #include "fsm.h"
+#include "json_number.h"
 #include "json_tokenizer.h"
 #include "varray.h"
 
@@ -10,16 +13,30 @@
 #define ASIZE( x ) ( sizeof( x ) / sizeof( (x)[0] ) )
 #define CHECK_TYPE( type, var ) ( 0 ? ( ( void (*)( type ) )NULL )( var ) : 0 )
 
+/** Number of characters of a string literal. */
+#define LITERAL_LEN( s ) ( sizeof( s ) - 1 )
+
+/** \c true if the byte \c c is an ASCII digit. */
+#define IS_DIGIT( c ) ( ( unsigned )( ( c ) - '0' ) < 10 )
+
 /** States defined in the FSM that tokenizes the input. */
 typedef enum {
     state_id_error = FSM_ERROR_STATE,
     state_id_init = FSM_INITIAL_STATE,
     state_id_end = FSM_END_STATE,
     state_id_string,
+    state_id_minus,
     state_id_numeric,
     state_id_fraction_first_digit,
     state_id_fraction,
+    state_id_exponent_sign,
+    state_id_exponent_first_digit,
+    state_id_exponent,
     state_id_escape,
+    state_id_unicode_1,
+    state_id_unicode_2,
+    state_id_unicode_3,
+    state_id_unicode_4,
     state_id_false,
     state_id_true,
     state_id_null_start,
@@ -37,21 +54,60 @@ struct fsm_ctx {
     tokenizer_t *tokenizer;
     /** Used when parsing boolean values to know which character must be matched next. */
     int boolean_index;
+    /** Byte that must be put back in the stream once the token is complete (or -1). Actions can't put it back
+     *  themselves because the stream is updated after the FSM stops. */
+    int put_back;
+    /** Digits of the number being parsed, accumulated up to the first one that doesn't fit in 64 bits. */
+    uint64_t magnitude;
+    /** Power of 10 of the last digit in \c magnitude. */
+    int64_t scale;
+    /** Power of 10 of the last digit in the buffer of the tokenizer, once \c magnitude overflows. */
+    int64_t spill_scale;
+    /** Value of the exponent, which stops growing far outside the range of doubles. */
+    int64_t exponent;
+    /** \c true if the number being parsed starts with a minus sign. */
+    bool negative;
+    /** \c true if the exponent starts with a minus sign. */
+    bool exponent_negative;
+    /** \c true if \c magnitude overflowed, in which case every digit is in the buffer of the tokenizer. */
+    bool overflow;
+    /** Code unit of the \uXXXX escape being parsed. */
+    uint32_t unicode;
+    /** High surrogate of a \uXXXX escape that must be followed by the escape of a low surrogate (or 0). */
+    uint32_t high_surrogate;
+    /** UTF-8 sequence of the string being parsed that goes on in its next run (see \c tokenizer_t.validate_utf8). */
+    json_utf8_state_t utf8;
 };
 
 /** Defines an entry in the array of states that define the FSM.
  *
- *  @param name State name.
+ *  @param _name State name.
  *  @param _transition_eof Transition that handles the EOF.
  *  @param ... List of transitions that compose the state (see \c TRANSITION).
  */
-#define STATE( name, _transition_eof, ... ) \
-    [state_id_##name] = { \
+#define STATE( _name, _transition_eof, ... ) \
+    [state_id_##_name] = { \
+        .name = #_name, \
         .transitions = ( transition_t [] ){ __VA_ARGS__ }, \
         .num_transitions = ASIZE( ( ( transition_t [] ){ __VA_ARGS__ } ) ), \
         .transition_eof = _transition_eof, \
     }
 
+/** Defines an entry in the array of states like \c STATE, for a state with a fast path.
+ *
+ *  @param _fast_path Callback that handles the input of the state in one go when it can (see \c state_t).
+ *  @param _fast_path_state State the FSM moves to after \c _fast_path handles some input.
+ */
+#define STATE_FAST_PATH( _name, _fast_path, _fast_path_state, _transition_eof, ... ) \
+    [state_id_##_name] = { \
+        .name = #_name, \
+        .transitions = ( transition_t [] ){ __VA_ARGS__ }, \
+        .num_transitions = ASIZE( ( ( transition_t [] ){ __VA_ARGS__ } ) ), \
+        .transition_eof = _transition_eof, \
+        .fast_path = ( state_fast_path_cb_t )_fast_path, \
+        .fast_path_state = state_id_##_fast_path_state, \
+    }
+
 /** Defines a transition for an FSM state
  *
  *  @param _next_state Next state if the transition is taken.
@@ -66,6 +122,22 @@ struct fsm_ctx {
         .action = ( transition_action_cb_t )_action, \
     }
 
+/** Defines a transition that loops back to its state with an action for whole runs of values
+ *
+ *  @param _next_state Next state if the transition is taken (the same state that contains the transition).
+ *  @param _values Array of values that trigger the transition.
+ *  @param _action Callback executed when the transition is taken (or \c NULL).
+ *  @param _span_action Callback executed for a run of values that take the transition.
+ */
+#define TRANSITION_SPAN( _next_state, _values, _action, _span_action ) \
+    { \
+        .next_state = state_id_##_next_state, \
+        .values = _values, \
+        .values_len = sizeof( _values ) - 1, \
+        .action = ( transition_action_cb_t )_action, \
+        .span_action = ( transition_span_action_cb_t )_span_action, \
+    }
+
 /** Defines an EOF transition for an FSM state
  *
  *  @param _next_state Next state if the transition is taken.
@@ -88,12 +160,27 @@ static bool _action_token_array_close( struct fsm_ctx *ctx, char c );
 static bool _action_token_colon( struct fsm_ctx *ctx, char c );
 static bool _action_token_comma( struct fsm_ctx *ctx, char c );
 static bool _action_string_init( struct fsm_ctx *ctx, char c );
+static bool _action_string_escape( struct fsm_ctx *ctx, char c );
 static bool _action_numeric_init( struct fsm_ctx *ctx, char c );
+static bool _action_numeric_minus( struct fsm_ctx *ctx, char c );
+static bool _action_integer_digit( struct fsm_ctx *ctx, char c );
+static bool _action_integer_digits( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len );
 static bool _action_token_string( struct fsm_ctx *ctx, char c );
 static bool _action_string_store( struct fsm_ctx *ctx, char c );
+static bool _action_string_store_span( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len );
 static bool _action_string_do_escape( struct fsm_ctx *ctx, char c );
-static bool _action_store_digit( struct fsm_ctx *ctx, char c );
+static bool _action_unicode_init( struct fsm_ctx *ctx, char c );
+static bool _action_unicode_digit( struct fsm_ctx *ctx, char c );
+static bool _action_unicode_end( struct fsm_ctx *ctx, char c );
+static size_t _fast_path_escapes( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len );
 static bool _action_fraction( struct fsm_ctx *ctx, char c );
+static bool _action_fraction_digit( struct fsm_ctx *ctx, char c );
+static bool _action_fraction_digits( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len );
+static bool _action_exponent( struct fsm_ctx *ctx, char c );
+static bool _action_exponent_minus( struct fsm_ctx *ctx, char c );
+static bool _action_exponent_plus( struct fsm_ctx *ctx, char c );
+static bool _action_exponent_digit( struct fsm_ctx *ctx, char c );
+static bool _action_exponent_digits( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len );
 static bool _action_token_integer_and_unget( struct fsm_ctx *ctx, char c );
 static bool _action_token_integer( struct fsm_ctx *ctx );
 static bool _action_token_fraction( struct fsm_ctx *ctx );
@@ -114,70 +201,7 @@ static bool _action_token_null( struct fsm_ctx *ctx, char c );
  * FSM states.
  */
 static const state_t _states[state_id_last] = {
-    STATE( init,
-        TRANSITION_EOF( end, _action_token_eof ),
-        TRANSITION( init,    "\r\n\t ", NULL ),
-        TRANSITION( end,     "{", _action_token_object_open ),
-        TRANSITION( end,     "}", _action_token_object_close ),
-        TRANSITION( end,     "[", _action_token_array_open ),
-        TRANSITION( end,     "]", _action_token_array_close ),
-        TRANSITION( end,     ":", _action_token_colon ),
-        TRANSITION( end,     ",", _action_token_comma ),
-        TRANSITION( string,  "\"", _action_string_init ),
-        TRANSITION( numeric, "0123456789", _action_numeric_init ),
-        TRANSITION( false, "f", _action_boolean_false_init ),
-        TRANSITION( true, "t", _action_boolean_true_init ),
-        TRANSITION( null_start, "n", NULL ),
-    ),
-    STATE( string,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( escape, "\\", NULL ),
-        TRANSITION( end,    "\"", _action_token_string ),
-        TRANSITION( error, "\n\r", _action_error_invalid_control_character ),
-        TRANSITION( string, ANY, _action_string_store ),
-    ),
-    STATE( escape,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( string, "nt\\rbf/", _action_string_do_escape ),
-        TRANSITION( string, ANY, _action_string_store ),
-    ),
-    STATE( numeric,
-        TRANSITION_EOF( end, _action_token_integer ),
-        TRANSITION( numeric,              "0123456789", _action_store_digit ),
-        TRANSITION( fraction_first_digit, ".", _action_fraction ),
-        TRANSITION( end,                  ANY, _action_token_integer_and_unget ),
-    ),
-    STATE( fraction_first_digit,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( fraction, "0123456789", _action_store_digit ),
-    ),
-    STATE( fraction,
-        TRANSITION_EOF( end, _action_token_fraction ),
-        TRANSITION( fraction, "0123456789", _action_store_digit ),
-        TRANSITION( end,      ANY, _action_token_fraction_and_unget ),
-    ),
-    STATE( true,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( true, "ru", _action_check_true ),
-        TRANSITION( end,  "e", _action_token_true ),
-    ),
-    STATE( false,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( false, "als", _action_check_false ),
-        TRANSITION( end,   "e", _action_token_false ),
-    ),
-    STATE( null_start,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( null_read_l, "u", NULL ),
-    ),
-    STATE( null_read_l,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( null_end, "l", NULL ),
-    ),
-    STATE( null_end,
-        TRANSITION_EOF( error, _action_error_eof ),
-        TRANSITION( end, "l", _action_token_null ),
-    ),
+#include "json_tokenizer_states.h"
 };
 
 
@@ -213,105 +237,545 @@ static bool _action_token_comma( struct fsm_ctx *ctx, char c ) {
 
 static bool _action_string_init( struct fsm_ctx *ctx, char c ) {
     ctx->token.type = json_token_string;
-    varray_init( ctx->token.value.string, 64 );
-    if( ctx->token.value.string == NULL ) {
-        ctx->token = TOKEN_ERROR( "Malloc error" );
+    ctx->token.value.string = ( json_string_t ){ .data = "", .len = 0, .copied = false };
+    return true;
+}
+
+/** Copies the string of the token being parsed, which is a view of the stream buffer until then, to the scratch
+ *  buffer of the tokenizer. */
+static bool _string_copy( struct fsm_ctx *ctx ) {
+    json_string_t *string = &ctx->token.value.string;
+    if( string->copied ) {
+        return true;
+    }
+
+    /* the scratch buffer keeps its capacity, so it stops growing once it fits the longest string */
+    tokenizer_t *t = ctx->tokenizer;
+    varray_len( t->string ) = 0;
+    varray_extend( t->string, string->data, string->len );
+    string->copied = true;
+    return true;
+}
+
+/** Fails the string if the escape of a high surrogate is not followed by the escape of a low one. */
+static bool _string_check_surrogate( struct fsm_ctx *ctx ) {
+    if( ctx->high_surrogate != 0 ) {
+        token_release( &ctx->token );
+        ctx->token = TOKEN_ERROR( "Invalid surrogate pair" );
+        return false;
+    }
+    return true;
+}
+
+/** Fails the string if \c data is not valid UTF-8 where it's validated, the sequence at the end of \c data may go on
+ *  in the next run of the string. */
+static bool _string_validate( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len ) {
+    if( !ctx->tokenizer->validate_utf8 ) {
+        return true;
+    }
+    size_t valid = json_utf8_validate( &ctx->utf8, data, data_len );
+    if( valid < data_len ) {
+        /* the FSM consumes the whole run, the position is the one of the invalid byte */
+        ctx->tokenizer->error_overrun = data_len - valid - 1;
+        token_release( &ctx->token );
+        ctx->token = TOKEN_ERROR( TOKEN_ERROR_INVALID_UTF8 );
         return false;
     }
     return true;
 }
 
+/** Fails the string if a UTF-8 sequence is cut by an escape or by its end. */
+static bool _string_check_sequence( struct fsm_ctx *ctx ) {
+    if( ctx->utf8.needed > 0 ) {
+        token_release( &ctx->token );
+        ctx->token = TOKEN_ERROR( TOKEN_ERROR_INVALID_UTF8 );
+        return false;
+    }
+    return true;
+}
+
+static bool _action_string_escape( struct fsm_ctx *ctx, char c ) {
+    if( !_string_check_sequence( ctx ) ) {
+        return false;
+    }
+    /* escaped characters don't match the input */
+    return _string_copy( ctx );
+}
+
+/** Keeps the characters of the number being parsed in the scratch buffer of the tokenizer, which is all the FSM does
+ *  with them for lazy numbers (see \c tokenizer_t.lazy_numbers). */
+static inline void _number_raw( struct fsm_ctx *ctx, char c ) {
+    if( ctx->tokenizer->lazy_numbers ) {
+        varray_push( ctx->tokenizer->string, c );
+    }
+}
+
+/** Same as \c _number_raw for the first character of the number. */
+static inline void _number_raw_start( struct fsm_ctx *ctx, char c ) {
+    if( ctx->tokenizer->lazy_numbers ) {
+        varray_len( ctx->tokenizer->string ) = 0;
+        varray_push( ctx->tokenizer->string, c );
+    }
+}
+
 static bool _action_numeric_init( struct fsm_ctx *ctx, char c ) {
     ctx->token.type = json_token_integer;
     ctx->token.value.integer = 0;
+    ctx->magnitude = c - '0';
     varray_len( ctx->tokenizer->buffer ) = 0;
-    varray_push( ctx->tokenizer->buffer, c );
+    _number_raw_start( ctx, c );
+    return true;
+}
+
+static bool _action_numeric_minus( struct fsm_ctx *ctx, char c ) {
+    ctx->token.type = json_token_integer;
+    ctx->token.value.integer = 0;
+    ctx->negative = true;
+    varray_len( ctx->tokenizer->buffer ) = 0;
+    _number_raw_start( ctx, c );
+    return true;
+}
+
+/** Writes the digits in \c magnitude to the buffer of the tokenizer, for the numbers that don't fit in it and for
+ *  the slow path of \c _action_token_fraction. */
+static void _number_spill( struct fsm_ctx *ctx ) {
+    char digits[20];
+    size_t len = 0;
+    uint64_t value = ctx->magnitude;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while( value != 0 );
+
+    while( len > 0 ) {
+        varray_push( ctx->tokenizer->buffer, digits[--len] );
+    }
+    ctx->spill_scale = ctx->scale;
+}
+
+/** Converts 8 ASCII digits to their value with a few multiplications on a 64 bit word (SWAR). */
+static inline uint64_t _parse_8_digits( const uint8_t *data ) {
+    uint64_t chunk;
+    memcpy( &chunk, data, sizeof( chunk ) );
+    chunk -= 0x3030303030303030;
+    /* pairs of digits, then groups of 4, then the 8 digits */
+    chunk = ( chunk * 10 ) + ( chunk >> 8 );
+    chunk = ( ( ( chunk & 0x000000ff000000ff ) * ( 100 + ( 1000000ULL << 32 ) ) ) +
+              ( ( ( chunk >> 16 ) & 0x000000ff000000ff ) * ( 1 + ( 10000ULL << 32 ) ) ) ) >> 32;
+    return chunk;
+}
+
+/** Adds a run of digits of the integer part or of the \c fraction part to the number being parsed, 8 at a time while
+ *  \c magnitude has room for them. */
+static void _number_digits( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len, bool fraction ) {
+    if( ctx->tokenizer->lazy_numbers ) {
+        varray_extend( ctx->tokenizer->string, data, data_len );
+        return;
+    }
+    if( ctx->overflow ) {
+        /* the digits of the integer part that don't fit make the number larger, those of the fraction part don't */
+        varray_extend( ctx->tokenizer->buffer, data, data_len );
+        ctx->scale += fraction ? 0 : ( int64_t )data_len;
+        ctx->spill_scale -= fraction ? ( int64_t )data_len : 0;
+        return;
+    }
+
+    uint64_t value = ctx->magnitude;
+    size_t i = 0;
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    /* below 10^11 there is room for 8 more digits in 64 bits */
+    for( ; i + 8 <= data_len && value < 100000000000ULL; i += 8 ) {
+        value = value * 100000000 + _parse_8_digits( &data[i] );
+    }
+#endif
+    for( ; i < data_len; i++ ) {
+        unsigned digit = data[i] - '0';
+        if( value > ( UINT64_MAX - digit ) / 10 ) {
+            break;
+        }
+        value = value * 10 + digit;
+    }
+    ctx->magnitude = value;
+    ctx->scale -= fraction ? ( int64_t )i : 0;
+
+    if( i < data_len ) {
+        /* the rest of the digits go to the buffer, which keeps the whole number */
+        _number_spill( ctx );
+        ctx->overflow = true;
+        _number_digits( ctx, &data[i], data_len - i, fraction );
+    }
+}
+
+static bool _action_integer_digit( struct fsm_ctx *ctx, char c ) {
+    const uint8_t digit = c;
+    _number_digits( ctx, &digit, 1, false );
+    return true;
+}
+
+static bool _action_integer_digits( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len ) {
+    _number_digits( ctx, data, data_len, false );
     return true;
 }
 
 static bool _action_token_string( struct fsm_ctx *ctx, char c ) {
     assert( ctx->token.type == json_token_string );
     assert( c == '"' );
-    varray_push( ctx->token.value.string, '\0' );
+    if( !_string_check_sequence( ctx ) ) {
+        return false;
+    }
+    json_string_t *string = &ctx->token.value.string;
+    if( string->copied ) {
+        if( !_string_check_surrogate( ctx ) ) {
+            return false;
+        }
+        varray_push( ctx->tokenizer->string, '\0' );
+        string->data = ctx->tokenizer->string;
+        string->len = varray_len( ctx->tokenizer->string ) - 1;
+    }
     return true;
 }
 
 static bool _action_string_store( struct fsm_ctx *ctx, char c ) {
     assert( ctx->token.type == json_token_string );
-    varray_push( ctx->token.value.string, c );
+    /* only reached after an escape, which copies the string */
+    assert( ctx->token.value.string.copied );
+    const uint8_t byte = c;
+    if( !_string_check_surrogate( ctx ) || !_string_validate( ctx, &byte, 1 ) ) {
+        return false;
+    }
+    varray_push( ctx->tokenizer->string, c );
+    return true;
+}
+
+static bool _action_string_store_span( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len ) {
+    assert( ctx->token.type == json_token_string );
+    if( !_string_validate( ctx, data, data_len ) ) {
+        return false;
+    }
+    json_string_t *string = &ctx->token.value.string;
+    if( string->copied ) {
+        if( !_string_check_surrogate( ctx ) ) {
+            return false;
+        }
+        varray_extend( ctx->tokenizer->string, data, data_len );
+        return true;
+    }
+
+    /* views are copied before the buffer is refilled, so their runs are contiguous */
+    assert( string->len == 0 || string->data + string->len == ( const char * )data );
+    if( string->len == 0 ) {
+        string->data = ( const char * )data;
+    }
+    string->len += data_len;
+
+    /* the string goes on after the data in the buffer, which the next refill overwrites */
+    const stream_t *s = ctx->tokenizer->stream;
+    if( data + data_len == &s->buffer[s->bytes_read + s->bytes_left] ) {
+        return _string_copy( ctx );
+    }
     return true;
 }
 
 static bool _action_string_do_escape( struct fsm_ctx *ctx, char c ) {
+    if( !_string_check_surrogate( ctx ) ) {
+        return false;
+    }
     switch( c ) {
         case 'n':
-            varray_push( ctx->token.value.string, '\n' );
+            varray_push( ctx->tokenizer->string, '\n' );
             break;
         case 't':
-            varray_push( ctx->token.value.string, '\t' );
+            varray_push( ctx->tokenizer->string, '\t' );
             break;
         case '\\':
-            varray_push( ctx->token.value.string, '\\' );
+            varray_push( ctx->tokenizer->string, '\\' );
             break;
         case 'r':
-            varray_push( ctx->token.value.string, '\r' );
+            varray_push( ctx->tokenizer->string, '\r' );
             break;
         case 'b':
-            varray_push( ctx->token.value.string, '\b' );
+            varray_push( ctx->tokenizer->string, '\b' );
             break;
         case 'f':
-            varray_push( ctx->token.value.string, '\f' );
+            varray_push( ctx->tokenizer->string, '\f' );
             break;
         case '/':
-            varray_push( ctx->token.value.string, '/' );
+            varray_push( ctx->tokenizer->string, '/' );
             break;
         default:
+            token_release( &ctx->token );
             ctx->token = TOKEN_ERROR( "Unexpected escape character" );
             return false;
     }
     return true;
 }
 
-static bool _action_store_digit( struct fsm_ctx *ctx, char c ) {
-    varray_push( ctx->tokenizer->buffer, c );
+/** Value of each hex digit with the 0x10 bit set, so the bytes that are not digits have it clear. */
+static const uint8_t _hex_digits[256] = {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d, ['e'] = 0x1e, ['f'] = 0x1f,
+    ['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d, ['E'] = 0x1e, ['F'] = 0x1f,
+};
+
+/** Character of each single character escape, 0 for the bytes that don't make one. */
+static const uint8_t _escapes[256] = {
+    ['"'] = '"', ['\\'] = '\\', ['/'] = '/', ['b'] = '\b', ['f'] = '\f', ['n'] = '\n', ['r'] = '\r', ['t'] = '\t',
+};
+
+#define IS_HIGH_SURROGATE( u ) ( ( ( u ) & 0xfc00 ) == 0xd800 )
+#define IS_LOW_SURROGATE( u ) ( ( ( u ) & 0xfc00 ) == 0xdc00 )
+
+/** Decodes 4 hex digits with one check for all of them.
+ *
+ *  @return The value of the digits, or -1 if any of them is not a hex digit.
+ */
+static inline int32_t _decode_hex_4( const uint8_t *data ) {
+    uint32_t a = _hex_digits[data[0]], b = _hex_digits[data[1]], c = _hex_digits[data[2]], d = _hex_digits[data[3]];
+    if( ( a & b & c & d & 0x10 ) == 0 ) {
+        return -1;
+    }
+    return ( ( a & 0xf ) << 12 ) | ( ( b & 0xf ) << 8 ) | ( ( c & 0xf ) << 4 ) | ( d & 0xf );
+}
+
+/** Appends the code point \c cp to the string of the tokenizer encoded in UTF-8. */
+static void _string_push_utf8( tokenizer_t *t, uint32_t cp ) {
+    varray_reserve( t->string, 4 );
+    uint8_t *out = ( uint8_t * )&t->string[varray_len( t->string )];
+    if( cp < 0x80 ) {
+        out[0] = cp;
+        varray_len( t->string ) += 1;
+    } else if( cp < 0x800 ) {
+        out[0] = 0xc0 | ( cp >> 6 );
+        out[1] = 0x80 | ( cp & 0x3f );
+        varray_len( t->string ) += 2;
+    } else if( cp < 0x10000 ) {
+        out[0] = 0xe0 | ( cp >> 12 );
+        out[1] = 0x80 | ( ( cp >> 6 ) & 0x3f );
+        out[2] = 0x80 | ( cp & 0x3f );
+        varray_len( t->string ) += 3;
+    } else {
+        out[0] = 0xf0 | ( cp >> 18 );
+        out[1] = 0x80 | ( ( cp >> 12 ) & 0x3f );
+        out[2] = 0x80 | ( ( cp >> 6 ) & 0x3f );
+        out[3] = 0x80 | ( cp & 0x3f );
+        varray_len( t->string ) += 4;
+    }
+}
+
+/** Code point of a surrogate pair. */
+static inline uint32_t _surrogate_pair( uint32_t high, uint32_t low ) {
+    return 0x10000 + ( ( high - 0xd800 ) << 10 ) + ( low - 0xdc00 );
+}
+
+static bool _action_unicode_init( struct fsm_ctx *ctx, char c ) {
+    ctx->unicode = 0;
+    return true;
+}
+
+static bool _action_unicode_digit( struct fsm_ctx *ctx, char c ) {
+    ctx->unicode = ( ctx->unicode << 4 ) | ( _hex_digits[( uint8_t )c] & 0xf );
+    return true;
+}
+
+static bool _action_unicode_end( struct fsm_ctx *ctx, char c ) {
+    _action_unicode_digit( ctx, c );
+    uint32_t unit = ctx->unicode;
+    if( ctx->high_surrogate != 0 ) {
+        if( !IS_LOW_SURROGATE( unit ) ) {
+            return _string_check_surrogate( ctx );
+        }
+        _string_push_utf8( ctx->tokenizer, _surrogate_pair( ctx->high_surrogate, unit ) );
+        ctx->high_surrogate = 0;
+    } else if( IS_HIGH_SURROGATE( unit ) ) {
+        /* the low surrogate comes in the next escape */
+        ctx->high_surrogate = unit;
+    } else if( IS_LOW_SURROGATE( unit ) ) {
+        token_release( &ctx->token );
+        ctx->token = TOKEN_ERROR( "Invalid surrogate pair" );
+        return false;
+    } else {
+        _string_push_utf8( ctx->tokenizer, unit );
+    }
     return true;
 }
 
+/** Decodes the run of escapes at \c data, which starts right after a backslash, straight from the buffer.
+ *
+ *  Stops before the first escape that is not whole in the buffer or is not valid, so the escape states handle it (and
+ *  report its errors) a byte at a time. Surrogate pairs are only decoded here if both halves are.
+ */
+static size_t _fast_path_escapes( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len ) {
+    /* the escape states finish the pair of a high surrogate they decoded */
+    if( ctx->high_surrogate != 0 ) {
+        return 0;
+    }
+
+    tokenizer_t *t = ctx->tokenizer;
+    size_t done = 0;
+    size_t i = 0;
+    while( i < data_len ) {
+        uint8_t c = data[i];
+        if( c != 'u' ) {
+            if( _escapes[c] == 0 ) {
+                break;
+            }
+            varray_push( t->string, _escapes[c] );
+            i += 1;
+        } else {
+            int32_t unit = data_len - i >= 5 ? _decode_hex_4( &data[i + 1] ) : -1;
+            if( unit < 0 || IS_LOW_SURROGATE( unit ) ) {
+                break;
+            }
+            if( IS_HIGH_SURROGATE( unit ) ) {
+                /* \uXXXX\uXXXX */
+                int32_t low = -1;
+                if( data_len - i >= 11 && data[i + 5] == '\\' && data[i + 6] == 'u' ) {
+                    low = _decode_hex_4( &data[i + 7] );
+                }
+                if( low < 0 || !IS_LOW_SURROGATE( low ) ) {
+                    break;
+                }
+                _string_push_utf8( t, _surrogate_pair( unit, low ) );
+                i += 11;
+            } else {
+                _string_push_utf8( t, unit );
+                i += 5;
+            }
+        }
+        done = i;
+
+        /* goes on with the escape right after this one */
+        if( data_len - i < 2 || data[i] != '\\' ) {
+            break;
+        }
+        i += 1;
+    }
+    return done;
+}
+
 static bool _action_fraction( struct fsm_ctx *ctx, char c ) {
     ctx->token.type = json_token_fraction;
-    varray_push( ctx->tokenizer->buffer, c );
+    _number_raw( ctx, c );
+    return true;
+}
+
+static bool _action_fraction_digit( struct fsm_ctx *ctx, char c ) {
+    const uint8_t digit = c;
+    _number_digits( ctx, &digit, 1, true );
+    return true;
+}
+
+static bool _action_fraction_digits( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len ) {
+    _number_digits( ctx, data, data_len, true );
+    return true;
+}
+
+static bool _action_exponent( struct fsm_ctx *ctx, char c ) {
+    ctx->token.type = json_token_fraction;
+    _number_raw( ctx, c );
+    return true;
+}
+
+static bool _action_exponent_minus( struct fsm_ctx *ctx, char c ) {
+    ctx->exponent_negative = true;
+    _number_raw( ctx, c );
+    return true;
+}
+
+static bool _action_exponent_plus( struct fsm_ctx *ctx, char c ) {
+    _number_raw( ctx, c );
+    return true;
+}
+
+static bool _action_exponent_digit( struct fsm_ctx *ctx, char c ) {
+    const uint8_t digit = c;
+    return _action_exponent_digits( ctx, &digit, 1 );
+}
+
+static bool _action_exponent_digits( struct fsm_ctx *ctx, const uint8_t *data, size_t data_len ) {
+    if( ctx->tokenizer->lazy_numbers ) {
+        varray_extend( ctx->tokenizer->string, data, data_len );
+        return true;
+    }
+    for( size_t i = 0; i < data_len; i++ ) {
+        /* any larger exponent gives 0 or infinity, whatever the digits */
+        if( ctx->exponent < 1000000000000000 ) {
+            ctx->exponent = ctx->exponent * 10 + ( data[i] - '0' );
+        }
+    }
     return true;
 }
 
 static bool _action_token_integer_and_unget( struct fsm_ctx *ctx, char c ) {
-    stream_put( ctx->tokenizer->stream, c );
+    ctx->put_back = ( uint8_t )c;
     return _action_token_integer( ctx );
 }
 
+/** Makes a lazy number token of the characters kept by the number actions. */
+static bool _number_token_lazy( struct fsm_ctx *ctx ) {
+    tokenizer_t *t = ctx->tokenizer;
+    varray_push( t->string, '\0' );
+    size_t len = varray_len( t->string ) - 1;
+    uint8_t flags = ctx->negative ? JSON_NUMBER_NEGATIVE : 0;
+    flags |= memchr( t->string, '.', len ) != NULL ? JSON_NUMBER_FRACTION : 0;
+    flags |= strpbrk( t->string, "eE" ) != NULL ? JSON_NUMBER_EXPONENT : 0;
+    ctx->token.type = json_token_number;
+    ctx->token.value.number = ( json_number_t ){ .data = t->string, .len = len, .flags = flags, .copied = true };
+    return true;
+}
+
 static bool _action_token_integer( struct fsm_ctx *ctx ) {
-    errno = 0;
-    varray_push( ctx->tokenizer->buffer, '\0' );
-    ctx->token.value.integer = strtol( ctx->tokenizer->buffer, NULL, 10 );
-    if( errno != 0 ) {
+    if( ctx->tokenizer->lazy_numbers ) {
+        return _number_token_lazy( ctx );
+    }
+    /* the negative range has one more value */
+    uint64_t max = ctx->negative ? ( uint64_t )INTEGER_MAX + 1 : ( uint64_t )INTEGER_MAX;
+    if( ctx->overflow || ctx->magnitude > max ) {
         ctx->token = TOKEN_ERROR( "Integer conversion failed" );
         return false;
     }
+    if( ctx->negative ) {
+        /* -max can't be negated as an integer_t */
+        ctx->token.value.integer = ctx->magnitude == 0 ? 0 : -( integer_t )( ctx->magnitude - 1 ) - 1;
+    } else {
+        ctx->token.value.integer = ctx->magnitude;
+    }
     return true;
 }
 
+/** Converts the number with \c strtod, which is exact, for the few that \c json_number_to_double can't round. The
+ *  digits are written without a decimal point, so the locale doesn't matter. */
+static double _number_slow( struct fsm_ctx *ctx, int64_t exponent ) {
+    if( !ctx->overflow ) {
+        _number_spill( ctx );
+    }
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), "e%lld", ( long long )( ctx->spill_scale + exponent ) );
+    varray_extend( ctx->tokenizer->buffer, suffix, strlen( suffix ) + 1 );
+    return strtod( ctx->tokenizer->buffer, NULL );
+}
+
 static bool _action_token_fraction( struct fsm_ctx *ctx ) {
-    errno = 0;
-    varray_push( ctx->tokenizer->buffer, '\0' );
-    ctx->token.value.fraction = strtod( ctx->tokenizer->buffer, NULL );
-    if( errno != 0 ) {
+    if( ctx->tokenizer->lazy_numbers ) {
+        return _number_token_lazy( ctx );
+    }
+    int64_t exponent = ctx->exponent_negative ? -ctx->exponent : ctx->exponent;
+    double value;
+    if( !json_number_to_double( ctx->magnitude, ctx->scale + exponent, ctx->overflow, &value ) ) {
+        value = _number_slow( ctx, exponent );
+    }
+    /* numbers too small for a double are 0, but too large ones are errors */
+    if( isinf( value ) ) {
         ctx->token = TOKEN_ERROR( "Fraction conversion failed" );
         return false;
     }
+    ctx->token.value.fraction = ctx->negative ? -value : value;
     return true;
 }
 
 static bool _action_token_fraction_and_unget( struct fsm_ctx *ctx, char c ) {
-    stream_put( ctx->tokenizer->stream, c );
+    ctx->put_back = ( uint8_t )c;
     return _action_token_fraction( ctx );
 }
 
@@ -322,7 +786,7 @@ static bool _action_error_invalid_control_character( struct fsm_ctx *ctx, char c
 }
 
 static bool _action_unget( struct fsm_ctx *ctx, char c ) {
-    stream_put( ctx->tokenizer->stream, c );
+    ctx->put_back = ( uint8_t )c;
     return true;
 }
 
@@ -346,7 +810,7 @@ static bool _action_boolean_false_init( struct fsm_ctx *ctx, char c ) {
 
 static bool _action_check_false( struct fsm_ctx *ctx, char c ) {
     /* checks the character is correct */
-    if( ctx->boolean_index >= strlen( "false" ) || "false"[ctx->boolean_index] != c ) {
+    if( ctx->boolean_index >= LITERAL_LEN( "false" ) || "false"[ctx->boolean_index] != c ) {
         ctx->token = TOKEN_ERROR( "Unexpected character" );
         return false;
     }
@@ -356,7 +820,7 @@ static bool _action_check_false( struct fsm_ctx *ctx, char c ) {
 
 static bool _action_token_false( struct fsm_ctx *ctx, char c ) {
     ctx->boolean_index += 1;
-    if( ctx->boolean_index != strlen( "false" ) ) {
+    if( ctx->boolean_index != LITERAL_LEN( "false" ) ) {
         ctx->token = TOKEN_ERROR( "Unexpected character" );
         return false;
     }
@@ -373,7 +837,7 @@ static bool _action_boolean_true_init( struct fsm_ctx *ctx, char c ) {
 
 static bool _action_check_true( struct fsm_ctx *ctx, char c ) {
     /* checks the character is correct */
-    if( ctx->boolean_index >= strlen( "true" ) || "true"[ctx->boolean_index] != c ) {
+    if( ctx->boolean_index >= LITERAL_LEN( "true" ) || "true"[ctx->boolean_index] != c ) {
         ctx->token = TOKEN_ERROR( "Unexpected character" );
         return false;
     }
@@ -383,7 +847,7 @@ static bool _action_check_true( struct fsm_ctx *ctx, char c ) {
 
 static bool _action_token_true( struct fsm_ctx *ctx, char c ) {
     ctx->boolean_index += 1;
-    if( ctx->boolean_index != strlen( "true" ) ) {
+    if( ctx->boolean_index != LITERAL_LEN( "true" ) ) {
         ctx->token = TOKEN_ERROR( "Unexpected character" );
         return false;
     }
@@ -397,45 +861,365 @@ static bool _action_token_null( struct fsm_ctx *ctx, char c ) {
     return true;
 }
 
+#ifdef JAYSON_FSM_PROFILE
+/** Counters of every tokenizer FSM. */
+static fsm_profile_t _profile;
+#endif
 
-void tokenizer_init( tokenizer_t *t, stream_t *stream ) {
+#ifdef JAYSON_GENERATED_TOKENIZER
+/* direct threaded version of _states generated by tool/fsmgen.c */
+#include "json_tokenizer_gen.h"
+#endif
+
+
+bool tokenizer_init( tokenizer_t *t, stream_t *stream ) {
     t->stream = stream;
+    if( !fsm_compile( &t->fsm, _states, ASIZE( _states ) ) ) {
+        return false;
+    }
+#ifdef JAYSON_FSM_PROFILE
+    /* the tokenizer works without a profile if it can't be allocated */
+    ( void )fsm_profile_attach( &t->fsm, &_profile );
+#endif
     varray_init( t->buffer, 64 );
+    varray_init( t->string, 64 );
+    varray_init( t->ends, 64 );
+    if( !json_index_init( &t->index ) ) {
+        fsm_release( &t->fsm );
+        varray_release( t->buffer );
+        varray_release( t->string );
+        varray_release( t->ends );
+        return false;
+    }
+    t->use_index = true;
+    t->lazy_numbers = false;
+    t->validate_utf8 = false;
+    t->error_overrun = 0;
+    return true;
 }
 
 void tokenizer_release( tokenizer_t *t ) {
+    fsm_release( &t->fsm );
     varray_release( t->buffer );
+    varray_release( t->string );
+    varray_release( t->ends );
+    json_index_release( &t->index );
 }
 
-json_token_t tokenizer_get_next( tokenizer_t *t ) {
+/** Loads 4 bytes that may not be aligned. */
+static inline uint32_t _load_32( const void *data ) {
+    uint32_t word;
+    memcpy( &word, data, sizeof( word ) );
+    return word;
+}
+
+/** Matches \c true, \c false or \c null at the start of \c data with one or two word compares.
+ *
+ *  @return Length of the literal, or 0 if \c data doesn't start with a whole one.
+ */
+static size_t _match_literal( const uint8_t *data, size_t data_len, json_token_t *token ) {
+    if( data_len < LITERAL_LEN( "false" ) ) {
+        if( data_len < LITERAL_LEN( "true" ) ) {
+            return 0;
+        }
+    } else if( data[0] == 'f' && _load_32( &data[1] ) == _load_32( "alse" ) ) {
+        *token = ( json_token_t ){ .type = json_token_boolean, .value.boolean = false };
+        return LITERAL_LEN( "false" );
+    }
+
+    uint32_t word = _load_32( data );
+    if( word == _load_32( "true" ) ) {
+        *token = ( json_token_t ){ .type = json_token_boolean, .value.boolean = true };
+        return LITERAL_LEN( "true" );
+    } else if( word == _load_32( "null" ) ) {
+        *token = ( json_token_t ){ .type = json_token_null };
+        return LITERAL_LEN( "null" );
+    }
+    return 0;
+}
+
+/** Matches the number at the start of \c data without converting it, for lazy numbers (see
+ *  \c tokenizer_t.lazy_numbers). The grammar is the one of the FSM.
+ *
+ *  @return Length of the number, or 0 if it's not valid or may go on past \c end, which is left to the FSM.
+ */
+static size_t _match_number( const uint8_t *data, const uint8_t *end, json_token_t *token ) {
+    const uint8_t *p = data;
+    uint8_t flags = 0;
+    if( p < end && *p == '-' ) {
+        flags |= JSON_NUMBER_NEGATIVE;
+        p++;
+    }
+    const uint8_t *digits = p;
+    while( p < end && IS_DIGIT( *p ) ) {
+        p++;
+    }
+    if( p == digits ) {
+        return 0;
+    }
+
+    if( p < end && *p == '.' ) {
+        flags |= JSON_NUMBER_FRACTION;
+        digits = ++p;
+        while( p < end && IS_DIGIT( *p ) ) {
+            p++;
+        }
+        if( p == digits ) {
+            return 0;
+        }
+    }
+    if( p < end && ( *p == 'e' || *p == 'E' ) ) {
+        flags |= JSON_NUMBER_EXPONENT;
+        p++;
+        if( p < end && ( *p == '+' || *p == '-' ) ) {
+            p++;
+        }
+        digits = p;
+        while( p < end && IS_DIGIT( *p ) ) {
+            p++;
+        }
+        if( p == digits ) {
+            return 0;
+        }
+    }
+    /* the byte after the number must be in the buffer, or the number may go on in the next one */
+    if( p == end ) {
+        return 0;
+    }
+
+    *token = ( json_token_t ){
+        .type = json_token_number,
+        .value.number = { .data = ( const char * )data, .len = p - data, .flags = flags, .copied = false },
+    };
+    return p - data;
+}
+
+/** Windows of the structural index with fewer structurals than one every this many bytes are considered sparse. */
+#define INDEX_SPARSE_BYTES 128
+
+/** Number of bytes left to the FSM after a sparse window before indexing again. */
+#define INDEX_SPARSE_SKIP ( 16 * JSON_INDEX_WINDOW )
+
+/** Matches the operator or the string without escapes at \c p with the structural index, indexing a new window of
+ *  the buffered input from \c p once it's past the last one.
+ *
+ *  @param t Tokenizer.
+ *  @param data Start of the span of the stream.
+ *  @param p First byte of the token.
+ *  @param end End of the span of the stream.
+ *  @param token Set to the token if it's matched.
+ *  @return Length of the token, or 0 to leave it to the FSM.
+ */
+static inline size_t _match_indexed( tokenizer_t *t, const uint8_t *data, const uint8_t *p, const uint8_t *end,
+                                     json_token_t *token ) {
+    json_index_t *index = &t->index;
+    size_t offset = stream_offset( t->stream ) + ( p - data );
+    if( offset >= index->end ) {
+        /* the window must start between tokens, where no string is open */
+        if( end - p < JSON_INDEX_BLOCK ) {
+            return 0;
+        }
+        size_t window = index->end - index->base;
+        if( !index->skipped && varray_len( index->offsets ) * INDEX_SPARSE_BYTES < window ) {
+            /* mostly long strings, which the vector loops of the FSM skip faster, so they are left to them for a
+             * while before indexing again */
+            json_index_skip( index, offset, INDEX_SPARSE_SKIP );
+            return 0;
+        }
+        json_index_build( index, offset, p, end - p );
+    }
+
+    /* scalars are not structurals */
+    long next = json_index_seek( index, offset );
+    if( next < 0 || index->offsets[next] != offset - index->base ) {
+        return 0;
+    }
+
+    switch( *p ) {
+        case '{':
+            *token = ( json_token_t ){ .type = json_token_object_open };
+            return 1;
+        case '}':
+            *token = ( json_token_t ){ .type = json_token_object_close };
+            return 1;
+        case '[':
+            *token = ( json_token_t ){ .type = json_token_array_open };
+            return 1;
+        case ']':
+            *token = ( json_token_t ){ .type = json_token_array_close };
+            return 1;
+        case ':':
+            *token = ( json_token_t ){ .type = json_token_colon };
+            return 1;
+        case ',':
+            *token = ( json_token_t ){ .type = json_token_comma };
+            return 1;
+        case '"':
+            break;
+        default:
+            return 0;
+    }
+
+    /* the next structural is the closing quote unless there is an escape or a control character first, or the
+     * string goes on past the window */
+    uint32_t close = index->offsets[next + 1];
+    if( close == UINT32_MAX || p[close - index->offsets[next]] != '"' ) {
+        return 0;
+    }
+    size_t len = close - index->offsets[next] - 1;
+    if( t->validate_utf8 ) {
+        /* the FSM finds the invalid byte */
+        json_utf8_state_t utf8 = { 0 };
+        if( json_utf8_validate( &utf8, p + 1, len ) < len || utf8.needed > 0 ) {
+            return 0;
+        }
+    }
+    *token = ( json_token_t ){
+        .type = json_token_string,
+        .value.string = { .data = ( const char * )p + 1, .len = len, .copied = false },
+    };
+    return len + 2;
+}
+
+/** Reads the next token, reading more input only if \c refill is \c true.
+ *
+ *  @return \c false if the token doesn't end in the buffered input and \c refill is \c false, in which case the token is
+ *          left in the stream.
+ */
+static inline bool _next_token( tokenizer_t *t, bool refill, json_token_t *token ) {
+    t->error_overrun = 0;
+
+    /* operators, plain strings and literals in the buffer skip the FSM, which matches them a byte at a time at the
+     * end of the buffer */
+    const uint8_t *data;
+    size_t data_len;
+    if( ( refill || t->stream->bytes_left > 0 ) && stream_peek_span( t->stream, &data, &data_len ) ) {
+        const uint8_t *p = fsm_skip_loop( &t->fsm, FSM_INITIAL_STATE, data, data + data_len );
+        size_t len = t->use_index ? _match_indexed( t, data, p, data + data_len, token ) : 0;
+        if( len == 0 && t->lazy_numbers ) {
+            len = _match_number( p, data + data_len, token );
+        }
+        if( len == 0 ) {
+            len = _match_literal( p, data + data_len - p, token );
+        }
+        stream_consume( t->stream, p + len - data );
+        if( len > 0 ) {
+            return true;
+        }
+    }
+
     struct fsm_ctx ctx = {
         .token = TOKEN_NONE,
         .tokenizer = t,
+        .put_back = -1,
     };
-    state_id_t end_state = fsm_run( _states, t->stream, &ctx );
+#ifdef JAYSON_GENERATED_TOKENIZER
+    state_id_t end_state = _fsm_run_generated( t->stream, &ctx, refill );
+#else
+    state_id_t end_state = refill ? fsm_run( &t->fsm, t->stream, &ctx ) : fsm_run_buffered( &t->fsm, t->stream, &ctx );
+#endif
+    if( ctx.put_back >= 0 ) {
+        stream_put( t->stream, ctx.put_back );
+    }
+    if( end_state < 0 && end_state != FSM_BUFFER_END ) {
+        /* the index may not agree with the FSM on where the tokens after an error start */
+        t->index.end = t->index.base;
+    }
 
     switch( end_state ) {
+        case FSM_BUFFER_END:
+            token_release( &ctx.token );
+            return false;
         case FSM_ERROR_NO_MATCH:
             token_release( &ctx.token );
-            return TOKEN_ERROR( "Unexpected character" );
+            *token = TOKEN_ERROR( "Unexpected character" );
+            return true;
         case FSM_ERROR_TRANSITION:
             assert( ctx.token.type == json_token_error );
-            return ctx.token;
+            *token = ctx.token;
+            return true;
         case FSM_ERROR_STREAM:
             token_release( &ctx.token );
-            return TOKEN_ERROR( "Input error" );
+            *token = TOKEN_ERROR( "Input error" );
+            return true;
         case FSM_ERROR_STATE:
             assert( ctx.token.type == json_token_error );
-            return ctx.token;
+            *token = ctx.token;
+            return true;
         case FSM_END_STATE:
-            return ctx.token;
+            *token = ctx.token;
+            return true;
     }
 
     /* this shouldn't be reached */
     assert( false );
-    return ctx.token;
+    *token = ctx.token;
+    return true;
+}
+
+json_token_t tokenizer_get_next( tokenizer_t *t ) {
+    json_token_t token;
+    ( void )_next_token( t, true, &token );
+    return token;
+}
+
+/** Reads up to \c cap tokens in one go, saving a call for each of them.
+ *
+ *  The batch ends early after an error, the end of the input or a string or number copied to the scratch buffer, and
+ *  before a token that needs more input than is buffered. That way the strings and numbers of every token in the batch
+ *  stay valid until the next call (see \c json_string_t).
+ *
+ *  @param t Tokenizer.
+ *  @param out Array where the tokens are stored.
+ *  @param cap Number of tokens that fit in \c out (at least 1).
+ *  @return Number of tokens read, at least 1 (see \c tokenizer_batch_position for their positions).
+ */
+size_t tokenizer_get_batch( tokenizer_t *t, json_token_t *out, size_t cap ) {
+    varray_len( t->ends ) = 0;
+    varray_reserve( t->ends, cap );
+
+    /* only the first token can refill the buffer, which would drop the strings of the tokens before it */
+    size_t n = 0;
+    bool refill = true;
+    while( n < cap && _next_token( t, refill, &out[n] ) ) {
+        t->ends[n] = stream_position_offset( t->stream );
+        const json_token_t *token = &out[n++];
+        if( token->type == json_token_error || token->type == json_token_eof ||
+            ( token->type == json_token_string && token->value.string.copied ) ||
+            ( token->type == json_token_number && token->value.number.copied ) ) {
+            break;
+        }
+        refill = false;
+    }
+    varray_len( t->ends ) = n;
+    return n;
+}
+
+/** Computes the line and column (starting at 0) after the last byte the tokenizer read, or after the byte that caused
+ *  the last error token, which may be earlier than the stream position (see \c stream_position). */
+void tokenizer_position( tokenizer_t *t, int *line, int *column ) {
+    stream_position( t->stream, line, column );
+    /* errors are found in runs of string characters, which are on the same line */
+    *column -= t->error_overrun;
 }
 
+/** Same as \c tokenizer_position for the token at \c index in the last batch (see \c tokenizer_get_batch), which
+ *  can't be before a token whose position was already computed. */
+void tokenizer_batch_position( tokenizer_t *t, size_t index, int *line, int *column ) {
+    assert( index < varray_len( t->ends ) );
+    stream_position_at( t->stream, t->ends[index], line, column );
+    /* only the last token of a batch can be an error */
+    if( index == varray_len( t->ends ) - 1 ) {
+        *column -= t->error_overrun;
+    }
+}
+
+#ifdef JAYSON_FSM_PROFILE
+void tokenizer_profile_dump( FILE *out ) {
+    fsm_profile_dump( &_profile, "tokenizer", out );
+}
+#endif
+
 void token_release( json_token_t *token ) {
     switch( token->type ) {
         case json_token_comma:
@@ -445,14 +1229,15 @@ void token_release( json_token_t *token ) {
         case json_token_array_close:
         case json_token_integer:
         case json_token_fraction:
+        case json_token_number:
         case json_token_boolean:
         case json_token_colon:
         case json_token_error:
         case json_token_none:
         case json_token_null:
         case json_token_eof:
-            break;
+        /* strings are views of the stream or of the scratch buffer of the tokenizer */
         case json_token_string:
-            varray_release( token->value.string );
+            break;
     }
 }
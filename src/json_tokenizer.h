@@ -4,7 +4,11 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include "fsm.h"
+#include "json_index.h"
+#include "json_number.h"
 #include "json_types.h"
+#include "json_utf8.h"
 #include "stream.h"
 
 
@@ -18,6 +22,7 @@ typedef enum {
     json_token_string,
     json_token_integer,
     json_token_fraction,
+    json_token_number,
     json_token_boolean,
     json_token_colon,
     json_token_error,
@@ -26,6 +31,20 @@ typedef enum {
     json_token_eof,
 } json_token_type_t;
 
+/** String value of a token, which is only valid until the next token is read.
+ *
+ *  Strings without escapes are views of the stream buffer and are not NUL terminated. Strings with escapes, or that
+ *  cross a refill of the buffer, are copied to the scratch buffer of the tokenizer.
+ */
+typedef struct {
+    /** First character of the string. */
+    const char *data;
+    /** Number of characters. */
+    size_t len;
+    /** \c true if the string is in the scratch buffer of the tokenizer, where it's NUL terminated. */
+    bool copied;
+} json_string_t;
+
 /** JSON token. */
 typedef struct {
     /** Token type. */
@@ -33,9 +52,10 @@ typedef struct {
 
     /** Token value. */
     union {
-        char *string;
+        json_string_t string;
         integer_t integer;
         fraction_t fraction;
+        json_number_t number;
         bool boolean;
         const char *error_msg;
     } value;
@@ -47,6 +67,9 @@ typedef struct {
 /** Creates an error token with the given message. */
 #define TOKEN_ERROR( msg ) ( ( json_token_t ) { .type = json_token_error, .value.error_msg = msg } )
 
+/** Message of the error tokens of strings that are not valid UTF-8 (see \c tokenizer_t.validate_utf8). */
+#define TOKEN_ERROR_INVALID_UTF8 "Invalid UTF-8"
+
 /** Creates an EOF token. */
 #define TOKEN_EOF ( ( json_token_t ) { .type = json_token_eof } )
 
@@ -60,12 +83,36 @@ typedef struct {
     stream_t *stream;
     /** varray that stores temporary data. */
     char *buffer;
+    /** varray with the last string that had to be copied (see \c json_string_t). */
+    char *string;
+    /** Compiled tokenizer FSM. */
+    fsm_t fsm;
+    /** Rejects strings that are not valid UTF-8 (\c false after \c tokenizer_init). */
+    bool validate_utf8;
+    /** Number of bytes consumed after the byte that caused the last error (see \c tokenizer_position). */
+    size_t error_overrun;
+    /** varray with the offset in the input past each token of the last batch (see \c tokenizer_batch_position). */
+    size_t *ends;
+    /** Structural index of the buffered input, which operators and strings without escapes are read from. */
+    json_index_t index;
+    /** Reads the tokens found in \c index without running the FSM (\c true after \c tokenizer_init). */
+    bool use_index;
+    /** Returns numbers as \c json_token_number tokens with their characters, which are not converted (\c false after
+     *  \c tokenizer_init). */
+    bool lazy_numbers;
 } tokenizer_t;
 
-void tokenizer_init( tokenizer_t *t, stream_t *stream );
+bool tokenizer_init( tokenizer_t *t, stream_t *stream );
 json_token_t tokenizer_get_next( tokenizer_t *t );
+size_t tokenizer_get_batch( tokenizer_t *t, json_token_t *out, size_t cap );
+void tokenizer_position( tokenizer_t *t, int *line, int *column );
+void tokenizer_batch_position( tokenizer_t *t, size_t index, int *line, int *column );
 void tokenizer_release( tokenizer_t *t );
 
 void token_release( json_token_t *token );
 
+#ifdef JAYSON_FSM_PROFILE
+void tokenizer_profile_dump( FILE *out );
+#endif
+
 #endif
@@ -0,0 +1,113 @@
+/**
+ * States of the FSM that tokenizes JSON input.
+ *
+ * This file has no include guard on purpose: it's included by json_tokenizer.c to build \c _states and by
+ * tool/fsmgen.c, which defines its own \c STATE, \c STATE_FAST_PATH and \c TRANSITION macros to generate a direct
+ * threaded version of the tokenizer.
+ */
+
+STATE( init,
+    TRANSITION_EOF( end, _action_token_eof ),
+    TRANSITION( init,    "\r\n\t ", NULL ),
+    TRANSITION( end,     "{", _action_token_object_open ),
+    TRANSITION( end,     "}", _action_token_object_close ),
+    TRANSITION( end,     "[", _action_token_array_open ),
+    TRANSITION( end,     "]", _action_token_array_close ),
+    TRANSITION( end,     ":", _action_token_colon ),
+    TRANSITION( end,     ",", _action_token_comma ),
+    TRANSITION( string,  "\"", _action_string_init ),
+    TRANSITION( numeric, "0123456789", _action_numeric_init ),
+    TRANSITION( minus,   "-", _action_numeric_minus ),
+    TRANSITION( false, "f", _action_boolean_false_init ),
+    TRANSITION( true, "t", _action_boolean_true_init ),
+    TRANSITION( null_start, "n", NULL ),
+),
+STATE( string,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( escape, "\\", _action_string_escape ),
+    TRANSITION( end,    "\"", _action_token_string ),
+    TRANSITION( error,  "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+                        "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f",
+                        _action_error_invalid_control_character ),
+    TRANSITION_SPAN( string, ANY, _action_string_store, _action_string_store_span ),
+),
+STATE_FAST_PATH( escape, _fast_path_escapes, string,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( string,    "nt\\rbf/", _action_string_do_escape ),
+    TRANSITION( unicode_1, "u", _action_unicode_init ),
+    TRANSITION( string,    ANY, _action_string_store ),
+),
+STATE( unicode_1,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( unicode_2, "0123456789abcdefABCDEF", _action_unicode_digit ),
+),
+STATE( unicode_2,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( unicode_3, "0123456789abcdefABCDEF", _action_unicode_digit ),
+),
+STATE( unicode_3,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( unicode_4, "0123456789abcdefABCDEF", _action_unicode_digit ),
+),
+STATE( unicode_4,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( string, "0123456789abcdefABCDEF", _action_unicode_end ),
+),
+STATE( minus,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( numeric, "0123456789", _action_integer_digit ),
+),
+STATE( numeric,
+    TRANSITION_EOF( end, _action_token_integer ),
+    TRANSITION_SPAN( numeric,         "0123456789", _action_integer_digit, _action_integer_digits ),
+    TRANSITION( fraction_first_digit, ".", _action_fraction ),
+    TRANSITION( exponent_sign,        "eE", _action_exponent ),
+    TRANSITION( end,                  ANY, _action_token_integer_and_unget ),
+),
+STATE( fraction_first_digit,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( fraction, "0123456789", _action_fraction_digit ),
+),
+STATE( fraction,
+    TRANSITION_EOF( end, _action_token_fraction ),
+    TRANSITION_SPAN( fraction,     "0123456789", _action_fraction_digit, _action_fraction_digits ),
+    TRANSITION( exponent_sign,     "eE", _action_exponent ),
+    TRANSITION( end,               ANY, _action_token_fraction_and_unget ),
+),
+STATE( exponent_sign,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( exponent_first_digit, "+", _action_exponent_plus ),
+    TRANSITION( exponent_first_digit, "-", _action_exponent_minus ),
+    TRANSITION( exponent,             "0123456789", _action_exponent_digit ),
+),
+STATE( exponent_first_digit,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( exponent, "0123456789", _action_exponent_digit ),
+),
+STATE( exponent,
+    TRANSITION_EOF( end, _action_token_fraction ),
+    TRANSITION_SPAN( exponent, "0123456789", _action_exponent_digit, _action_exponent_digits ),
+    TRANSITION( end,           ANY, _action_token_fraction_and_unget ),
+),
+STATE( true,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( true, "ru", _action_check_true ),
+    TRANSITION( end,  "e", _action_token_true ),
+),
+STATE( false,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( false, "als", _action_check_false ),
+    TRANSITION( end,   "e", _action_token_false ),
+),
+STATE( null_start,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( null_read_l, "u", NULL ),
+),
+STATE( null_read_l,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( null_end, "l", NULL ),
+),
+STATE( null_end,
+    TRANSITION_EOF( error, _action_error_eof ),
+    TRANSITION( end, "l", _action_token_null ),
+),
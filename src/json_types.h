@@ -1,6 +1,7 @@
 #ifndef JSON_TYPES_H
 #define JSON_TYPES_H
 
+#include <limits.h>
 #include <stdbool.h>
 
 
@@ -8,6 +9,8 @@
 typedef double fraction_t;
 /** Type used to represent JSON integers. */
 typedef long integer_t;
+/** Largest value of \c integer_t. */
+#define INTEGER_MAX LONG_MAX
 
 #ifndef ssize_t
 #define ssize_t int
@@ -0,0 +1,238 @@
+#include "json_utf8.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef JSON_UTF8_AVX2
+#include <immintrin.h>
+#endif
+
+
+/** Validates \c data from \c begin a byte at a time, carrying the sequence in \c state across calls.
+ *
+ *  @return Offset of the first invalid byte, or \c data_len if there is none. \c state is the one before that byte.
+ */
+static size_t _validate_scalar( json_utf8_state_t *state, const uint8_t *data, size_t begin, size_t data_len ) {
+    uint8_t needed = state->needed;
+    uint8_t low = state->low;
+    uint8_t high = state->high;
+
+    size_t i;
+    for( i = begin; i < data_len; i++ ) {
+        uint8_t b = data[i];
+        if( needed > 0 ) {
+            if( b < low || b > high ) {
+                break;
+            }
+            needed -= 1;
+            low = 0x80;
+            high = 0xbf;
+        } else if( b >= 0x80 ) {
+            /* C0 and C1 only start overlong sequences, F5 and above code points past U+10FFFF */
+            if( b < 0xc2 || b > 0xf4 ) {
+                break;
+            }
+            needed = b >= 0xf0 ? 3 : b >= 0xe0 ? 2 : 1;
+            low = b == 0xe0 ? 0xa0 : b == 0xf0 ? 0x90 : 0x80;
+            high = b == 0xed ? 0x9f : b == 0xf4 ? 0x8f : 0xbf;
+        }
+    }
+
+    state->needed = needed;
+    state->low = low;
+    state->high = high;
+    return i;
+}
+
+/** Returns the start of the sequence that \c data[\c end - 1] belongs to if it goes on past \c end, or \c end.
+ *  Everything before \c end must have been validated but the sequence that crosses it. */
+static size_t _sequence_start( const uint8_t *data, size_t end ) {
+    for( size_t back = 1; back <= 3 && back <= end; back++ ) {
+        uint8_t b = data[end - back];
+        if( b < 0x80 ) {
+            break;
+        } else if( b >= 0xc0 ) {
+            size_t len = b >= 0xf0 ? 4 : b >= 0xe0 ? 3 : 2;
+            return len > back ? end - back : end;
+        }
+    }
+    return end;
+}
+
+#ifdef __SSE2__
+/** Skips blocks of 16 ASCII bytes between sequences, validating the others a byte at a time. */
+size_t json_utf8_scan_sse2( json_utf8_state_t *state, const uint8_t *data, size_t data_len ) {
+    size_t i = 0;
+    while( i + 16 <= data_len ) {
+        __m128i block = _mm_loadu_si128( ( const __m128i * )&data[i] );
+        if( state->needed == 0 && _mm_movemask_epi8( block ) == 0 ) {
+            i += 16;
+            continue;
+        }
+        size_t valid = _validate_scalar( state, data, i, i + 16 );
+        if( valid < i + 16 ) {
+            return valid;
+        }
+        i = valid;
+    }
+    return i;
+}
+#endif
+
+#ifdef JSON_UTF8_AVX2
+/* errors found by looking at the high and low nibbles of a byte and the high nibble of the next one, each table has a
+ * bit set for the errors the nibble can be part of (see "Validating UTF-8 In Less Than One Instruction Per Byte",
+ * Keiser and Lemire, 2021) */
+#define TOO_SHORT ( 1 << 0 )
+#define TOO_LONG ( 1 << 1 )
+#define OVERLONG_3 ( 1 << 2 )
+#define TOO_LARGE ( 1 << 3 )
+#define SURROGATE ( 1 << 4 )
+#define OVERLONG_2 ( 1 << 5 )
+#define TOO_LARGE_1000 ( 1 << 6 )
+#define OVERLONG_4 ( 1 << 6 )
+#define TWO_CONTS ( ( char )( 1 << 7 ) )
+#define CARRY ( TOO_SHORT | TOO_LONG | TWO_CONTS )
+
+/** Repeats the 16 bytes of a table in both lanes, since the AVX2 shuffle looks up each lane on its own. */
+#define TABLE( ... ) _mm256_broadcastsi128_si256( _mm_setr_epi8( __VA_ARGS__ ) )
+
+/** Shifts the high nibble of each byte of \c v to the low one. */
+__attribute__( ( target( "avx2" ) ) )
+static inline __m256i _high_nibbles( __m256i v ) {
+    return _mm256_and_si256( _mm256_srli_epi16( v, 4 ), _mm256_set1_epi8( 0x0f ) );
+}
+
+/** Returns the bytes of \c input shifted \c n positions later, with the last bytes of \c prev in front. */
+#define PREV( input, prev, n ) _mm256_alignr_epi8( input, _mm256_permute2x128_si256( prev, input, 0x21 ), 16 - ( n ) )
+
+/** Finds the errors of the 32 bytes of \c input, whose sequences may start in \c prev. Non zero bytes are errors. */
+__attribute__( ( target( "avx2" ) ) )
+static inline __m256i _check_block( __m256i input, __m256i prev ) {
+    const __m256i byte_1_high = TABLE(
+        /* 0_______ ________ */
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        /* 10______ ________ */
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        /* 1100____ ________ */
+        TOO_SHORT | OVERLONG_2,
+        /* 1101____ ________ */
+        TOO_SHORT,
+        /* 1110____ ________ */
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        /* 1111____ ________ */
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4 );
+    const __m256i byte_1_low = TABLE(
+        /* ____0000 ________ */
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        /* ____0001 ________ */
+        CARRY | OVERLONG_2,
+        /* ____001_ ________ */
+        CARRY, CARRY,
+        /* ____0100 ________ */
+        CARRY | TOO_LARGE,
+        /* ____0101 ________ to ____1100 ________ */
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        /* ____1101 ________ */
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        /* ____111_ ________ */
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000 );
+    const __m256i byte_2_high = TABLE(
+        /* ________ 0_______ */
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        /* ________ 1000____ */
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        /* ________ 1001____ */
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        /* ________ 101_____ */
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        /* ________ 11______ */
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT );
+
+    /* errors of each byte and the one before it */
+    __m256i prev1 = PREV( input, prev, 1 );
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256( _mm256_shuffle_epi8( byte_1_high, _high_nibbles( prev1 ) ),
+                          _mm256_shuffle_epi8( byte_1_low, _mm256_and_si256( prev1, _mm256_set1_epi8( 0x0f ) ) ) ),
+        _mm256_shuffle_epi8( byte_2_high, _high_nibbles( input ) ) );
+
+    /* the third and fourth bytes of 3 and 4 byte sequences must be continuations, and only them (the special cases
+     * flag a continuation after a continuation as an error, which these cancel) */
+    __m256i third = _mm256_subs_epu8( PREV( input, prev, 2 ), _mm256_set1_epi8( ( char )( 0xe0 - 0x80 ) ) );
+    __m256i fourth = _mm256_subs_epu8( PREV( input, prev, 3 ), _mm256_set1_epi8( ( char )( 0xf0 - 0x80 ) ) );
+    __m256i must_continue = _mm256_and_si256( _mm256_or_si256( third, fourth ), _mm256_set1_epi8( ( char )0x80 ) );
+    return _mm256_xor_si256( must_continue, special );
+}
+
+/** Validates 32 bytes at a time with the lookup tables of \c _check_block, only called if the CPU has AVX2.
+ *
+ *  The sequence that crosses the end of the validated blocks is left to the caller, which gets back the offset of its
+ *  first byte with \c state cleared. \c state must have no sequence in progress.
+ */
+__attribute__( ( target( "avx2" ) ) )
+size_t json_utf8_scan_avx2( json_utf8_state_t *state, const uint8_t *data, size_t data_len ) {
+    if( state->needed > 0 ) {
+        return 0;
+    }
+
+    /* bytes above these values at the end of a block start sequences that go on in the next one */
+    const __m256i max_complete = _mm256_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                   -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                   ( char )( 0xf0 - 1 ), ( char )( 0xe0 - 1 ), ( char )( 0xc0 - 1 ) );
+    __m256i prev = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for( ; i + 32 <= data_len; i += 32 ) {
+        __m256i input = _mm256_loadu_si256( ( const __m256i * )&data[i] );
+        /* ASCII blocks only need the sequence of the previous block to be complete */
+        __m256i error = _mm256_movemask_epi8( input ) == 0 ? incomplete : _check_block( input, prev );
+        if( !_mm256_testz_si256( error, error ) ) {
+            break;
+        }
+        incomplete = _mm256_subs_epu8( input, max_complete );
+        prev = input;
+    }
+    return _sequence_start( data, i );
+}
+#endif
+
+
+/** Validates \c data with \c scan for the bulk of it and a byte at a time for the rest.
+ *
+ *  @param scan Kernel to use (or \c NULL to validate every byte on its own).
+ *  @param state Sequence left by the previous call, updated with the one that continues in the next call.
+ *  @param data First byte to validate.
+ *  @param data_len Number of bytes in \c data.
+ *  @return Offset of the first invalid byte, or \c data_len if the bytes are valid (the last sequence may be
+ *          incomplete, see \c state).
+ */
+size_t json_utf8_validate_scan( json_utf8_scan_t scan, json_utf8_state_t *state, const uint8_t *data, size_t data_len ) {
+    /* finishes the sequence of the previous call */
+    size_t pending = state->needed < data_len ? state->needed : data_len;
+    size_t i = _validate_scalar( state, data, 0, pending );
+    if( i < pending || state->needed > 0 ) {
+        return i;
+    }
+
+    if( scan != NULL ) {
+        i += scan( state, &data[i], data_len - i );
+    }
+    return _validate_scalar( state, data, i, data_len );
+}
+
+/** Same as \c json_utf8_validate_scan with the widest kernel the CPU supports. */
+size_t json_utf8_validate( json_utf8_state_t *state, const uint8_t *data, size_t data_len ) {
+#ifdef JSON_UTF8_AVX2
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        return json_utf8_validate_scan( json_utf8_scan_avx2, state, data, data_len );
+    }
+#endif
+#ifdef __SSE2__
+    return json_utf8_validate_scan( json_utf8_scan_sse2, state, data, data_len );
+#else
+    return json_utf8_validate_scan( NULL, state, data, data_len );
+#endif
+}
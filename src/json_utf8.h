@@ -0,0 +1,42 @@
+#ifndef JSON_UTF8_H
+#define JSON_UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** State of a UTF-8 sequence that continues in the next call to \c json_utf8_validate (all 0 between sequences). */
+typedef struct {
+    /** Number of continuation bytes the sequence still needs. */
+    uint8_t needed;
+    /** Smallest value of the next continuation byte (above 0x80 after the lead bytes of overlong sequences). */
+    uint8_t low;
+    /** Largest value of the next continuation byte (below 0xbf after the lead bytes of surrogates and of code
+     *  points above U+10FFFF). */
+    uint8_t high;
+} json_utf8_state_t;
+
+/* the AVX2 kernel is compiled for x86-64 with GCC or clang and used if the CPU has AVX2 */
+#if defined( __x86_64__ ) && defined( __GNUC__ )
+#define JSON_UTF8_AVX2
+#endif
+
+/** Kernel that validates whole blocks at the start of \c data, stopping at the first block with an error.
+ *
+ *  @return Number of bytes validated, \c state is the one after them.
+ */
+typedef size_t ( *json_utf8_scan_t )( json_utf8_state_t *state, const uint8_t *data, size_t data_len );
+
+
+size_t json_utf8_validate( json_utf8_state_t *state, const uint8_t *data, size_t data_len );
+size_t json_utf8_validate_scan( json_utf8_scan_t scan, json_utf8_state_t *state, const uint8_t *data, size_t data_len );
+#ifdef __SSE2__
+size_t json_utf8_scan_sse2( json_utf8_state_t *state, const uint8_t *data, size_t data_len );
+#endif
+#ifdef JSON_UTF8_AVX2
+size_t json_utf8_scan_avx2( json_utf8_state_t *state, const uint8_t *data, size_t data_len );
+#endif
+
+
+#endif
@@ -1,4 +1,8 @@
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 #include "fsm.h"
 #include "json_tokenizer.h"
 #include "parser.h"
@@ -7,14 +11,18 @@
 
 #define ASIZE( x ) ( sizeof( x ) / sizeof( (x)[0] ) )
 
+/** Number of tokens read from the tokenizer in one go. */
+#define TOKEN_BATCH_SIZE 64
+
 
 /** Defines an entry in the array of states that define the FSM.
  *
- *  @param name State name.
+ *  @param _name State name.
  *  @param ... List of transitions that compose the state (see \c TRANSITION).
  */
-#define STATE( name, ... ) \
-    [parser_state_##name] = { \
+#define STATE( _name, ... ) \
+    [parser_state_##_name] = { \
+        .name = #_name, \
         .transitions = ( transition_t [] ){ __VA_ARGS__ }, \
         .num_transitions = ASIZE( ( ( transition_t [] ){ __VA_ARGS__ } ) ), \
     }
@@ -57,16 +65,24 @@ typedef enum {
 typedef struct {
     /** Stack of container types (var array). */
     container_type_t *container_types;
-    /** Stack of JSON tokens (var array). */
-    json_token_t *tokens;
+    /** Tokens of the last batch read from the tokenizer (see \c tokenizer_get_batch). */
+    json_token_t tokens[TOKEN_BATCH_SIZE];
+    /** Number of tokens in \c tokens. */
+    size_t num_tokens;
+    /** Index in \c tokens of the next token to parse, the one before it is the token being parsed. */
+    size_t next_token;
     /** Handler. */
     json_handler_t *handler;
     /** Input stream. */
     stream_t *stream;
     /** JSON tokenizer. */
     tokenizer_t *tokenizer;
+    /** NUL terminated copy of the last string token that was a view (var array). */
+    char *string;
     /** Error message (or \c NULL is no error). */
     const char *error;
+    /** Compiled parser FSM. */
+    fsm_t fsm;
 } fsm_ctx_t;
 
 
@@ -82,6 +98,7 @@ static bool _action_array_close( fsm_ctx_t *ctx, char c );
 static bool _action_string( fsm_ctx_t *ctx, char c );
 static bool _action_integer( fsm_ctx_t *ctx, char c );
 static bool _action_fraction( fsm_ctx_t *ctx, char c );
+static bool _action_number( fsm_ctx_t *ctx, char c );
 static bool _action_null( fsm_ctx_t *ctx, char c );
 static bool _action_boolean( fsm_ctx_t *ctx, char c );
 
@@ -117,6 +134,7 @@ typedef enum {
     TRANSITION( next_state, string,      _action_string ), \
     TRANSITION( next_state, integer,     _action_integer ), \
     TRANSITION( next_state, fraction,    _action_fraction ), \
+    TRANSITION( next_state, number,      _action_number ), \
     TRANSITION( next_state, null,        _action_null ), \
     TRANSITION( next_state, boolean,     _action_boolean )
 
@@ -161,6 +179,12 @@ static const state_t _states[state_id_last] = {
 };
 
 
+#ifdef JAYSON_FSM_PROFILE
+/** Counters of every parser FSM. */
+static fsm_profile_t _profile;
+#endif
+
+
 static bool _action_object_start( fsm_ctx_t *ctx, char c ) {
     bool rv = ctx->handler->object_start( ctx->handler->ctx );
 
@@ -180,8 +204,26 @@ static bool _action_object_close( fsm_ctx_t *ctx, char c ) {
     return rv;
 }
 
+/** Returns the token being parsed. */
+static inline const json_token_t *_last_token( const fsm_ctx_t *ctx ) {
+    return &ctx->tokens[ctx->next_token - 1];
+}
+
+/** Returns the string of the last token NUL terminated for the handler, copying it if it's a view of the stream
+ *  buffer (see \c json_string_t). */
+static const char *_last_string( fsm_ctx_t *ctx ) {
+    const json_string_t *string = &_last_token( ctx )->value.string;
+    if( string->copied ) {
+        return string->data;
+    }
+    varray_len( ctx->string ) = 0;
+    varray_extend( ctx->string, string->data, string->len );
+    varray_push( ctx->string, '\0' );
+    return ctx->string;
+}
+
 static bool _action_object_key( fsm_ctx_t *ctx, char c ) {
-    return ctx->handler->object_key( ctx->handler->ctx, varray_last( ctx->tokens ).value.string );
+    return ctx->handler->object_key( ctx->handler->ctx, _last_string( ctx ) );
 }
 
 static bool _action_array_start( fsm_ctx_t *ctx, char c ) {
@@ -223,15 +265,19 @@ static bool _action_array_close( fsm_ctx_t *ctx, char c ) {
 }
 
 static bool _action_string( fsm_ctx_t *ctx, char c ) {
-    return ctx->handler->string( ctx->handler->ctx, varray_last( ctx->tokens ).value.string );
+    return ctx->handler->string( ctx->handler->ctx, _last_string( ctx ) );
 }
 
 static bool _action_integer( fsm_ctx_t *ctx, char c ) {
-    return ctx->handler->integer( ctx->handler->ctx, varray_last( ctx->tokens ).value.integer );
+    return ctx->handler->integer( ctx->handler->ctx, _last_token( ctx )->value.integer );
 }
 
 static bool _action_fraction( fsm_ctx_t *ctx, char c ) {
-    return ctx->handler->fraction( ctx->handler->ctx, varray_last( ctx->tokens ).value.fraction );
+    return ctx->handler->fraction( ctx->handler->ctx, _last_token( ctx )->value.fraction );
+}
+
+static bool _action_number( fsm_ctx_t *ctx, char c ) {
+    return ctx->handler->number( ctx->handler->ctx, &_last_token( ctx )->value.number );
 }
 
 static bool _action_null( fsm_ctx_t *ctx, char c ) {
@@ -239,7 +285,7 @@ static bool _action_null( fsm_ctx_t *ctx, char c ) {
 }
 
 static bool _action_boolean( fsm_ctx_t *ctx, char c ) {
-    return ctx->handler->boolean( ctx->handler->ctx, varray_last( ctx->tokens ).value.boolean );
+    return ctx->handler->boolean( ctx->handler->ctx, _last_token( ctx )->value.boolean );
 }
 
 static bool _action_recursive_parse( fsm_ctx_t *ctx, char c ) {
@@ -253,7 +299,7 @@ static bool _action_eof_unexpected( fsm_ctx_t *ctx ) {
 }
 
 static bool _step_fsm( fsm_ctx_t *parser_ctx, json_token_type_t type, state_id_t fsm_state ) {
-    fsm_state = fsm_step( &_states[fsm_state], type, fsm_state, parser_ctx );
+    fsm_state = fsm_step_compiled( &parser_ctx->fsm, fsm_state, type, parser_ctx );
     switch( fsm_state ) {
         case FSM_ERROR_NO_MATCH:
             parser_ctx->error = "Unexpected token";
@@ -272,16 +318,29 @@ static bool _step_fsm( fsm_ctx_t *parser_ctx, json_token_type_t type, state_id_t
     return true;
 }
 
+/** Returns the next token to parse, reading a new batch once the tokens of the last one were parsed. */
+static inline json_token_t *_next_token( fsm_ctx_t *ctx, tokenizer_t *tokenizer ) {
+    if( ctx->next_token == ctx->num_tokens ) {
+        ctx->num_tokens = tokenizer_get_batch( tokenizer, ctx->tokens, ASIZE( ctx->tokens ) );
+        ctx->next_token = 0;
+    }
+    return &ctx->tokens[ctx->next_token++];
+}
+
 static bool _run_fsm( fsm_ctx_t *parser_ctx, tokenizer_t *tokenizer, state_id_t fsm_state ) {
     json_token_type_t type;
+    json_token_t *token;
     do {
-        varray_push( parser_ctx->tokens, tokenizer_get_next( tokenizer ) );
-        type = varray_last( parser_ctx->tokens ).type;
+        token = _next_token( parser_ctx, tokenizer );
+        type = token->type;
 
-        fsm_state = fsm_step( &_states[fsm_state], type, fsm_state, parser_ctx );
+        fsm_state = fsm_step_compiled( &parser_ctx->fsm, fsm_state, type, parser_ctx );
         switch( fsm_state ) {
             case FSM_ERROR_NO_MATCH:
-                parser_ctx->error = "Unexpected token";
+                /* only invalid UTF-8 gets its own message, other errors of the tokenizer are reported as before */
+                parser_ctx->error = type == json_token_error && strcmp( token->value.error_msg, TOKEN_ERROR_INVALID_UTF8 ) == 0
+                                        ? TOKEN_ERROR_INVALID_UTF8
+                                        : "Unexpected token";
                 goto error;
             case FSM_ERROR_TRANSITION:
             case FSM_ERROR_STATE:
@@ -294,42 +353,186 @@ static bool _run_fsm( fsm_ctx_t *parser_ctx, tokenizer_t *tokenizer, state_id_t
             default:
                 break;
         }
-        token_release( &varray_pop( parser_ctx->tokens ) );
+        token_release( token );
     } while( type != json_token_error && fsm_state != FSM_END_STATE );
     return ( fsm_state == FSM_END_STATE );
 
 error:
-    token_release( &varray_pop( parser_ctx->tokens ) );
+    token_release( token );
     return false;
 }
 
 
 bool json_parse( json_handler_t *handler, json_read_cb_t read_cb, void *read_cb_ctx ) {
-    /* initializes the stream for the tokenizer */
-    stream_t stream;
-    STREAM_INIT( &stream, read_cb, read_cb_ctx );    
+    return json_parse_ex( handler, read_cb, read_cb_ctx, NULL );
+}
 
+/** Parses the JSON in \c stream, which is released when done. */
+static bool _parse_stream( json_handler_t *handler, stream_t *stream, const json_options_t *options ) {
     /* initializes the tokenizer */
     tokenizer_t tokenizer;
-    tokenizer_init( &tokenizer, &stream );
+    if( !tokenizer_init( &tokenizer, stream ) ) {
+        stream_release( stream );
+        handler->error( handler->ctx, "Malloc error", 0, 0 );
+        return false;
+    }
+    tokenizer.validate_utf8 = options != NULL && options->validate_utf8;
+    /* handlers without a number callback (e.g. from HANDLER_INIT) get converted numbers */
+    tokenizer.lazy_numbers = options != NULL && options->lazy_numbers && handler->number != NULL;
 
     /* initializes the parser context */
     fsm_ctx_t parser_ctx;
+    if( !fsm_compile( &parser_ctx.fsm, _states, ASIZE( _states ) ) ) {
+        tokenizer_release( &tokenizer );
+        stream_release( stream );
+        handler->error( handler->ctx, "Malloc error", 0, 0 );
+        return false;
+    }
+#ifdef JAYSON_FSM_PROFILE
+    /* the parser works without a profile if it can't be allocated */
+    ( void )fsm_profile_attach( &parser_ctx.fsm, &_profile );
+#endif
     varray_init( parser_ctx.container_types, 5 );
-    varray_init( parser_ctx.tokens, 5 );
+    parser_ctx.num_tokens = 0;
+    parser_ctx.next_token = 0;
+    varray_init( parser_ctx.string, 64 );
     parser_ctx.handler = handler;
-    parser_ctx.stream = &stream;
+    parser_ctx.stream = stream;
     parser_ctx.tokenizer = &tokenizer;
 
     /* runs the JSON FSM */
     bool success = _run_fsm( &parser_ctx, &tokenizer, parser_state_init );
     if( !success ) {
         assert( parser_ctx.error != NULL );
-        parser_ctx.handler->error( parser_ctx.handler->ctx, parser_ctx.error, stream.line + 1, stream.column + 1 );
+        int line, column;
+        tokenizer_batch_position( &tokenizer, parser_ctx.next_token - 1, &line, &column );
+        parser_ctx.handler->error( parser_ctx.handler->ctx, parser_ctx.error, line + 1, column + 1 );
     }
 
     tokenizer_release( &tokenizer );
+    stream_release( stream );
+    fsm_release( &parser_ctx.fsm );
     varray_release( parser_ctx.container_types );
-    varray_release( parser_ctx.tokens );
+    varray_release( parser_ctx.string );
+    return success;
+}
+
+/** Initializes \c stream to read from \c read_cb, in a background thread if \c options asks for it. */
+static bool _init_stream( stream_t *stream, json_read_cb_t read_cb, void *read_cb_ctx, const json_options_t *options ) {
+    size_t buffer_size = options ? options->buffer_size : 0;
+    if( options != NULL && options->read_ahead > 0 ) {
+        return stream_init_readahead( stream, read_cb, read_cb_ctx, buffer_size, options->read_ahead );
+    }
+    return STREAM_INIT_BUFFER( stream, read_cb, read_cb_ctx, NULL, buffer_size );
+}
+
+/** Parses the data read by \c read_cb through a decoder (see \c stream_decoder_open). */
+static bool _parse_decompress( json_handler_t *handler, json_read_cb_t read_cb, void *read_cb_ctx, const json_options_t *options ) {
+    struct stream_decoder *decoder = stream_decoder_open( read_cb, read_cb_ctx );
+    stream_t stream;
+    if( decoder == NULL || !_init_stream( &stream, ( json_read_cb_t )stream_decoder_read, decoder, options ) ) {
+        if( decoder != NULL ) {
+            stream_decoder_close( decoder );
+        }
+        handler->error( handler->ctx, "Malloc error", 0, 0 );
+        return false;
+    }
+
+    /* the stream is released first since it may read from a background thread */
+    bool success = _parse_stream( handler, &stream, options );
+    stream_decoder_close( decoder );
+    return success;
+}
+
+/** Parses the JSON in \c raw, decompressing it if \c options asks for it and it's compressed. \c raw is released
+ *  when done. */
+static bool _parse_raw( json_handler_t *handler, stream_t *raw, const json_options_t *options ) {
+    if( options == NULL || !options->decompress ) {
+        return _parse_stream( handler, raw, options );
+    }
+
+    /* the bytes that tell the formats apart, if the input has them */
+    const uint8_t *data;
+    size_t data_len = 0;
+    stream_ensure( raw, 4 );
+    stream_compression_t format = stream_compression_none;
+    if( stream_peek_span( raw, &data, &data_len ) ) {
+        format = stream_detect_compression( data, data_len );
+    }
+    if( format == stream_compression_none ) {
+        return _parse_stream( handler, raw, options );
+    } else if( !stream_decompression_supported( format ) ) {
+        stream_release( raw );
+        handler->error( handler->ctx, "Unsupported compression format", 0, 0 );
+        return false;
+    }
+
+    bool success = _parse_decompress( handler, ( json_read_cb_t )stream_read, raw, options );
+    stream_release( raw );
+    return success;
+}
+
+/** Same as \c json_parse but with the given options (or the defaults if \c options is \c NULL). */
+bool json_parse_ex( json_handler_t *handler, json_read_cb_t read_cb, void *read_cb_ctx, const json_options_t *options ) {
+    if( options != NULL && options->decompress ) {
+        return _parse_decompress( handler, read_cb, read_cb_ctx, options );
+    }
+
+    /* initializes the stream for the tokenizer */
+    stream_t stream;
+    if( !_init_stream( &stream, read_cb, read_cb_ctx, options ) ) {
+        handler->error( handler->ctx, "Malloc error", 0, 0 );
+        return false;
+    }
+    return _parse_stream( handler, &stream, options );
+}
+
+/** Parses a file on disk reading it straight from a memory mapping (see \c stream_init_mmap).
+ *
+ *  A compressed file is decoded from the mapping into the input buffer if \c options asks for it. Files that can't be
+ *  mapped, such as pipes and the files of /proc, are read like \c json_parse_fd does.
+ *
+ *  @param handler Handler of the parsing events.
+ *  @param path Path of the file.
+ *  @param options Parser options (or \c NULL), the buffer size is only used for compressed files since the mapping
+ *                 is the buffer.
+ *  @return \c true if the file was parsed successfully.
+ */
+bool json_parse_file( json_handler_t *handler, const char *path, const json_options_t *options ) {
+    stream_t stream;
+    if( stream_init_mmap( &stream, path, options ? options->mmap_flags : 0 ) ) {
+        return _parse_raw( handler, &stream, options );
+    }
+
+    int fd = errno == ENODEV ? open( path, O_RDONLY ) : -1;
+    if( fd < 0 ) {
+        handler->error( handler->ctx, "Can't read file", 0, 0 );
+        return false;
+    }
+    bool success = json_parse_fd( handler, fd, options );
+    close( fd );
     return success;
 }
+
+/** Parses the data read from a file descriptor, with io_uring if \c options asks for it (see \c stream_init_fd).
+ *
+ *  @param handler Handler of the parsing events.
+ *  @param fd File descriptor, which is not closed.
+ *  @param options Parser options (or \c NULL).
+ *  @return \c true if the data was parsed successfully.
+ */
+bool json_parse_fd( json_handler_t *handler, int fd, const json_options_t *options ) {
+    stream_t stream;
+    if( !stream_init_fd( &stream, fd, options ? options->buffer_size : 0, options ? options->io_depth : 0 ) ) {
+        handler->error( handler->ctx, "Malloc error", 0, 0 );
+        return false;
+    }
+    return _parse_raw( handler, &stream, options );
+}
+
+#ifdef JAYSON_FSM_PROFILE
+void json_profile_dump( FILE *out ) {
+    tokenizer_profile_dump( out );
+    fsm_profile_dump( &_profile, "parser", out );
+}
+#endif
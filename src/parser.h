@@ -1,11 +1,12 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "json_number.h"
 #include "json_types.h"
 #include "stream.h"
 
 
-/** Helper macro to initilize a JSON handler. */
+/** Helper macro to initilize a JSON handler, which leaves \c number unset. */
 #define HANDLER_INIT( _ctx, \
                       _error, \
                       _object_start, \
@@ -54,6 +55,9 @@ typedef struct {
     bool ( *integer )( void *ctx, integer_t integer );
     /** Called when a fraction is parsed. */
     bool ( *fraction )( void *ctx, fraction_t fraction );
+    /** Called instead of \c integer and \c fraction with the characters of the number when
+     *  \c json_options_t.lazy_numbers is set, the number is only valid during the call. */
+    bool ( *number )( void *ctx, const json_number_t *number );
     /** Called when a string is parsed. */
     bool ( *string )( void *ctx, const char *string );
     /** Called when a null is parsed. */
@@ -66,8 +70,45 @@ typedef struct {
 /** Callback that feeds raw input to the parser. */
 typedef ssize_t ( *json_read_cb_t )( void *ctx, void *data, size_t data_len );
 
+/** Parser options. */
+typedef struct {
+    /** Size of the input buffer, which is the most data requested to the read callback at once (0 uses
+     *  \c STREAM_DEFAULT_BUFFER_SIZE). */
+    size_t buffer_size;
+
+    /** Number of buffers read ahead by a background thread (0 reads in the parser thread, see
+     *  \c stream_init_readahead). */
+    size_t read_ahead;
+
+    /** Number of reads kept in flight by \c json_parse_fd (0 calls \c read, see \c stream_init_fd). */
+    size_t io_depth;
+
+    /** Flags passed to \c stream_init_mmap by \c json_parse_file (e.g. \c STREAM_MMAP_HUGE_PAGES). */
+    int mmap_flags;
+
+    /** Decompresses gzip and zstd input, detected by its first bytes (see \c stream_decoder_open). */
+    bool decompress;
+
+    /** Rejects strings that are not valid UTF-8 while they are tokenized, the error is reported at the first invalid
+     *  byte (see \c json_utf8_validate). */
+    bool validate_utf8;
+
+    /** Passes numbers to the \c number handler without converting them, so they are only converted if the handler
+     *  asks for it (see \c json_number_as_i64 and \c json_number_as_double) and integers of any size stay exact.
+     *  Ignored if the handler has no \c number callback. */
+    bool lazy_numbers;
+
+} json_options_t;
+
 
 bool json_parse( json_handler_t *handler, json_read_cb_t read_cb, void *read_cb_ctx );
+bool json_parse_ex( json_handler_t *handler, json_read_cb_t read_cb, void *read_cb_ctx, const json_options_t *options );
+bool json_parse_file( json_handler_t *handler, const char *path, const json_options_t *options );
+bool json_parse_fd( json_handler_t *handler, int fd, const json_options_t *options );
+
+#ifdef JAYSON_FSM_PROFILE
+void json_profile_dump( FILE *out );
+#endif
 
 
 #endif
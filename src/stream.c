@@ -1,56 +1,307 @@
 #include "stream.h"
+#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
-void stream_init( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx ) {
+/** Counts the new line characters in \c data, setting \c last to the last one (or leaving it untouched). */
+static size_t _count_newlines( const uint8_t *data, size_t len, const uint8_t **last ) {
+    size_t count = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    for( ; i + 16 <= len; i += 16 ) {
+        __m128i block = _mm_loadu_si128( ( const __m128i * )&data[i] );
+        unsigned mask = _mm_movemask_epi8( _mm_cmpeq_epi8( block, newline ) );
+        if( mask != 0 ) {
+            count += __builtin_popcount( mask );
+            *last = &data[i + 31 - __builtin_clz( mask )];
+        }
+    }
+#endif
+    const uint8_t *p = &data[i];
+    const uint8_t *end = &data[len];
+    const uint8_t *new_line;
+    while( ( new_line = memchr( p, '\n', end - p ) ) != NULL ) {
+        count += 1;
+        *last = new_line;
+        p = new_line + 1;
+    }
+    return count;
+}
+
+/** Moves the line and column checkpoint forward to position \c end of the buffer. */
+static void _count_lines( stream_t *s, size_t end ) {
+    const uint8_t *last = NULL;
+    size_t lines = _count_newlines( &s->buffer[s->counted], end - s->counted, &last );
+    if( lines > 0 ) {
+        s->line += lines;
+        s->column = &s->buffer[end] - ( last + 1 );
+    } else {
+        s->column += end - s->counted;
+    }
+    s->counted = end;
+}
+
+/** Position in the buffer past the last byte consumed, bytes put back are still counted as consumed. */
+static size_t _high_water( const stream_t *s ) {
+    return s->bytes_read + s->bytes_put;
+}
+
+/** Moves the data of the buffer from position \c from (at most \c bytes_read) to its start. */
+static void _compact( stream_t *s, size_t from ) {
+    if( from == 0 )
+        return;
+
+    _count_lines( s, _high_water( s ) );
+    memmove( s->buffer, &s->buffer[from], s->bytes_read + s->bytes_left - from );
+    s->buffer_offset += from;
+    s->counted -= from;
+    s->bytes_read -= from;
+    s->mark -= s->marked ? from : 0;
+}
+
+
+bool stream_init( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx ) {
+    return stream_init_buffer( s, in_cb, in_cb_ctx, NULL, STREAM_DEFAULT_BUFFER_SIZE );
+}
+
+/** Initializes a stream with a buffer of the given size.
+ *
+ *  @param s Stream.
+ *  @param in_cb Input callback.
+ *  @param in_cb_ctx Input callback context.
+ *  @param buffer Buffer owned by the caller, which should be aligned to \c STREAM_BUFFER_ALIGNMENT (or \c NULL to
+ *                let the stream allocate it).
+ *  @param buffer_size Size of the buffer (0 uses \c STREAM_DEFAULT_BUFFER_SIZE).
+ *  @return \c false if the buffer could not be allocated.
+ */
+bool stream_init_buffer( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx, uint8_t *buffer, size_t buffer_size ) {
     memset( s, 0, sizeof( *s ) );
     s->in_cb = in_cb;
     s->in_cb_ctx = in_cb_ctx;
-}
+    s->buffer_size = buffer_size ? buffer_size : STREAM_DEFAULT_BUFFER_SIZE;
 
-bool stream_get( stream_t *s, uint8_t *c ) {
-    if( s->byte_put != 0 ) {
-        *c = s->byte_put;
-        s->byte_put = 0;
+    if( buffer != NULL ) {
+        s->buffer = buffer;
         return true;
     }
 
-    if( s->finished || s->error )
+    s->buffer_alloc = malloc( s->buffer_size + STREAM_BUFFER_ALIGNMENT - 1 );
+    if( s->buffer_alloc == NULL ) {
+        return false;
+    }
+    uintptr_t aligned = ( ( uintptr_t )s->buffer_alloc + STREAM_BUFFER_ALIGNMENT - 1 ) & ~( uintptr_t )( STREAM_BUFFER_ALIGNMENT - 1 );
+    s->buffer = ( uint8_t * )aligned;
+    return true;
+}
+
+void stream_release( stream_t *s ) {
+    if( s->release_cb != NULL ) {
+        s->release_cb( s );
+        s->release_cb = NULL;
+    }
+    free( s->buffer_alloc );
+    s->buffer_alloc = NULL;
+    s->buffer = NULL;
+}
+
+bool stream_get( stream_t *s, uint8_t *c ) {
+    const uint8_t *data;
+    size_t data_len;
+
+    if( !stream_peek_span( s, &data, &data_len ) )
+        return false;
+
+    *c = data[0];
+    stream_consume( s, 1 );
+    return true;
+}
+
+bool stream_put( stream_t *s, uint8_t c ) {
+    if( s->error )
+        return false;
+
+    /* checks if a byte was put but never consumed */
+    if( s->bytes_put != 0 )
+        return false;
+
+    /* only the last byte obtained can be put back, and it's still in the buffer */
+    if( s->bytes_read == 0 || s->buffer[s->bytes_read - 1] != c )
+        return false;
+
+    /* the stream can't go back past the mark */
+    if( s->marked && s->bytes_read == s->mark )
         return false;
 
+    s->bytes_read -= 1;
+    s->bytes_left += 1;
+    s->bytes_put = 1;
+    return true;
+}
+
+/** Returns the contiguous bytes available in the stream, reading more input if there are none.
+ *
+ *  @param s Stream.
+ *  @param data Set to the first available byte.
+ *  @param data_len Set to the number of available bytes (at least one).
+ *  @return \c false if there is no more input or the input callback failed.
+ */
+bool stream_peek_span( stream_t *s, const uint8_t **data, size_t *data_len ) {
     if( s->bytes_left == 0 ) {
-        ssize_t bytes_read = s->in_cb( s->in_cb_ctx, s->buffer, sizeof( s->buffer ) );
+        if( s->finished || s->error )
+            return false;
+
+        /* keeps the data after the mark unless it takes the whole buffer */
+        if( s->marked && s->bytes_read - s->mark >= s->buffer_size )
+            s->marked = false;
+        size_t start = 0;
+        if( s->marked ) {
+            _compact( s, s->mark );
+            start = s->bytes_read;
+        } else {
+            /* counts the lines of the data about to be overwritten */
+            _count_lines( s, _high_water( s ) );
+        }
+
+        ssize_t bytes_read = !s->marked && s->swap_cb != NULL
+                                 ? s->swap_cb( s->in_cb_ctx, &s->buffer )
+                                 : s->in_cb( s->in_cb_ctx, &s->buffer[start], s->buffer_size - start );
         if( bytes_read < 0 ) {
             s->error = true;
             return false;
         } else if( bytes_read == 0 ) {
             s->finished = true;
             return false;
-        } else {
-            s->bytes_left = bytes_read;
+        }
+        if( !s->marked ) {
+            s->buffer_offset += s->bytes_read;
             s->bytes_read = 0;
+            s->counted = 0;
         }
+        s->bytes_left = bytes_read;
     }
 
-    *c = s->buffer[s->bytes_read++];
-    s->bytes_left -= 1;
-    if( *c == '\n' ) {
-        s->line += 1;
-        s->column = 0;
-    } else {
-        s->column += 1;
-    }
+    *data = &s->buffer[s->bytes_read];
+    *data_len = s->bytes_left;
     return true;
 }
 
-bool stream_put( stream_t *s, uint8_t c ) {
-    if( s->error || c == 0 )
+/** Makes at least \c n bytes contiguous at the start of the span returned by \c stream_peek_span.
+ *
+ *  Moves the bytes left to the start of the buffer and reads more input after them. The last byte consumed is kept
+ *  so it can still be put back, and so is the data after the mark (see \c stream_mark).
+ *
+ *  @param s Stream.
+ *  @param n Number of bytes needed.
+ *  @return \c false if the input ends or fails before \c n bytes are available, or if they don't fit in the buffer.
+ *          The bytes that were available can still be read in any case.
+ */
+bool stream_ensure( stream_t *s, size_t n ) {
+    if( s->bytes_left >= n )
+        return true;
+    if( s->finished || s->error )
         return false;
 
-    /* checks if a byte was put but never consumed */
-    if( s->byte_put != 0 )
+    /* keeps the last byte consumed for stream_put and the data after the mark */
+    size_t from = s->bytes_read > 0 ? s->bytes_read - 1 : 0;
+    if( s->marked && s->mark < from )
+        from = s->mark;
+    if( s->bytes_read - from + n > s->buffer_size )
         return false;
+    _compact( s, from );
 
-    s->byte_put = c;
+    while( s->bytes_left < n ) {
+        size_t used = s->bytes_read + s->bytes_left;
+        ssize_t bytes_read = s->in_cb( s->in_cb_ctx, &s->buffer[used], s->buffer_size - used );
+        if( bytes_read < 0 ) {
+            s->error = true;
+            return false;
+        } else if( bytes_read == 0 ) {
+            s->finished = true;
+            return false;
+        }
+        s->bytes_left += bytes_read;
+    }
     return true;
 }
+
+/** Read callback that copies the data of another stream, so a stream can be the input of an adapter such as
+ *  \c stream_decoder_read. */
+ssize_t stream_read( stream_t *s, void *data, size_t data_len ) {
+    const uint8_t *span;
+    size_t span_len;
+    if( !stream_peek_span( s, &span, &span_len ) ) {
+        return s->error ? -1 : 0;
+    }
+
+    size_t len = span_len < data_len ? span_len : data_len;
+    memcpy( data, span, len );
+    stream_consume( s, len );
+    return len;
+}
+
+/** Consumes \c n bytes of the span returned by \c stream_peek_span. */
+void stream_consume( stream_t *s, size_t n ) {
+    s->bytes_read += n;
+    s->bytes_left -= n;
+    s->bytes_put -= n < s->bytes_put ? n : s->bytes_put;
+}
+
+/** Marks the current position so the stream can go back to it with \c stream_rewind.
+ *
+ *  The data after the mark is kept in the buffer when it's refilled, moving it to the start of the buffer, as long as
+ *  it fits. Nothing is copied while the stream stays in the same buffer. A stream has one mark, marking again moves
+ *  it.
+ */
+void stream_mark( stream_t *s ) {
+    s->marked = true;
+    s->mark = s->bytes_read;
+}
+
+/** Goes back to the mark, which is kept so the stream can rewind to it again.
+ *
+ *  @return \c false if there is no mark or the data after it didn't fit in the buffer, in which case the stream
+ *          doesn't move.
+ */
+bool stream_rewind( stream_t *s ) {
+    if( !s->marked )
+        return false;
+
+    /* the bytes read again were already counted, like bytes put back */
+    s->bytes_put = _high_water( s ) - s->mark;
+    s->bytes_left += s->bytes_read - s->mark;
+    s->bytes_read = s->mark;
+    return true;
+}
+
+/** Drops the mark, so the data before the current position doesn't need to be kept anymore. */
+void stream_release_mark( stream_t *s ) {
+    s->marked = false;
+}
+
+/** Computes the line and column (starting at 0) after the last byte consumed.
+ *
+ *  Lines are counted on demand from a checkpoint that moves forward every time the data of the buffer is replaced,
+ *  so consuming bytes doesn't need to look at them. A byte put back still counts as consumed.
+ */
+void stream_position( stream_t *s, int *line, int *column ) {
+    _count_lines( s, _high_water( s ) );
+    *line = s->line;
+    *column = s->column;
+}
+
+/** Same as \c stream_position for an earlier offset returned by \c stream_position_offset.
+ *
+ *  The bytes up to \c offset must still be in the buffer, and \c offset can't be before the last position computed,
+ *  since the lines are counted from there.
+ */
+void stream_position_at( stream_t *s, size_t offset, int *line, int *column ) {
+    assert( offset >= s->buffer_offset + s->counted && offset <= stream_position_offset( s ) );
+    _count_lines( s, offset - s->buffer_offset );
+    *line = s->line;
+    *column = s->column;
+}
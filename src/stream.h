@@ -19,11 +19,37 @@
 /** Helper macro to check at compile time that the callback and it's context are compatible. */
 #define _CHECK_CB( cb, ctx ) ( 0 ? _TMP_SSIZE_T = cb( _CHECK_PTR( ctx ), NULL, 0 ), ( stream_read_cb_t )cb : ( stream_read_cb_t )cb )
 
+/** Default size of the stream buffer. */
+#define STREAM_DEFAULT_BUFFER_SIZE ( 64 * 1024 )
+
+/** Alignment of the buffers allocated by the stream (enough for any SIMD load). */
+#define STREAM_BUFFER_ALIGNMENT 64
+
+/** \c stream_init_mmap flag that asks the kernel to back the mapping with huge pages where it can. */
+#define STREAM_MMAP_HUGE_PAGES 0x1
+
 /** Callback that feeds raw input to the stream. */
 typedef ssize_t ( *stream_read_cb_t )( void *ctx, void *data, size_t data_len );
 
+/** Callback that replaces \c *buffer with a buffer of the same size already filled with input, taking the old one
+ *  back. Returns the number of bytes in the new buffer like \c stream_read_cb_t. */
+typedef ssize_t ( *stream_swap_cb_t )( void *ctx, uint8_t **buffer );
+
+/** Background reader of a stream (see \c stream_init_readahead). */
+struct stream_readahead;
+
+/** Read callback adapter that decompresses its input (see \c stream_decoder_open). */
+struct stream_decoder;
+
+/** Compression formats detected by \c stream_decoder_open. */
+typedef enum {
+    stream_compression_none,
+    stream_compression_gzip,
+    stream_compression_zstd,
+} stream_compression_t;
+
 /** Stream type. */
-typedef struct {
+typedef struct stream {
     /** \c true if there is no more input available. */
     bool finished;
 
@@ -36,31 +62,97 @@ typedef struct {
     /** Stream input callback context. */
     void *in_cb_ctx;
 
+    /** Used instead of \c in_cb when none of the data in the buffer has to be kept, so the input isn't copied (or
+     *  \c NULL). Called with \c in_cb_ctx. */
+    stream_swap_cb_t swap_cb;
+
     /** Number of bytes consumed from the internal buffer. */
     size_t bytes_read;
 
     /** Number of bytes available in the internal buffer. */
     size_t bytes_left;
 
-    /** A byte put in the stream (or 0 if not set). */
-    uint8_t byte_put;
+    /** Number of bytes put back in the stream or rewound (their lines and columns were already counted). */
+    size_t bytes_put;
 
-    /** Internal buffer that holds data obtained from the input callback. */
-    uint8_t buffer[1024];
+    /** \c true if there is a mark (see \c stream_mark). */
+    bool marked;
 
-    /** Number of new line characters read so far. */
+    /** Position of the mark in \c buffer. */
+    size_t mark;
+
+    /** Buffer that holds data obtained from the input callback. */
+    uint8_t *buffer;
+
+    /** Size of \c buffer. */
+    size_t buffer_size;
+
+    /** Allocation that contains \c buffer (or \c NULL if the buffer belongs to the caller). */
+    void *buffer_alloc;
+
+    /** Releases the input source, for streams that own one (or \c NULL). */
+    void ( *release_cb )( struct stream *s );
+
+    /** Offset in the input of the first byte of \c buffer. */
+    size_t buffer_offset;
+
+    /** Number of new line characters before the checkpoint (see \c stream_position). */
     int line;
 
-    /** Number of characters read from the last new line character. */
+    /** Number of characters between the last new line character and the checkpoint. */
     int column;
 
+    /** Position of the checkpoint in \c buffer, \c line and \c column are only counted up to it. */
+    size_t counted;
+
 } stream_t;
 
 
 #define STREAM_INIT( s, in_cb, in_cb_ctx ) stream_init( s, _CHECK_CB( in_cb, in_cb_ctx ), in_cb_ctx )
-
-void stream_init( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx );
+#define STREAM_INIT_BUFFER( s, in_cb, in_cb_ctx, buffer, buffer_size ) \
+    stream_init_buffer( s, _CHECK_CB( in_cb, in_cb_ctx ), in_cb_ctx, buffer, buffer_size )
+
+bool stream_init( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx );
+bool stream_init_buffer( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx, uint8_t *buffer, size_t buffer_size );
+bool stream_init_mmap( stream_t *s, const char *path, int flags );
+bool stream_init_readahead( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx, size_t buffer_size, size_t num_buffers );
+bool stream_init_fd( stream_t *s, int fd, size_t buffer_size, size_t depth );
+bool stream_init_decompress( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx, size_t buffer_size );
+bool stream_uses_uring( const stream_t *s );
+void stream_release( stream_t *s );
+
+struct stream_readahead *stream_readahead_start( stream_read_cb_t in_cb, void *in_cb_ctx, size_t slot_size, size_t num_slots );
+ssize_t stream_readahead_read( struct stream_readahead *ra, void *data, size_t data_len );
+ssize_t stream_readahead_swap( struct stream_readahead *ra, uint8_t **buffer );
+void stream_readahead_stop( struct stream_readahead *ra );
+
+stream_compression_t stream_detect_compression( const uint8_t *data, size_t len );
+bool stream_decompression_supported( stream_compression_t format );
+struct stream_decoder *stream_decoder_open( stream_read_cb_t in_cb, void *in_cb_ctx );
+ssize_t stream_decoder_read( struct stream_decoder *d, void *data, size_t data_len );
+stream_compression_t stream_decoder_format( const struct stream_decoder *d );
+void stream_decoder_close( struct stream_decoder *d );
+
+ssize_t stream_read( stream_t *s, void *data, size_t data_len );
 bool stream_get( stream_t *s, uint8_t *c );
 bool stream_put( stream_t *s, uint8_t c );
+bool stream_peek_span( stream_t *s, const uint8_t **data, size_t *data_len );
+void stream_consume( stream_t *s, size_t n );
+bool stream_ensure( stream_t *s, size_t n );
+void stream_mark( stream_t *s );
+bool stream_rewind( stream_t *s );
+void stream_release_mark( stream_t *s );
+void stream_position( stream_t *s, int *line, int *column );
+void stream_position_at( stream_t *s, size_t offset, int *line, int *column );
+
+/** Returns the offset in the input of the next byte to read. */
+static inline size_t stream_offset( const stream_t *s ) {
+    return s->buffer_offset + s->bytes_read;
+}
+
+/** Returns the offset in the input that \c stream_position refers to, past the last byte consumed or put back. */
+static inline size_t stream_position_offset( const stream_t *s ) {
+    return s->buffer_offset + s->bytes_read + s->bytes_put;
+}
 
 #endif
@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef JAYSON_ZLIB
+#include <zlib.h>
+#endif
+#ifdef JAYSON_ZSTD
+#include <zstd.h>
+#endif
+#include "stream.h"
+
+
+/** Size of the buffer for the compressed input. */
+#define DECODER_INPUT_SIZE ( 64 * 1024 )
+
+/** Number of bytes needed to tell the formats apart. */
+#define MAGIC_LEN 4
+
+
+/** Read callback adapter that decompresses its input. */
+struct stream_decoder {
+    /** Callback that reads the compressed input. */
+    stream_read_cb_t in_cb;
+    /** Context of \c in_cb. */
+    void *in_cb_ctx;
+
+    /** Format of the input, known after the first read. */
+    stream_compression_t format;
+    /** \c true once the format was detected. */
+    bool detected;
+    /** \c true if \c in_cb reached the end of the input. */
+    bool finished;
+    /** \c true if the last frame or member of the input was complete. */
+    bool frame_done;
+
+    /** Compressed input not decoded yet. */
+    uint8_t *input;
+    size_t input_pos;
+    size_t input_len;
+
+#ifdef JAYSON_ZLIB
+    z_stream zlib;
+    bool zlib_initialized;
+#endif
+#ifdef JAYSON_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+};
+
+
+/** Detects the compression format of the data starting with \c data.
+ *
+ *  @param data First bytes of the input.
+ *  @param len Number of bytes in \c data, 4 are enough to detect every format.
+ *  @return The format, or \c stream_compression_none if it's not compressed.
+ */
+stream_compression_t stream_detect_compression( const uint8_t *data, size_t len ) {
+    if( len >= 2 && data[0] == 0x1f && data[1] == 0x8b ) {
+        return stream_compression_gzip;
+    }
+    if( len >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f && data[3] == 0xfd ) {
+        return stream_compression_zstd;
+    }
+    return stream_compression_none;
+}
+
+/** Checks if the library that decodes \c format was available at build time. */
+bool stream_decompression_supported( stream_compression_t format ) {
+    switch( format ) {
+        case stream_compression_none:
+            return true;
+        case stream_compression_gzip:
+#ifdef JAYSON_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case stream_compression_zstd:
+#ifdef JAYSON_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+
+/** Reads more compressed input after the data not decoded yet.
+ *
+ *  @return Number of bytes read, 0 at the end of the input or -1 on errors.
+ */
+static ssize_t _fill( struct stream_decoder *d ) {
+    if( d->input_pos == d->input_len ) {
+        d->input_pos = d->input_len = 0;
+    }
+    if( d->finished || d->input_len == DECODER_INPUT_SIZE ) {
+        return 0;
+    }
+
+    ssize_t bytes_read = d->in_cb( d->in_cb_ctx, &d->input[d->input_len], DECODER_INPUT_SIZE - d->input_len );
+    if( bytes_read == 0 ) {
+        d->finished = true;
+    } else if( bytes_read > 0 ) {
+        d->input_len += bytes_read;
+    }
+    return bytes_read;
+}
+
+/** Reads the first bytes of the input and sets up the decoder of its format. */
+static bool _detect( struct stream_decoder *d ) {
+    while( d->input_len < MAGIC_LEN && !d->finished ) {
+        if( _fill( d ) < 0 ) {
+            return false;
+        }
+    }
+    d->format = stream_detect_compression( d->input, d->input_len );
+    d->detected = true;
+    d->frame_done = true;
+
+    switch( d->format ) {
+        case stream_compression_none:
+            return true;
+        case stream_compression_gzip:
+#ifdef JAYSON_ZLIB
+            /* 16 selects the gzip wrapper */
+            d->zlib_initialized = inflateInit2( &d->zlib, 16 + MAX_WBITS ) == Z_OK;
+            return d->zlib_initialized;
+#else
+            return false;
+#endif
+        case stream_compression_zstd:
+#ifdef JAYSON_ZSTD
+            d->zstd = ZSTD_createDStream();
+            return d->zstd != NULL && !ZSTD_isError( ZSTD_initDStream( d->zstd ) );
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+/** Copies the data of an uncompressed input, which only goes through \c input until the bytes used to detect the
+ *  format are consumed. */
+static ssize_t _read_plain( struct stream_decoder *d, uint8_t *data, size_t data_len ) {
+    if( d->input_pos < d->input_len ) {
+        size_t len = d->input_len - d->input_pos;
+        len = len < data_len ? len : data_len;
+        memcpy( data, &d->input[d->input_pos], len );
+        d->input_pos += len;
+        return len;
+    }
+    return d->finished ? 0 : d->in_cb( d->in_cb_ctx, data, data_len );
+}
+
+#ifdef JAYSON_ZLIB
+/** Decodes gzip input, including files with several members. */
+static ssize_t _read_gzip( struct stream_decoder *d, uint8_t *data, size_t data_len ) {
+    z_stream *z = &d->zlib;
+    z->next_out = data;
+    z->avail_out = data_len;
+
+    while( z->avail_out == data_len ) {
+        if( d->input_pos == d->input_len ) {
+            ssize_t bytes_read = _fill( d );
+            if( bytes_read < 0 ) {
+                return -1;
+            } else if( bytes_read == 0 ) {
+                /* the input can only end after a complete member */
+                return d->frame_done ? 0 : -1;
+            }
+        }
+
+        z->next_in = &d->input[d->input_pos];
+        z->avail_in = d->input_len - d->input_pos;
+        int result = inflate( z, Z_NO_FLUSH );
+        d->input_pos = d->input_len - z->avail_in;
+
+        if( result == Z_STREAM_END ) {
+            /* another member may follow */
+            d->frame_done = true;
+            if( inflateReset( z ) != Z_OK ) {
+                return -1;
+            }
+        } else if( result == Z_OK ) {
+            d->frame_done = false;
+        } else if( result != Z_BUF_ERROR ) {
+            return -1;
+        }
+    }
+    return data_len - z->avail_out;
+}
+#endif
+
+#ifdef JAYSON_ZSTD
+/** Decodes zstd input, including files with several frames. */
+static ssize_t _read_zstd( struct stream_decoder *d, uint8_t *data, size_t data_len ) {
+    ZSTD_outBuffer out = { .dst = data, .size = data_len, .pos = 0 };
+
+    while( out.pos == 0 ) {
+        if( d->input_pos == d->input_len ) {
+            ssize_t bytes_read = _fill( d );
+            if( bytes_read < 0 ) {
+                return -1;
+            } else if( bytes_read == 0 ) {
+                if( d->frame_done ) {
+                    return 0;
+                }
+                /* the decoder can still hold output of input it consumed, the frame is only truncated without any */
+                ZSTD_inBuffer in = { .src = d->input, .size = 0, .pos = 0 };
+                size_t result = ZSTD_decompressStream( d->zstd, &out, &in );
+                if( ZSTD_isError( result ) ) {
+                    return -1;
+                }
+                d->frame_done = ( result == 0 );
+                if( out.pos == 0 ) {
+                    return d->frame_done ? 0 : -1;
+                }
+                break;
+            }
+        }
+
+        ZSTD_inBuffer in = { .src = &d->input[d->input_pos], .size = d->input_len - d->input_pos, .pos = 0 };
+        size_t result = ZSTD_decompressStream( d->zstd, &out, &in );
+        d->input_pos += in.pos;
+        if( ZSTD_isError( result ) ) {
+            return -1;
+        }
+        /* 0 means a frame was completely decoded and flushed */
+        d->frame_done = ( result == 0 );
+    }
+    return out.pos;
+}
+#endif
+
+
+/** Creates a read callback adapter that detects if the input of \c in_cb is compressed and decodes it.
+ *
+ *  The format is detected from the first bytes (gzip and zstd, if the libraries were available at build time),
+ *  input that is not compressed is passed through. Read it with \c stream_decoder_read.
+ *
+ *  @return The decoder or \c NULL if it could not be allocated.
+ */
+struct stream_decoder *stream_decoder_open( stream_read_cb_t in_cb, void *in_cb_ctx ) {
+    struct stream_decoder *d = calloc( 1, sizeof( *d ) );
+    if( d == NULL ) {
+        return NULL;
+    }
+    d->input = malloc( DECODER_INPUT_SIZE );
+    if( d->input == NULL ) {
+        free( d );
+        return NULL;
+    }
+    d->in_cb = in_cb;
+    d->in_cb_ctx = in_cb_ctx;
+    return d;
+}
+
+/** Read callback that decodes straight into \c data. Fails on input in a format that can't be decoded. */
+ssize_t stream_decoder_read( struct stream_decoder *d, void *data, size_t data_len ) {
+    if( !d->detected && !_detect( d ) ) {
+        return -1;
+    }
+
+    switch( d->format ) {
+        case stream_compression_none:
+            return _read_plain( d, data, data_len );
+#ifdef JAYSON_ZLIB
+        case stream_compression_gzip:
+            return _read_gzip( d, data, data_len );
+#endif
+#ifdef JAYSON_ZSTD
+        case stream_compression_zstd:
+            return _read_zstd( d, data, data_len );
+#endif
+        default:
+            return -1;
+    }
+}
+
+/** Returns the format of the input, which is only known after the first read. */
+stream_compression_t stream_decoder_format( const struct stream_decoder *d ) {
+    return d->format;
+}
+
+void stream_decoder_close( struct stream_decoder *d ) {
+#ifdef JAYSON_ZLIB
+    if( d->zlib_initialized ) {
+        inflateEnd( &d->zlib );
+    }
+#endif
+#ifdef JAYSON_ZSTD
+    ZSTD_freeDStream( d->zstd );
+#endif
+    free( d->input );
+    free( d );
+}
+
+
+/** Closes the decoder of a stream initialized with \c stream_init_decompress. */
+static void _release( stream_t *s ) {
+    stream_decoder_close( s->in_cb_ctx );
+}
+
+/** Initializes a stream that decompresses the input of \c in_cb if needed (see \c stream_decoder_open).
+ *
+ *  @return \c false if the buffers could not be allocated.
+ */
+bool stream_init_decompress( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx, size_t buffer_size ) {
+    struct stream_decoder *d = stream_decoder_open( in_cb, in_cb_ctx );
+    if( d == NULL ) {
+        return false;
+    }
+    if( !stream_init_buffer( s, ( stream_read_cb_t )stream_decoder_read, d, NULL, buffer_size ) ) {
+        stream_decoder_close( d );
+        return false;
+    }
+    s->release_cb = _release;
+    return true;
+}
@@ -0,0 +1,74 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "stream.h"
+
+
+/** Unmaps the file of a stream initialized with \c stream_init_mmap. */
+static void _unmap( stream_t *s ) {
+    munmap( s->buffer, s->buffer_size );
+}
+
+/** Initializes a stream that reads a whole file through a memory mapping.
+ *
+ *  The stream has no input callback, its buffer is the mapping itself so the data is never copied. Release it with
+ *  \c stream_release.
+ *
+ *  @param s Stream.
+ *  @param path Path of the file.
+ *  @param flags Zero or \c STREAM_MMAP_HUGE_PAGES.
+ *  @return \c false if the file could not be opened or mapped (\c errno tells why, \c ENODEV for files that have no
+ *          size to map such as pipes, terminals and the files of /proc, which must be read instead).
+ */
+bool stream_init_mmap( stream_t *s, const char *path, int flags ) {
+    memset( s, 0, sizeof( *s ) );
+
+    int fd = open( path, O_RDONLY );
+    if( fd < 0 ) {
+        return false;
+    }
+
+    struct stat st;
+    if( fstat( fd, &st ) != 0 ) {
+        close( fd );
+        return false;
+    }
+
+    /* only regular files have a size, and some of them still report 0 (e.g. in /proc) but have data to read */
+    uint8_t c;
+    if( !S_ISREG( st.st_mode ) || ( st.st_size == 0 && read( fd, &c, 1 ) != 0 ) ) {
+        close( fd );
+        errno = ENODEV;
+        return false;
+    }
+
+    /* empty files can't be mapped, the stream just reports the end of file */
+    if( st.st_size > 0 ) {
+        void *mapping = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( mapping == MAP_FAILED ) {
+            close( fd );
+            return false;
+        }
+
+        /* the tokenizer reads the file front to back, the hints are best effort */
+        ( void )madvise( mapping, st.st_size, MADV_SEQUENTIAL );
+#ifdef MADV_HUGEPAGE
+        if( flags & STREAM_MMAP_HUGE_PAGES ) {
+            ( void )madvise( mapping, st.st_size, MADV_HUGEPAGE );
+        }
+#endif
+
+        s->buffer = mapping;
+        s->buffer_size = st.st_size;
+        s->bytes_left = st.st_size;
+        s->release_cb = _unmap;
+    }
+
+    close( fd );
+    s->finished = true;
+    return true;
+}
@@ -0,0 +1,275 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+
+
+/** Buffer of the read-ahead ring. */
+struct slot {
+    /** Data read by the producer, aligned like the stream buffers. */
+    uint8_t *data;
+    /** Number of bytes in \c data, 0 at the end of the input or negative if the read failed. */
+    ssize_t len;
+};
+
+/** Read-ahead state shared by the producer thread and the stream.
+ *
+ *  The ring is single producer, single consumer: the producer only writes \c head and the slot it points to, the
+ *  consumer only writes \c tail, and both are published with atomic stores. A side only takes the lock to sleep when
+ *  the ring is empty or full, and the other side only takes it to wake a sleeping one.
+ */
+struct stream_readahead {
+    /** Callback that reads the input in the producer thread. */
+    stream_read_cb_t in_cb;
+    /** Context of \c in_cb. */
+    void *in_cb_ctx;
+
+    /** Ring of slots. */
+    struct slot *slots;
+    /** Number of slots in \c slots. */
+    size_t num_slots;
+    /** Size of the data of each slot. */
+    size_t slot_size;
+    /** Buffer out of the ring, which the stream reads from (see \c stream_readahead_swap). */
+    uint8_t *spare;
+
+    /** Number of slots filled by the producer. */
+    size_t head;
+    /** Number of slots given back by the consumer. */
+    size_t tail;
+    /** Bytes of the tail slot already consumed. */
+    size_t tail_read;
+
+    /** Lock and condition a side sleeps on while the ring is empty or full. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    /** \c true while the consumer sleeps until a slot is filled. */
+    bool consumer_sleeping;
+    /** \c true while the producer sleeps until a slot is given back. */
+    bool producer_sleeping;
+    /** Set by the consumer to make the producer exit. */
+    bool stop;
+
+    /** Producer thread. */
+    pthread_t thread;
+};
+
+
+/** \c true if the consumer can take a slot. */
+static bool _has_filled( struct stream_readahead *ra ) {
+    return __atomic_load_n( &ra->head, __ATOMIC_SEQ_CST ) != ra->tail;
+}
+
+/** \c true if the producer can fill a slot, or has to stop. */
+static bool _has_empty( struct stream_readahead *ra ) {
+    return ra->head - __atomic_load_n( &ra->tail, __ATOMIC_SEQ_CST ) < ra->num_slots ||
+           __atomic_load_n( &ra->stop, __ATOMIC_SEQ_CST );
+}
+
+/** Sleeps until \c ready returns \c true, setting \c sleeping meanwhile so the other side wakes it (see \c _wake).
+ *
+ *  \c sleeping is set before \c ready is checked again and both are sequentially consistent, so either the other
+ *  side sees it and wakes this one, or this one sees the change of the other side and doesn't sleep.
+ */
+static void _wait( struct stream_readahead *ra, bool *sleeping, bool ( *ready )( struct stream_readahead *ra ) ) {
+    if( ready( ra ) ) {
+        return;
+    }
+    pthread_mutex_lock( &ra->lock );
+    __atomic_store_n( sleeping, true, __ATOMIC_SEQ_CST );
+    while( !ready( ra ) ) {
+        pthread_cond_wait( &ra->wake, &ra->lock );
+    }
+    __atomic_store_n( sleeping, false, __ATOMIC_RELAXED );
+    pthread_mutex_unlock( &ra->lock );
+}
+
+/** Wakes the other side if it sleeps in \c _wait, after a change of the ring. */
+static void _wake( struct stream_readahead *ra, bool *sleeping ) {
+    if( __atomic_load_n( sleeping, __ATOMIC_SEQ_CST ) ) {
+        pthread_mutex_lock( &ra->lock );
+        pthread_cond_signal( &ra->wake );
+        pthread_mutex_unlock( &ra->lock );
+    }
+}
+
+/** Producer thread, fills slots until the input ends or fails. */
+static void *_producer( void *arg ) {
+    struct stream_readahead *ra = arg;
+    for( ;; ) {
+        _wait( ra, &ra->producer_sleeping, _has_empty );
+        if( __atomic_load_n( &ra->stop, __ATOMIC_SEQ_CST ) ) {
+            return NULL;
+        }
+
+        struct slot *slot = &ra->slots[ra->head % ra->num_slots];
+        slot->len = ra->in_cb( ra->in_cb_ctx, slot->data, ra->slot_size );
+        /* publishes the slot, whose data and length are written before */
+        __atomic_store_n( &ra->head, ra->head + 1, __ATOMIC_SEQ_CST );
+        _wake( ra, &ra->consumer_sleeping );
+        if( slot->len <= 0 ) {
+            return NULL;
+        }
+    }
+}
+
+/** Releases the memory of a read-ahead that has no thread running. */
+static void _free( struct stream_readahead *ra ) {
+    if( ra->slots != NULL ) {
+        for( size_t i = 0; i < ra->num_slots; i++ ) {
+            free( ra->slots[i].data );
+        }
+    }
+    free( ra->slots );
+    free( ra->spare );
+    free( ra );
+}
+
+/** Allocates a buffer of \c size bytes aligned to \c STREAM_BUFFER_ALIGNMENT, or returns \c NULL. */
+static uint8_t *_alloc_buffer( size_t size ) {
+    void *buffer;
+    return posix_memalign( &buffer, STREAM_BUFFER_ALIGNMENT, size ) == 0 ? buffer : NULL;
+}
+
+/** Starts a thread that reads ahead up to \c num_slots blocks of \c slot_size bytes with \c in_cb.
+ *
+ *  @return The read-ahead, to be read with \c stream_readahead_read or \c stream_readahead_swap, or \c NULL if it
+ *          could not be started.
+ */
+struct stream_readahead *stream_readahead_start( stream_read_cb_t in_cb, void *in_cb_ctx, size_t slot_size, size_t num_slots ) {
+    struct stream_readahead *ra = calloc( 1, sizeof( *ra ) );
+    if( ra == NULL ) {
+        return NULL;
+    }
+    ra->in_cb = in_cb;
+    ra->in_cb_ctx = in_cb_ctx;
+    ra->slot_size = slot_size;
+    ra->num_slots = num_slots;
+
+    ra->slots = calloc( num_slots, sizeof( *ra->slots ) );
+    ra->spare = _alloc_buffer( slot_size );
+    if( ra->slots == NULL || ra->spare == NULL ) {
+        _free( ra );
+        return NULL;
+    }
+    for( size_t i = 0; i < num_slots; i++ ) {
+        ra->slots[i].data = _alloc_buffer( slot_size );
+        if( ra->slots[i].data == NULL ) {
+            _free( ra );
+            return NULL;
+        }
+    }
+
+    pthread_mutex_init( &ra->lock, NULL );
+    pthread_cond_init( &ra->wake, NULL );
+    if( pthread_create( &ra->thread, NULL, _producer, ra ) != 0 ) {
+        pthread_mutex_destroy( &ra->lock );
+        pthread_cond_destroy( &ra->wake );
+        _free( ra );
+        return NULL;
+    }
+    return ra;
+}
+
+/** Gives the tail slot back to the producer once it's consumed. */
+static void _release_tail( struct stream_readahead *ra ) {
+    ra->tail_read = 0;
+    __atomic_store_n( &ra->tail, ra->tail + 1, __ATOMIC_SEQ_CST );
+    _wake( ra, &ra->producer_sleeping );
+}
+
+/** Input callback that copies the data read ahead to a stream, blocking only when the ring is empty. */
+ssize_t stream_readahead_read( struct stream_readahead *ra, void *data, size_t data_len ) {
+    _wait( ra, &ra->consumer_sleeping, _has_filled );
+
+    /* the end of the input and errors stay in the tail slot so every later call returns them */
+    struct slot *slot = &ra->slots[ra->tail % ra->num_slots];
+    if( slot->len <= 0 ) {
+        return slot->len;
+    }
+
+    size_t len = slot->len - ra->tail_read;
+    len = len < data_len ? len : data_len;
+    memcpy( data, slot->data + ra->tail_read, len );
+    ra->tail_read += len;
+    if( ra->tail_read == ( size_t )slot->len ) {
+        _release_tail( ra );
+    }
+    return len;
+}
+
+/** Same as \c stream_readahead_read, but hands the tail slot to the caller without copying it: \c *buffer is
+ *  swapped with the data of the slot, and the old buffer goes back to the producer.
+ *
+ *  @param ra Read-ahead.
+ *  @param buffer Buffer of the caller, which must be \c ra->spare or a buffer obtained from an earlier swap.
+ *  @return Number of bytes in the new \c *buffer, 0 at the end of the input or negative if the read failed.
+ */
+ssize_t stream_readahead_swap( struct stream_readahead *ra, uint8_t **buffer ) {
+    _wait( ra, &ra->consumer_sleeping, _has_filled );
+
+    struct slot *slot = &ra->slots[ra->tail % ra->num_slots];
+    if( slot->len <= 0 ) {
+        return slot->len;
+    }
+    if( ra->tail_read > 0 ) {
+        /* the start of the slot was copied by stream_readahead_read, the rest is copied too */
+        return stream_readahead_read( ra, *buffer, ra->slot_size );
+    }
+
+    uint8_t *data = slot->data;
+    ssize_t len = slot->len;
+    slot->data = *buffer;
+    *buffer = data;
+    ra->spare = data;
+    _release_tail( ra );
+    return len;
+}
+
+/** Stops the producer thread and releases the read-ahead.
+ *
+ *  If the input didn't end this waits for the read in progress, if any, to return.
+ */
+void stream_readahead_stop( struct stream_readahead *ra ) {
+    __atomic_store_n( &ra->stop, true, __ATOMIC_SEQ_CST );
+    _wake( ra, &ra->producer_sleeping );
+    pthread_join( ra->thread, NULL );
+
+    pthread_mutex_destroy( &ra->lock );
+    pthread_cond_destroy( &ra->wake );
+    _free( ra );
+}
+
+
+/** Stops the read-ahead of a stream initialized with \c stream_init_readahead. */
+static void _release( stream_t *s ) {
+    stream_readahead_stop( s->in_cb_ctx );
+}
+
+/** Initializes a stream whose input is read ahead by a background thread (see \c stream_readahead_start).
+ *
+ *  The stream buffer is one of the buffers of the ring, which is swapped with the next filled one when it's consumed
+ *  instead of copying it (see \c stream_readahead_swap). Only the refills that keep data in the buffer, after a mark
+ *  or in \c stream_ensure, copy it.
+ *
+ *  @param s Stream.
+ *  @param in_cb Input callback, called from the background thread.
+ *  @param in_cb_ctx Input callback context.
+ *  @param buffer_size Size of the stream buffer and of each block read ahead (0 uses \c STREAM_DEFAULT_BUFFER_SIZE).
+ *  @param num_buffers Number of blocks read ahead.
+ *  @return \c false if the buffers could not be allocated or the thread could not be started.
+ */
+bool stream_init_readahead( stream_t *s, stream_read_cb_t in_cb, void *in_cb_ctx, size_t buffer_size, size_t num_buffers ) {
+    buffer_size = buffer_size ? buffer_size : STREAM_DEFAULT_BUFFER_SIZE;
+    struct stream_readahead *ra = stream_readahead_start( in_cb, in_cb_ctx, buffer_size, num_buffers );
+    if( ra == NULL ) {
+        return false;
+    }
+
+    /* the buffers belong to the read-ahead, whichever the stream has when it's released */
+    stream_init_buffer( s, ( stream_read_cb_t )stream_readahead_read, ra, ra->spare, buffer_size );
+    s->swap_cb = ( stream_swap_cb_t )stream_readahead_swap;
+    s->release_cb = _release;
+    return true;
+}
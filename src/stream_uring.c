@@ -0,0 +1,509 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef JAYSON_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#include "stream.h"
+
+
+/** Input callback that reads from the file descriptor in \c ctx. */
+static ssize_t _read_fd( void *ctx, void *data, size_t data_len ) {
+    ssize_t bytes_read;
+    do {
+        bytes_read = read( ( int )( intptr_t )ctx, data, data_len );
+    } while( bytes_read < 0 && errno == EINTR );
+    return bytes_read;
+}
+
+
+#ifdef JAYSON_IO_URING
+/** Alignment of the buffers read by the kernel. */
+#define URING_BUFFER_ALIGNMENT 4096
+
+/** User data of the requests that cancel reads. */
+#define URING_CANCEL ( ( uint64_t )-1 )
+
+/** Buffer with a read in flight or completed. */
+struct uring_slot {
+    /** Registered buffer, which changes when it's handed to the stream (see \c _swap_uring). */
+    uint8_t *data;
+    /** Index of \c data in the registered buffers. */
+    unsigned buf_index;
+    /** File offset of the first byte of \c data (-1 for files that can't seek). */
+    off_t offset;
+    /** Number of bytes requested. */
+    size_t len;
+    /** Number of bytes read so far. */
+    size_t filled;
+    /** Negative error code if the read failed. */
+    int error;
+    /** \c true once the read completed (or ended the input). */
+    bool done;
+};
+
+/** io_uring input source, with a fixed number of reads kept in flight. */
+struct stream_uring {
+    /** Ring file descriptor. */
+    int ring_fd;
+    /** File descriptor being read. */
+    int fd;
+    /** \c true if reads can use explicit offsets, so several of them can be in flight. */
+    bool seekable;
+    /** Size of the file if \c seekable. */
+    off_t file_size;
+    /** Offset of the next read if \c seekable. */
+    off_t next_offset;
+    /** \c true if the buffers are registered with the ring. */
+    bool fixed;
+
+    /** Submission ring. */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_entries;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    /** Number of entries queued but not submitted. */
+    unsigned to_submit;
+    /** Number of reads queued that didn't complete yet. */
+    size_t in_flight;
+
+    /** Completion ring. */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /** Mappings of the rings. */
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    /** Buffers, consumed in order. */
+    struct uring_slot *slots;
+    size_t num_slots;
+    size_t slot_size;
+    void *buffers;
+
+    /** Index of the registered buffer held by the stream, which is in no slot. */
+    unsigned held;
+
+    /** Slot being consumed. */
+    size_t current;
+    /** Bytes of the current slot already consumed. */
+    size_t current_read;
+    /** \c true if a read could not be submitted, every later read fails. */
+    bool failed;
+};
+
+
+/** Submits the queued entries and waits for at least \c min_complete completions, or returns \c false if the ring
+ *  failed (with \c errno set). */
+static bool _enter( struct stream_uring *u, unsigned min_complete ) {
+    int submitted = syscall( __NR_io_uring_enter, u->ring_fd, u->to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+    if( submitted < 0 ) {
+        /* the kernel is short of memory or the completion ring is full, the entries stay queued for the next call */
+        return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+    }
+    u->to_submit -= submitted;
+    return true;
+}
+
+/** Returns the next free entry of the submission ring, submitting the queued ones first if it is full, or \c NULL if
+ *  there is still no room. */
+static struct io_uring_sqe *_next_sqe( struct stream_uring *u ) {
+    unsigned tail = *u->sq_tail;
+    if( tail - __atomic_load_n( u->sq_head, __ATOMIC_ACQUIRE ) >= *u->sq_entries ) {
+        if( !_enter( u, 0 ) || tail - __atomic_load_n( u->sq_head, __ATOMIC_ACQUIRE ) >= *u->sq_entries ) {
+            return NULL;
+        }
+    }
+    return &u->sqes[tail & *u->sq_mask];
+}
+
+/** Adds the entry filled by \c _next_sqe to the submission ring. */
+static void _push_sqe( struct stream_uring *u ) {
+    unsigned tail = *u->sq_tail;
+    unsigned index = tail & *u->sq_mask;
+    u->sq_array[index] = index;
+    __atomic_store_n( u->sq_tail, tail + 1, __ATOMIC_RELEASE );
+    u->to_submit += 1;
+}
+
+/** Queues a read for the part of slot \c i that is not filled yet, or ends the slot with an error if the submission
+ *  ring is full. */
+static void _queue_read( struct stream_uring *u, size_t i ) {
+    struct uring_slot *slot = &u->slots[i];
+    struct io_uring_sqe *sqe = _next_sqe( u );
+    if( sqe == NULL ) {
+        slot->error = -EBUSY;
+        slot->done = true;
+        return;
+    }
+
+    memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = u->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = u->fd;
+    sqe->off = u->seekable ? ( uint64_t )( slot->offset + slot->filled ) : ( uint64_t )-1;
+    sqe->addr = ( uintptr_t )( slot->data + slot->filled );
+    sqe->len = slot->len - slot->filled;
+    sqe->buf_index = slot->buf_index;
+    sqe->user_data = i;
+
+    _push_sqe( u );
+    u->in_flight += 1;
+}
+
+/** Queues a request that cancels the read of slot \c i, if the submission ring has room. */
+static void _queue_cancel( struct stream_uring *u, size_t i ) {
+    struct io_uring_sqe *sqe = _next_sqe( u );
+    if( sqe == NULL ) {
+        return;
+    }
+
+    memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = i;
+    sqe->user_data = URING_CANCEL;
+
+    _push_sqe( u );
+}
+
+/** Starts reading the next block of the input into slot \c i. */
+static void _arm( struct stream_uring *u, size_t i ) {
+    struct uring_slot *slot = &u->slots[i];
+    slot->filled = 0;
+    slot->error = 0;
+    slot->done = false;
+
+    if( u->seekable ) {
+        /* slots past the end of the file are done right away with no data */
+        if( u->next_offset >= u->file_size ) {
+            slot->len = 0;
+            slot->done = true;
+            return;
+        }
+        slot->offset = u->next_offset;
+        slot->len = u->file_size - u->next_offset < ( off_t )u->slot_size ? ( size_t )( u->file_size - u->next_offset ) : u->slot_size;
+        u->next_offset += slot->len;
+    } else {
+        slot->offset = -1;
+        slot->len = u->slot_size;
+    }
+    _queue_read( u, i );
+}
+
+/** Processes the completions, queueing the rest of short reads of regular files unless \c stopping. */
+static void _reap( struct stream_uring *u, bool stopping ) {
+    unsigned head = *u->cq_head;
+    while( head != __atomic_load_n( u->cq_tail, __ATOMIC_ACQUIRE ) ) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        head += 1;
+        if( cqe->user_data == URING_CANCEL ) {
+            continue;
+        }
+
+        struct uring_slot *slot = &u->slots[cqe->user_data];
+        u->in_flight -= 1;
+        if( stopping ) {
+            slot->done = true;
+        } else if( cqe->res == -EINTR || cqe->res == -EAGAIN ) {
+            _queue_read( u, cqe->user_data );
+        } else if( cqe->res < 0 ) {
+            slot->error = cqe->res;
+            slot->done = true;
+        } else {
+            slot->filled += cqe->res;
+            if( u->seekable && cqe->res > 0 && slot->filled < slot->len ) {
+                _queue_read( u, cqe->user_data );
+            } else {
+                slot->done = true;
+            }
+        }
+    }
+    __atomic_store_n( u->cq_head, head, __ATOMIC_RELEASE );
+}
+
+/** Waits for the read of the slot being consumed, returns it or \c NULL if the ring failed. */
+static struct uring_slot *_wait_current( struct stream_uring *u ) {
+    if( u->failed ) {
+        return NULL;
+    }
+    struct uring_slot *slot = &u->slots[u->current];
+    while( !slot->done ) {
+        if( !_enter( u, 1 ) ) {
+            return NULL;
+        }
+        _reap( u, false );
+    }
+    return slot;
+}
+
+/** Reuses the slot being consumed for the next block and moves to the next slot. */
+static void _next( struct stream_uring *u ) {
+    _arm( u, u->current );
+    if( !_enter( u, 0 ) ) {
+        /* the read stays queued and in flight, so it's waited for on release, but the input can't go on */
+        u->failed = true;
+    }
+    u->current = ( u->current + 1 ) % u->num_slots;
+    u->current_read = 0;
+}
+
+/** Input callback that copies the completed reads to the stream in order. */
+static ssize_t _read_uring( struct stream_uring *u, void *data, size_t data_len ) {
+    struct uring_slot *slot = _wait_current( u );
+    if( slot == NULL ) {
+        return -1;
+    }
+
+    /* the end of the input and errors stay in the current slot so every later call returns them */
+    if( slot->error != 0 ) {
+        return -1;
+    } else if( slot->filled == 0 ) {
+        return 0;
+    }
+
+    size_t len = slot->filled - u->current_read;
+    len = len < data_len ? len : data_len;
+    memcpy( data, slot->data + u->current_read, len );
+    u->current_read += len;
+    if( u->current_read == slot->filled ) {
+        _next( u );
+    }
+    return len;
+}
+
+/** Swap callback that hands the buffer of the next completed read to the stream, and reads the next block into the
+ *  buffer given back. */
+static ssize_t _swap_uring( struct stream_uring *u, uint8_t **buffer ) {
+    struct uring_slot *slot = _wait_current( u );
+    if( slot == NULL ) {
+        return -1;
+    }
+    if( slot->error != 0 ) {
+        return -1;
+    } else if( slot->filled == 0 ) {
+        return 0;
+    }
+    if( u->current_read > 0 ) {
+        /* the start of the slot was copied by _read_uring, the rest is copied too */
+        return _read_uring( u, *buffer, u->slot_size );
+    }
+
+    /* the stream only ever holds the registered buffer u->held */
+    uint8_t *data = slot->data;
+    unsigned index = slot->buf_index;
+    slot->data = *buffer;
+    slot->buf_index = u->held;
+    *buffer = data;
+    u->held = index;
+
+    ssize_t len = slot->filled;
+    _next( u );
+    return len;
+}
+
+/** Cancels the reads in flight and waits for them, since they write to the buffers. */
+static void _drain( struct stream_uring *u ) {
+    for( size_t i = 0; i < u->num_slots; i++ ) {
+        if( !u->slots[i].done ) {
+            _queue_cancel( u, i );
+        }
+    }
+    while( u->in_flight > 0 && _enter( u, 1 ) ) {
+        _reap( u, true );
+    }
+}
+
+static void _free( struct stream_uring *u ) {
+    if( u->slots != NULL && u->in_flight > 0 ) {
+        _drain( u );
+    }
+    if( u->sq_ring != NULL && u->sq_ring != MAP_FAILED ) {
+        munmap( u->sq_ring, u->sq_ring_size );
+    }
+    if( u->cq_ring != NULL && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring ) {
+        munmap( u->cq_ring, u->cq_ring_size );
+    }
+    if( u->sqes != NULL && u->sqes != MAP_FAILED ) {
+        munmap( u->sqes, u->sqes_size );
+    }
+    if( u->ring_fd >= 0 ) {
+        close( u->ring_fd );
+    }
+    free( u->buffers );
+    free( u->slots );
+    free( u );
+}
+
+/** Maps the rings of \c u->ring_fd. */
+static bool _map_rings( struct stream_uring *u, const struct io_uring_params *p ) {
+    u->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof( unsigned );
+    u->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof( struct io_uring_cqe );
+    if( p->features & IORING_FEAT_SINGLE_MMAP ) {
+        u->sq_ring_size = u->cq_ring_size = u->sq_ring_size > u->cq_ring_size ? u->sq_ring_size : u->cq_ring_size;
+    }
+
+    u->sq_ring = mmap( NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING );
+    if( u->sq_ring == MAP_FAILED ) {
+        return false;
+    }
+    if( p->features & IORING_FEAT_SINGLE_MMAP ) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap( NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_CQ_RING );
+        if( u->cq_ring == MAP_FAILED ) {
+            return false;
+        }
+    }
+    u->sqes_size = p->sq_entries * sizeof( struct io_uring_sqe );
+    u->sqes = mmap( NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES );
+    if( u->sqes == MAP_FAILED ) {
+        return false;
+    }
+
+    uint8_t *sq = u->sq_ring;
+    uint8_t *cq = u->cq_ring;
+    u->sq_head = ( unsigned * )( sq + p->sq_off.head );
+    u->sq_tail = ( unsigned * )( sq + p->sq_off.tail );
+    u->sq_entries = ( unsigned * )( sq + p->sq_off.ring_entries );
+    u->sq_mask = ( unsigned * )( sq + p->sq_off.ring_mask );
+    u->sq_array = ( unsigned * )( sq + p->sq_off.array );
+    u->cq_head = ( unsigned * )( cq + p->cq_off.head );
+    u->cq_tail = ( unsigned * )( cq + p->cq_off.tail );
+    u->cq_mask = ( unsigned * )( cq + p->cq_off.ring_mask );
+    u->cqes = ( struct io_uring_cqe * )( cq + p->cq_off.cqes );
+    return true;
+}
+
+/** Sets up a ring that keeps up to \c depth reads of \c slot_size bytes in flight, or returns \c NULL if the kernel
+ *  doesn't support io_uring. */
+static struct stream_uring *_uring_start( int fd, size_t slot_size, size_t depth ) {
+    struct stat st;
+    if( fstat( fd, &st ) != 0 ) {
+        return NULL;
+    }
+
+    struct stream_uring *u = calloc( 1, sizeof( *u ) );
+    if( u == NULL ) {
+        return NULL;
+    }
+    u->ring_fd = -1;
+    u->fd = fd;
+    u->slot_size = slot_size;
+
+    /* reads from pipes and sockets complete in any order, only files get several in flight */
+    u->seekable = S_ISREG( st.st_mode );
+    u->file_size = st.st_size;
+    u->next_offset = lseek( fd, 0, SEEK_CUR );
+    if( !u->seekable || u->next_offset < 0 ) {
+        u->seekable = false;
+        depth = 1;
+    }
+    u->num_slots = depth;
+
+    struct io_uring_params p;
+    memset( &p, 0, sizeof( p ) );
+    /* room for a read and a cancel per slot, so the submission ring can't fill even if nothing was submitted */
+    u->ring_fd = syscall( __NR_io_uring_setup, ( unsigned )( 2 * depth ), &p );
+    if( u->ring_fd < 0 || !_map_rings( u, &p ) ) {
+        _free( u );
+        return NULL;
+    }
+
+    /* one buffer per slot, and the last one for the stream */
+    size_t num_buffers = depth + 1;
+    u->slots = calloc( depth, sizeof( *u->slots ) );
+    if( u->slots == NULL || posix_memalign( &u->buffers, URING_BUFFER_ALIGNMENT, num_buffers * slot_size ) != 0 ) {
+        u->buffers = NULL;
+        _free( u );
+        return NULL;
+    }
+
+    /* registered buffers save the kernel mapping them on every read, plain reads work if they can't be pinned */
+    struct iovec *iovecs = malloc( num_buffers * sizeof( *iovecs ) );
+    if( iovecs == NULL ) {
+        _free( u );
+        return NULL;
+    }
+    for( size_t i = 0; i < num_buffers; i++ ) {
+        iovecs[i].iov_base = ( uint8_t * )u->buffers + i * slot_size;
+        iovecs[i].iov_len = slot_size;
+    }
+    for( size_t i = 0; i < depth; i++ ) {
+        u->slots[i].data = iovecs[i].iov_base;
+        u->slots[i].buf_index = i;
+    }
+    u->held = depth;
+    u->fixed = syscall( __NR_io_uring_register, u->ring_fd, IORING_REGISTER_BUFFERS, iovecs, ( unsigned )num_buffers ) == 0;
+    free( iovecs );
+
+    for( size_t i = 0; i < depth; i++ ) {
+        _arm( u, i );
+    }
+    if( !_enter( u, 0 ) ) {
+        _free( u );
+        return NULL;
+    }
+    return u;
+}
+
+/** Releases the ring of a stream initialized with \c stream_init_fd. */
+static void _release( stream_t *s ) {
+    _free( s->in_cb_ctx );
+}
+#endif
+
+
+/** Initializes a stream that reads from a file descriptor.
+ *
+ *  When built with \c JAYSON_IO_URING and the kernel supports it, up to \c depth reads are kept in flight with
+ *  io_uring into registered buffers (one at a time for pipes and sockets, which can't be read at an offset). The
+ *  stream buffer is one of them, which is swapped with the buffer of the next completed read when it's consumed, so
+ *  the input is only copied by refills that keep data in the buffer (after a mark or in \c stream_ensure).
+ *  Otherwise, or if \c depth is 0, the stream calls \c read.
+ *
+ *  @param s Stream.
+ *  @param fd File descriptor, which is not closed by \c stream_release.
+ *  @param buffer_size Size of the stream buffer and of each read (0 uses \c STREAM_DEFAULT_BUFFER_SIZE).
+ *  @param depth Maximum number of reads in flight.
+ *  @return \c false if the buffers could not be allocated.
+ */
+bool stream_init_fd( stream_t *s, int fd, size_t buffer_size, size_t depth ) {
+    buffer_size = buffer_size ? buffer_size : STREAM_DEFAULT_BUFFER_SIZE;
+
+#ifdef JAYSON_IO_URING
+    if( depth > 0 ) {
+        struct stream_uring *u = _uring_start( fd, buffer_size, depth );
+        if( u != NULL ) {
+            /* the buffers belong to the ring, whichever the stream has when it's released */
+            uint8_t *buffer = ( uint8_t * )u->buffers + u->held * buffer_size;
+            stream_init_buffer( s, ( stream_read_cb_t )_read_uring, u, buffer, buffer_size );
+            s->swap_cb = ( stream_swap_cb_t )_swap_uring;
+            s->release_cb = _release;
+            return true;
+        }
+    }
+#endif
+    return stream_init_buffer( s, _read_fd, ( void * )( intptr_t )fd, NULL, buffer_size );
+}
+
+/** Checks if \c s reads through io_uring (see \c stream_init_fd). */
+bool stream_uses_uring( const stream_t *s ) {
+#ifdef JAYSON_IO_URING
+    return s->release_cb == _release;
+#else
+    return false;
+#endif
+}
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 typedef struct
@@ -29,6 +30,9 @@ typedef struct
 #define varray_push( ptr, elem ) ( _resize_if_req( ptr ), (ptr)[varray_len( ptr )++] = (elem) )
 #define varray_pop( ptr ) ( (ptr)[--varray_len( ptr )] )
 #define varray_last( ptr ) ( (ptr)[varray_len( ptr ) - 1] )
+#define varray_reserve( ptr, n ) ( ( varray_len( ptr ) + (n) > _cap( ptr ) ) ? _resize( ptr, _grow_cap( _cap( ptr ), varray_len( ptr ) + (n) ) ) : ptr )
+#define varray_extend( ptr, src, n ) \
+    ( varray_reserve( ptr, n ), memcpy( (ptr) + varray_len( ptr ), src, sizeof( *(ptr) ) * (n) ), varray_len( ptr ) += (n) )
 
 
 static inline void *_varray_resize( void *ptr, size_t n, size_t elem_size ) {
@@ -38,5 +42,15 @@ static inline void *_varray_resize( void *ptr, size_t n, size_t elem_size ) {
     return va->data;
 }
 
+static inline size_t _grow_cap( size_t cap, size_t required ) {
+    if( cap == 0 ) {
+        cap = 1;
+    }
+    while( cap < required ) {
+        cap *= 2;
+    }
+    return cap;
+}
+
 
 #endif
@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fsm.h"
+#include "scunit.h"
+
+
+#define ASIZE( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
+
+
+enum {
+    test_state_init = FSM_INITIAL_STATE,
+    test_state_end = FSM_END_STATE,
+    test_state_word,
+    test_state_number,
+
+    test_state_last
+};
+
+/** Counts how many times each action was called. */
+struct action_ctx {
+    int word;
+    int digit;
+    int fail;
+};
+
+static bool _action_word( struct action_ctx *ctx, char c ) {
+    ctx->word += 1;
+    return true;
+}
+
+static bool _action_digit( struct action_ctx *ctx, char c ) {
+    ctx->digit += 1;
+    return true;
+}
+
+static bool _action_fail( struct action_ctx *ctx, char c ) {
+    ctx->fail += 1;
+    return false;
+}
+
+static const state_t _states[test_state_last] = {
+    [test_state_init] = {
+        .transitions = ( transition_t[] ){
+            { .values = " \t", .values_len = 2, .next_state = test_state_init },
+            { .values = "abc", .values_len = 3, .next_state = test_state_word, .action = ( transition_action_cb_t )_action_word },
+            { .values = "0123456789", .values_len = 10, .next_state = test_state_number, .action = ( transition_action_cb_t )_action_digit },
+            { .values = "!", .values_len = 1, .next_state = test_state_end, .action = ( transition_action_cb_t )_action_fail },
+        },
+        .num_transitions = 4,
+    },
+    [test_state_word] = {
+        .transitions = ( transition_t[] ){
+            { .values = "abc", .values_len = 3, .next_state = test_state_word, .action = ( transition_action_cb_t )_action_word },
+            { .values = "a0", .values_len = 2, .next_state = test_state_end },
+            { .values = ANY, .next_state = test_state_init },
+        },
+        .num_transitions = 3,
+    },
+    [test_state_number] = {
+        .transitions = ( transition_t[] ){
+            { .values = "0123456789", .values_len = 10, .next_state = test_state_number, .action = ( transition_action_cb_t )_action_digit },
+            { .values = " ", .values_len = 1, .next_state = test_state_init },
+        },
+        .num_transitions = 2,
+    },
+};
+
+
+TEST( CompiledMatchesLinear ) {
+    fsm_t fsm;
+    ASSERT_TRUE( fsm_compile( &fsm, _states, ASIZE( _states ) ) );
+
+    /* bytes that behave the same are grouped in a few classes */
+    EXPECT_TRUE( fsm.num_classes < 10 );
+
+    for( state_id_t state = 0; state < test_state_last; state++ ) {
+        for( int c = 0; c < 256; c++ ) {
+            struct action_ctx linear_ctx = { 0 };
+            struct action_ctx compiled_ctx = { 0 };
+
+            state_id_t linear = fsm_step( &_states[state], c, state, &linear_ctx );
+            state_id_t compiled = fsm_step_compiled( &fsm, state, c, &compiled_ctx );
+
+            ASSERT_EQ( linear, compiled );
+            ASSERT_EQ( 0, memcmp( &linear_ctx, &compiled_ctx, sizeof( linear_ctx ) ) );
+        }
+    }
+
+    fsm_release( &fsm );
+}
+
+TEST( CompiledFirstMatchWins ) {
+    fsm_t fsm;
+    ASSERT_TRUE( fsm_compile( &fsm, _states, ASIZE( _states ) ) );
+
+    struct action_ctx ctx = { 0 };
+
+    /* 'a' is in two transitions of the word state, the first one must be taken */
+    ASSERT_EQ( test_state_word, fsm_step_compiled( &fsm, test_state_word, 'a', &ctx ) );
+    ASSERT_EQ( 1, ctx.word );
+    /* '0' only matches the second transition */
+    ASSERT_EQ( test_state_end, fsm_step_compiled( &fsm, test_state_word, '0', &ctx ) );
+    /* anything else matches the ANY transition */
+    ASSERT_EQ( test_state_init, fsm_step_compiled( &fsm, test_state_word, 'z', &ctx ) );
+    /* failing actions are reported */
+    ASSERT_EQ( FSM_ERROR_TRANSITION, fsm_step_compiled( &fsm, test_state_init, '!', &ctx ) );
+    ASSERT_EQ( 1, ctx.fail );
+    /* no match */
+    ASSERT_EQ( FSM_ERROR_NO_MATCH, fsm_step_compiled( &fsm, test_state_number, 'x', &ctx ) );
+    ASSERT_EQ( FSM_ERROR_NO_MATCH, fsm_step_compiled( &fsm, test_state_end, 'x', &ctx ) );
+
+    fsm_release( &fsm );
+}
+
+TEST( RunSpan ) {
+    fsm_t fsm;
+    ASSERT_TRUE( fsm_compile( &fsm, _states, ASIZE( _states ) ) );
+
+    struct action_ctx ctx = { 0 };
+    const uint8_t *input = ( const uint8_t * )"  ab 12 a0 bb";
+    state_id_t state = FSM_INITIAL_STATE;
+
+    /* stops at the end of the span keeping the state */
+    const uint8_t *stop = fsm_run_span( &fsm, &state, input, input + 3, &ctx );
+    ASSERT_EQ( input + 3, stop );
+    ASSERT_EQ( test_state_word, state );
+
+    /* resumes and stops right after reaching the end state */
+    stop = fsm_run_span( &fsm, &state, stop, input + strlen( ( const char * )input ), &ctx );
+    ASSERT_EQ( input + 10, stop );
+    ASSERT_EQ( test_state_end, state );
+    ASSERT_EQ( 3, ctx.word );
+    ASSERT_EQ( 2, ctx.digit );
+
+    /* stops on errors */
+    state = test_state_number;
+    stop = fsm_run_span( &fsm, &state, input + 2, input + 4, &ctx );
+    ASSERT_EQ( input + 3, stop );
+    ASSERT_EQ( FSM_ERROR_NO_MATCH, state );
+
+    fsm_release( &fsm );
+}
+
+/** Records the runs passed to the span action. */
+struct span_ctx {
+    size_t runs;
+    size_t bytes;
+    size_t singles;
+};
+
+static bool _action_single( struct span_ctx *ctx, char c ) {
+    ctx->singles += 1;
+    return true;
+}
+
+static bool _action_run( struct span_ctx *ctx, const uint8_t *data, size_t data_len ) {
+    ctx->runs += 1;
+    ctx->bytes += data_len;
+    return true;
+}
+
+static const state_t _loop_states[] = {
+    [FSM_INITIAL_STATE] = {
+        .transitions = ( transition_t[] ){
+            { .values = " ", .values_len = 1, .next_state = FSM_INITIAL_STATE },
+            { .values = "\"", .values_len = 1, .next_state = 2 },
+        },
+        .num_transitions = 2,
+    },
+    [2] = {
+        .transitions = ( transition_t[] ){
+            { .values = "\"", .values_len = 1, .next_state = FSM_END_STATE },
+            { .values = ANY, .next_state = 2, .action = ( transition_action_cb_t )_action_single, .span_action = ( transition_span_action_cb_t )_action_run },
+        },
+        .num_transitions = 2,
+    },
+};
+
+TEST( SkipLoops ) {
+    fsm_t fsm;
+    ASSERT_TRUE( fsm_compile( &fsm, _loop_states, ASIZE( _loop_states ) ) );
+
+    /* only loops without a per byte action or with a span action can be skipped */
+    ASSERT_TRUE( fsm.loops[FSM_INITIAL_STATE].stays != NULL );
+    ASSERT_TRUE( fsm.loops[FSM_END_STATE].stays == NULL );
+    ASSERT_TRUE( fsm.loops[2].stays != NULL );
+    ASSERT_FALSE( fsm.loops[2].stays['"'] );
+
+    struct span_ctx ctx = { 0 };
+    const uint8_t *input = ( const uint8_t * )"    \"a long string\" ";
+    state_id_t state = FSM_INITIAL_STATE;
+
+    /* a run split by the end of the span is reported in two parts */
+    const uint8_t *stop = fsm_run_span( &fsm, &state, input, input + 10, &ctx );
+    ASSERT_EQ( input + 10, stop );
+    ASSERT_EQ( 2, state );
+    stop = fsm_run_span( &fsm, &state, stop, input + strlen( ( const char * )input ), &ctx );
+    ASSERT_EQ( FSM_END_STATE, state );
+    ASSERT_EQ( input + 19, stop );
+
+    ASSERT_EQ( 2, ctx.runs );
+    ASSERT_EQ( strlen( "a long string" ), ctx.bytes );
+    ASSERT_EQ( 0, ctx.singles );
+
+    fsm_release( &fsm );
+}
+
+/** State that loops until a quote, a backslash or a control character, like the strings of the tokenizer. */
+static const state_t _string_states[] = {
+    [FSM_INITIAL_STATE] = {
+        .transitions = ( transition_t[] ){
+            { .values = "\"\\", .values_len = 2, .next_state = FSM_END_STATE },
+            { .values = "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+                        "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f",
+              .values_len = 32, .next_state = FSM_ERROR_STATE },
+            { .values = ANY, .next_state = FSM_INITIAL_STATE },
+        },
+        .num_transitions = 3,
+    },
+    [FSM_END_STATE] = { 0 },
+};
+
+/** States that loop on whitespace, like the tokenizer between tokens, and on digits. */
+static const state_t _space_states[] = {
+    [FSM_INITIAL_STATE] = {
+        .transitions = ( transition_t[] ){
+            { .values = "\r\n\t ", .values_len = 4, .next_state = FSM_INITIAL_STATE },
+            { .values = "0123456789", .values_len = 10, .next_state = 2 },
+        },
+        .num_transitions = 2,
+    },
+    [FSM_END_STATE] = { 0 },
+    [2] = {
+        .transitions = ( transition_t[] ){
+            { .values = "0123456789", .values_len = 10, .next_state = 2 },
+            { .values = ANY, .next_state = FSM_END_STATE },
+        },
+        .num_transitions = 2,
+    },
+};
+
+/** Checks that \c scan followed by the scalar scan of the tail stops at the first byte that leaves \c loop. */
+static bool _check_scan( fsm_scan_t scan, const fsm_loop_t *loop ) {
+    uint8_t stays[256], stops[256];
+    size_t num_stays = 0, num_stops = 0;
+    for( size_t b = 0; b < 256; b++ ) {
+        if( loop->stays[b] ) {
+            stays[num_stays++] = b;
+        } else {
+            stops[num_stops++] = b;
+        }
+    }
+
+    uint8_t data[100];
+    for( size_t len = 0; len <= sizeof( data ); len++ ) {
+        for( size_t pos = 0; pos <= len; pos++ ) {
+            /* covers every byte, those above 0x7f catch signed comparisons */
+            for( size_t i = 0; i < len; i++ ) {
+                data[i] = stays[( i * 37 + len ) % num_stays];
+            }
+            if( pos < len ) {
+                data[pos] = stops[( pos * 13 + len ) % num_stops];
+            }
+
+            const uint8_t *p = scan( loop, data, data + len );
+            if( p > data + pos ) {
+                return false;
+            }
+            while( p < data + len && loop->stays[*p] ) {
+                p++;
+            }
+            if( p != data + pos ) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/** Checks every kernel the CPU supports on \c loop. */
+static bool _check_kernels( const fsm_loop_t *loop ) {
+#ifdef __SSE2__
+    if( !_check_scan( fsm_scan_sse2, loop ) ) {
+        return false;
+    }
+#endif
+#ifdef FSM_SCAN_AVX2
+    if( __builtin_cpu_supports( "avx2" ) && !_check_scan( fsm_scan_avx2, loop ) ) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+TEST( VectorScan ) {
+    fsm_t fsm;
+    ASSERT_TRUE( fsm_compile( &fsm, _string_states, ASIZE( _string_states ) ) );
+
+    /* a range at the start of the byte values plus a few bytes leave the loop */
+    const fsm_loop_t *loop = &fsm.loops[FSM_INITIAL_STATE];
+    ASSERT_TRUE( loop->vector );
+    ASSERT_EQ( 0x20, loop->stop_below );
+    ASSERT_EQ( '"', loop->bytes[0] );
+    ASSERT_EQ( '\\', loop->bytes[1] );
+#ifdef __SSE2__
+    ASSERT_TRUE( fsm.scan != NULL );
+#endif
+    ASSERT_TRUE( _check_kernels( loop ) );
+    fsm_release( &fsm );
+
+    /* a few bytes stay in the loop */
+    ASSERT_TRUE( fsm_compile( &fsm, _space_states, ASIZE( _space_states ) ) );
+    loop = &fsm.loops[FSM_INITIAL_STATE];
+    ASSERT_TRUE( loop->vector );
+    ASSERT_TRUE( loop->inverted );
+    ASSERT_EQ( 0, loop->stop_below );
+    ASSERT_TRUE( _check_kernels( loop ) );
+
+    /* the loop can be skipped by itself, like the whitespace before a token */
+    const uint8_t *input = ( const uint8_t * )"\r\n\t   \n                              42";
+    const uint8_t *end = input + strlen( ( const char * )input );
+    ASSERT_TRUE( fsm_skip_loop( &fsm, FSM_INITIAL_STATE, input, end ) == end - 2 );
+    ASSERT_TRUE( fsm_skip_loop( &fsm, FSM_INITIAL_STATE, end - 2, end ) == end - 2 );
+    ASSERT_TRUE( fsm_skip_loop( &fsm, FSM_INITIAL_STATE, input, end - 3 ) == end - 3 );
+    ASSERT_TRUE( fsm_skip_loop( &fsm, FSM_END_STATE, input, end ) == input );
+
+    /* loops that too many bytes stay in and leave are scanned with the map */
+    ASSERT_TRUE( fsm.loops[2].stays != NULL );
+    ASSERT_FALSE( fsm.loops[2].vector );
+    fsm_release( &fsm );
+}
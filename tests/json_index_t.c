@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json_index.h"
+#include "scunit.h"
+
+
+#define ASIZE( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
+
+
+/** Kernels the CPU supports. */
+static json_index_classify_t _kernels[3];
+
+static size_t _get_kernels( void ) {
+    size_t num_kernels = 0;
+    _kernels[num_kernels++] = json_index_classify_scalar;
+#ifdef __SSE2__
+    _kernels[num_kernels++] = json_index_classify_sse2;
+#endif
+#ifdef JSON_INDEX_AVX2
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        _kernels[num_kernels++] = json_index_classify_avx2;
+    }
+#endif
+    return num_kernels;
+}
+
+/** Fills \c data with pieces of JSON picked at random, so strings, escapes and operators land anywhere in the blocks. */
+static void _generate( char *data, size_t len, unsigned *seed ) {
+    static const char *pieces[] = {
+        "\"", "\\", "\\\\", "\\\"", "{", "}", "[", "]", ":", ",", " ", "\n", "\t", "abc", "12", "\x01", "\xc3\xa9",
+    };
+    size_t i = 0;
+    while( i < len ) {
+        *seed = *seed * 1103515245 + 12345;
+        const char *piece = pieces[( *seed >> 16 ) % ASIZE( pieces )];
+        for( ; *piece != '\0' && i < len; piece++ ) {
+            data[i++] = *piece;
+        }
+    }
+}
+
+/** Finds the structurals of \c data a byte at a time (see \c json_index_t).
+ *
+ *  @return Number of structurals stored in \c offsets.
+ */
+static size_t _structurals( const char *data, size_t len, uint32_t *offsets ) {
+    size_t n = 0;
+    bool in_string = false;
+    bool escaped = false;
+    for( size_t i = 0; i < len; i++ ) {
+        char c = data[i];
+        if( c == '"' && !escaped ) {
+            offsets[n++] = i;
+            in_string = !in_string;
+        } else if( in_string ? c == '\\' || ( uint8_t )c < 0x20 : strchr( "{}[]:,", c ) != NULL && c != '\0' ) {
+            offsets[n++] = i;
+        }
+        escaped = c == '\\' && !escaped;
+    }
+    return n;
+}
+
+TEST( Classify ) {
+    size_t num_kernels = _get_kernels();
+    unsigned seed = 1;
+    for( int round = 0; round < 1000; round++ ) {
+        uint8_t block[JSON_INDEX_BLOCK];
+        for( size_t i = 0; i < sizeof( block ); i++ ) {
+            seed = seed * 1103515245 + 12345;
+            block[i] = seed >> 16;
+        }
+        /* and the bytes the index looks for */
+        _generate( ( char * )block, ( seed >> 8 ) % JSON_INDEX_BLOCK, &seed );
+
+        json_index_masks_t expected;
+        json_index_classify_scalar( block, &expected );
+        for( size_t k = 1; k < num_kernels; k++ ) {
+            json_index_masks_t masks;
+            _kernels[k]( block, &masks );
+            ASSERT_EQ( expected.quote, masks.quote );
+            ASSERT_EQ( expected.backslash, masks.backslash );
+            ASSERT_EQ( expected.op, masks.op );
+            ASSERT_EQ( expected.control, masks.control );
+        }
+    }
+}
+
+TEST( Structurals ) {
+    size_t num_kernels = _get_kernels();
+    json_index_t index;
+    ASSERT_TRUE( json_index_init( &index ) );
+
+    static char data[3 * JSON_INDEX_BLOCK + 10];
+    static uint32_t expected[sizeof( data )];
+    unsigned seed = 1;
+    for( int round = 0; round < 2000; round++ ) {
+        _generate( data, sizeof( data ), &seed );
+        /* the bytes after the last whole block are not indexed */
+        size_t len = sizeof( data ) - sizeof( data ) % JSON_INDEX_BLOCK;
+        size_t num_expected = _structurals( data, len, expected );
+
+        for( size_t k = 0; k < num_kernels; k++ ) {
+            index.classify = _kernels[k];
+            json_index_build( &index, 1000, ( const uint8_t * )data, sizeof( data ) );
+            ASSERT_EQ( 1000, index.base );
+            ASSERT_EQ( 1000 + len, index.end );
+            ASSERT_EQ( num_expected, varray_len( index.offsets ) );
+            ASSERT_EQ( 0, memcmp( expected, index.offsets, num_expected * sizeof( expected[0] ) ) );
+            ASSERT_EQ( UINT32_MAX, index.offsets[num_expected] );
+        }
+    }
+    json_index_release( &index );
+}
+
+TEST( Seek ) {
+    char data[2 * JSON_INDEX_BLOCK];
+    memset( data, ' ', sizeof( data ) );
+    memcpy( data, "{\"key\": [1, 2]}", 15 );
+    memcpy( &data[JSON_INDEX_BLOCK + 10], "\"a \\\" b\"", 8 );
+
+    json_index_t index;
+    ASSERT_TRUE( json_index_init( &index ) );
+
+    /* no window yet */
+    ASSERT_EQ( -1, json_index_seek( &index, 0 ) );
+
+    json_index_build( &index, 100, ( const uint8_t * )data, sizeof( data ) );
+    ASSERT_EQ( -1, json_index_seek( &index, 99 ) );
+    ASSERT_EQ( 0, json_index_seek( &index, 100 ) );
+    ASSERT_EQ( 1, json_index_seek( &index, 101 ) );
+    ASSERT_EQ( 2, json_index_seek( &index, 102 ) );
+    ASSERT_EQ( 5, index.offsets[2] );
+
+    /* the escaped quote is not a structural, the backslash is */
+    long next = json_index_seek( &index, 100 + 16 );
+    ASSERT_EQ( JSON_INDEX_BLOCK + 10, index.offsets[next] );
+    ASSERT_EQ( JSON_INDEX_BLOCK + 13, index.offsets[next + 1] );
+    ASSERT_EQ( JSON_INDEX_BLOCK + 17, index.offsets[next + 2] );
+    ASSERT_EQ( -1, json_index_seek( &index, 100 + JSON_INDEX_BLOCK + 18 ) );
+    ASSERT_EQ( -1, json_index_seek( &index, 100 + sizeof( data ) ) );
+
+    json_index_release( &index );
+}
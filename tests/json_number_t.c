@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_number.h"
+#include "scunit.h"
+
+
+#define ASIZE( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
+
+
+/** Converts \c digits * 10^\c exponent like the tokenizer does, keeping the digits that fit in 64 bits, and checks
+ *  the result is the one of \c strtod.
+ *
+ *  @return 1 if the number was converted, 0 if it needs the slow path or -1 if the result is wrong.
+ */
+static int _check( const char *digits, int exponent ) {
+    uint64_t mantissa = 0;
+    int64_t scale = exponent;
+    bool truncated = false;
+    for( const char *p = digits; *p; p++ ) {
+        unsigned digit = *p - '0';
+        if( truncated || mantissa > ( UINT64_MAX - digit ) / 10 ) {
+            truncated = true;
+            scale += 1;
+        } else {
+            mantissa = mantissa * 10 + digit;
+        }
+    }
+
+    double value;
+    if( !json_number_to_double( mantissa, scale, truncated, &value ) ) {
+        return 0;
+    }
+
+    char input[512];
+    snprintf( input, sizeof( input ), "%se%d", digits, exponent );
+    double expected = strtod( input, NULL );
+    if( memcmp( &value, &expected, sizeof( value ) ) != 0 ) {
+        printf( "%s: %.17g instead of %.17g\n", input, value, expected );
+        return -1;
+    }
+    return 1;
+}
+
+TEST( NumberHardCases ) {
+    static const struct {
+        const char *digits;
+        int exponent;
+    } cases[] = {
+        /* Clinger's fast path */
+        { "0", 0 }, { "1", 0 }, { "15", -1 }, { "9007199254740992", 0 }, { "123456789", 22 }, { "5", -22 },
+        /* 2^53 + 1 is halfway between two doubles */
+        { "9007199254740993", 0 },
+        { "1", 23 },
+        /* largest and smallest doubles, and the limit between subnormal and normal numbers */
+        { "17976931348623157", 292 }, { "17976931348623159", 292 }, { "49406564584124654", -340 },
+        { "24703282292062327", -340 }, { "24703282292062328", -340 }, { "22250738585072011", -324 },
+        { "22250738585072014", -324 },
+        /* out of range */
+        { "1", 400 }, { "1", -400 }, { "18446744073709551615", 290 },
+        /* long numbers that only match strtod if the dropped digits are taken into account */
+        { "9007199254740993000000000000000000001", -21 }, { "7450580596923828125", -27 },
+        { "18446744073709551615", 0 }, { "123456789012345678901234567890", -10 },
+    };
+
+    for( size_t i = 0; i < ASIZE( cases ); i++ ) {
+        ASSERT_NE( -1, _check( cases[i].digits, cases[i].exponent ) );
+    }
+
+    /* the numbers that fit in the fast paths never take the slow one */
+    ASSERT_EQ( 1, _check( "9007199254740993", 0 ) );
+    ASSERT_EQ( 1, _check( "17976931348623157", 292 ) );
+    ASSERT_EQ( 1, _check( "49406564584124654", -340 ) );
+}
+
+TEST( NumberRandom ) {
+    uint64_t seed = 1;
+    size_t slow = 0;
+    for( int i = 0; i < 200000; i++ ) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        char digits[48];
+        /* 1 to 19 digits most of the time, sometimes longer numbers */
+        int len = ( seed >> 58 ) < 56 ? 1 + ( seed >> 40 ) % 19 : 20 + ( seed >> 40 ) % 20;
+        uint64_t bits = seed;
+        for( int d = 0; d < len; d++ ) {
+            bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+            digits[d] = '0' + ( bits >> 33 ) % 10;
+        }
+        digits[len] = '\0';
+        int exponent = ( int )( ( seed >> 20 ) % 700 ) - 360;
+
+        int result = _check( digits, exponent );
+        ASSERT_NE( -1, result );
+        slow += result == 0;
+    }
+    /* only numbers very close to halfway between two doubles need the slow path */
+    ASSERT_TRUE( slow < 100 );
+}
+
+/** Makes a number of the characters of \c raw, with the flags the tokenizer gives it. */
+static json_number_t _number( const char *raw ) {
+    json_number_t number = { .data = raw, .len = strlen( raw ) };
+    number.flags |= raw[0] == '-' ? JSON_NUMBER_NEGATIVE : 0;
+    number.flags |= strchr( raw, '.' ) != NULL ? JSON_NUMBER_FRACTION : 0;
+    number.flags |= strpbrk( raw, "eE" ) != NULL ? JSON_NUMBER_EXPONENT : 0;
+    return number;
+}
+
+TEST( NumberAsI64 ) {
+    static const struct {
+        const char *raw;
+        int64_t value;
+    } cases[] = {
+        { "0", 0 }, { "-0", 0 }, { "42", 42 }, { "-7", -7 }, { "000123", 123 },
+        { "9223372036854775807", INT64_MAX }, { "-9223372036854775808", INT64_MIN },
+    };
+    for( size_t i = 0; i < ASIZE( cases ); i++ ) {
+        json_number_t number = _number( cases[i].raw );
+        int64_t value;
+        ASSERT_TRUE( json_number_as_i64( &number, &value ) );
+        ASSERT_EQ( cases[i].value, value );
+    }
+
+    /* out of range, or not written as an integer */
+    static const char *invalid[] = {
+        "9223372036854775808", "-9223372036854775809", "18446744073709551616", "123456789012345678901234567890",
+        "1.0", "1e3", "-2.5E-1",
+    };
+    for( size_t i = 0; i < ASIZE( invalid ); i++ ) {
+        json_number_t number = _number( invalid[i] );
+        int64_t value;
+        ASSERT_FALSE( json_number_as_i64( &number, &value ) );
+    }
+}
+
+TEST( NumberAsDouble ) {
+    static const char *cases[] = {
+        "0", "-0", "1", "-2.5e3", "1E+5", "0.1", "6.02214076e23", "1.7976931348623157e308", "4.9e-324", "1e-400",
+        "9007199254740993", "0.00000000000000000000000000000000000000001e45", "3.14159265358979323846264338327950288",
+        "2.4703282292062327208828439644e-324", "18446744073709551616", "-123456789012345678901234567890.5",
+    };
+    for( size_t i = 0; i < ASIZE( cases ); i++ ) {
+        json_number_t number = _number( cases[i] );
+        double value;
+        ASSERT_TRUE( json_number_as_double( &number, &value ) );
+        double expected = strtod( cases[i], NULL );
+        ASSERT_EQ( 0, memcmp( &expected, &value, sizeof( value ) ) );
+    }
+
+    /* a number close to halfway between two doubles, with more digits than fit on the stack of the slow path */
+    char digits[300];
+    memset( digits, '0', sizeof( digits ) - 1 );
+    digits[sizeof( digits ) - 1] = '\0';
+    memcpy( digits, "7450580596923828125", 19 );
+    memcpy( &digits[sizeof( digits ) - 6], "e-279", 5 );
+    json_number_t number = _number( digits );
+    double value;
+    ASSERT_TRUE( json_number_as_double( &number, &value ) );
+    ASSERT_TRUE( value == strtod( digits, NULL ) );
+
+    /* too large for a double */
+    number = _number( "1e400" );
+    ASSERT_FALSE( json_number_as_double( &number, &value ) );
+    number = _number( "-1e99999999999999999999" );
+    ASSERT_FALSE( json_number_as_double( &number, &value ) );
+}
@@ -12,8 +12,9 @@
 #define ASSERT_TOKEN_STR( expected_cstr, token ) \
     do { \
         ASSERT_EQ( json_token_string, ( token ).type ); \
-        ASSERT_EQ( 0, strcmp( ( token ).value.string, expected_cstr ) ); \
-        varray_release( ( token ).value.string ); \
+        ASSERT_EQ( strlen( expected_cstr ), ( token ).value.string.len ); \
+        ASSERT_EQ( 0, memcmp( ( token ).value.string.data, expected_cstr, ( token ).value.string.len ) ); \
+        token_release( &( token ) ); \
     } while(0)
 
 #define ASSERT_TOKEN_ERROR( expected_error_cstr, token ) \
@@ -63,6 +64,30 @@ struct buffer {
     STREAM_INIT( &var_name, _stream_cstr_in_cb, &buffer )
 
 
+/* malloc, calloc and realloc are wrapped at link time (see the Makefile) to count the heap allocations */
+void *__real_malloc( size_t size );
+void *__real_calloc( size_t num, size_t size );
+void *__real_realloc( void *ptr, size_t size );
+
+/** Number of calls to malloc, calloc and realloc. */
+static size_t _allocations = 0;
+
+void *__wrap_malloc( size_t size ) {
+    __atomic_add_fetch( &_allocations, 1, __ATOMIC_RELAXED );
+    return __real_malloc( size );
+}
+
+void *__wrap_calloc( size_t num, size_t size ) {
+    __atomic_add_fetch( &_allocations, 1, __ATOMIC_RELAXED );
+    return __real_calloc( num, size );
+}
+
+void *__wrap_realloc( void *ptr, size_t size ) {
+    __atomic_add_fetch( &_allocations, 1, __ATOMIC_RELAXED );
+    return __real_realloc( ptr, size );
+}
+
+
 static ssize_t _stream_cstr_in_cb( struct buffer *b, void *data, size_t data_len ) {
     size_t bytes_to_output = MIN( data_len, b->data_len - ( b->ptr - b->data ) );
     memcpy( data, b->ptr, bytes_to_output );
@@ -85,6 +110,7 @@ TEST( String ) {
         ASSERT_TOKEN_ERROR( "Unexpected end of file", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* empty string */
     {
@@ -105,6 +131,7 @@ TEST( String ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* good string */
     {
@@ -125,6 +152,7 @@ TEST( String ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* spaces */
     {
@@ -145,6 +173,7 @@ TEST( String ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* escapes */
     {
@@ -161,6 +190,7 @@ TEST( String ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* no control characters inside string */
     {
@@ -174,6 +204,20 @@ TEST( String ) {
         ASSERT_TOKEN_ERROR( "Invalid control character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
+    }
+    {
+        CSTR_STREAM( s, " \"a long string that cannot have a tab \t inside\" " );
+
+        json_token_t token;
+        tokenizer_t tokenizer;
+        tokenizer_init( &tokenizer, &s );
+
+        token = tokenizer_get_next( &tokenizer );
+        ASSERT_TOKEN_ERROR( "Invalid control character", token );
+
+        tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
 }
 
@@ -195,6 +239,7 @@ TEST( integer ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
         
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* zero */
     {
@@ -212,6 +257,7 @@ TEST( integer ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* integer */
     {
@@ -229,6 +275,7 @@ TEST( integer ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     {
         CSTR_STREAM( s, "8192[" );
@@ -248,6 +295,7 @@ TEST( integer ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* spaces */
     {
@@ -265,7 +313,108 @@ TEST( integer ) {
         ASSERT_EQ( json_token_eof, token.type );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
+    }
+}
+
+
+/** Returns the first token of \c input, read through a 16 byte buffer so long numbers cross refills. */
+static json_token_t _first_token( const char *input ) {
+    BUFFER( input );
+    uint8_t data[16];
+    stream_t s;
+    STREAM_INIT_BUFFER( &s, _stream_cstr_in_cb, &buffer, data, sizeof( data ) );
+
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+    /* numbers and errors don't point into the tokenizer */
+    json_token_t token = tokenizer_get_next( &tokenizer );
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+    return token;
+}
+
+TEST( IntegerRange ) {
+    char input[64];
+    json_token_t token;
+
+    /* 8 digit chunks, leading zeros and numbers longer than the buffer */
+    token = _first_token( "1234567890123456789 " );
+    ASSERT_EQ( json_token_integer, token.type );
+    ASSERT_EQ( 1234567890123456789, token.value.integer );
+    token = _first_token( "000000000000000000000042]" );
+    ASSERT_EQ( json_token_integer, token.type );
+    ASSERT_EQ( 42, token.value.integer );
+
+    /* negative numbers */
+    token = _first_token( "-7," );
+    ASSERT_EQ( json_token_integer, token.type );
+    ASSERT_EQ( -7, token.value.integer );
+    token = _first_token( "-0" );
+    ASSERT_EQ( json_token_integer, token.type );
+    ASSERT_EQ( 0, token.value.integer );
+    ASSERT_TOKEN_ERROR( "Unexpected end of file", _first_token( "-" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "-a" ) );
+
+    /* the limits of integer_t */
+    snprintf( input, sizeof( input ), "%ld", ( long )INTEGER_MAX );
+    token = _first_token( input );
+    ASSERT_EQ( json_token_integer, token.type );
+    ASSERT_EQ( INTEGER_MAX, token.value.integer );
+    snprintf( input, sizeof( input ), "%ld", ( long )-INTEGER_MAX - 1 );
+    token = _first_token( input );
+    ASSERT_EQ( json_token_integer, token.type );
+    ASSERT_EQ( -INTEGER_MAX - 1, token.value.integer );
+
+    /* overflows */
+    snprintf( input, sizeof( input ), "%lu", ( unsigned long )INTEGER_MAX + 1 );
+    ASSERT_TOKEN_ERROR( "Integer conversion failed", _first_token( input ) );
+    snprintf( input, sizeof( input ), "-%lu", ( unsigned long )INTEGER_MAX + 2 );
+    ASSERT_TOKEN_ERROR( "Integer conversion failed", _first_token( input ) );
+    ASSERT_TOKEN_ERROR( "Integer conversion failed", _first_token( "18446744073709551616" ) );
+    ASSERT_TOKEN_ERROR( "Integer conversion failed", _first_token( "-123456789012345678901234567890" ) );
+
+    /* the integer part of fractions is kept even if it overflows */
+    token = _first_token( "-1.5" );
+    ASSERT_TOKEN_FRACTION( -1.5, token );
+    token = _first_token( "123456789012345678901234.5" );
+    ASSERT_EQ( json_token_fraction, token.type );
+    ASSERT_TRUE( token.value.fraction == 123456789012345678901234.5 );
+    token = _first_token( "-98765432109876543210.25" );
+    ASSERT_EQ( json_token_fraction, token.type );
+    ASSERT_TRUE( token.value.fraction == -98765432109876543210.25 );
+}
+
+
+TEST( Exponent ) {
+    static const struct {
+        const char *input;
+        double value;
+    } numbers[] = {
+        { "1e5", 1e5 }, { "1E+5,", 1e5 }, { "-2.5e-3]", -2.5e-3 }, { "0e0", 0.0 }, { "6.02214076e23", 6.02214076e23 },
+        { "1.7976931348623157e308", 1.7976931348623157e308 }, { "4.9e-324", 4.9e-324 }, { "1e-400", 0.0 },
+        { "-37.774929e0 ", -37.774929 }, { "122.419416E-0}", 122.419416 },
+        /* exponents larger than any double cancelled by the digits */
+        { "0.00000000000000000000000000000000000000001e45", 1e4 },
+        { "100000000000000000000000000000000000000000e-45", 1e-4 },
+        /* more digits than fit in 64 bits */
+        { "3.14159265358979323846264338327950288", 3.14159265358979323846264338327950288 },
+        { "2.4703282292062327208828439644e-324", 5e-324 }, { "2.4703282292062327208828e-324", 0.0 },
+    };
+    for( size_t i = 0; i < ASIZE( numbers ); i++ ) {
+        json_token_t token = _first_token( numbers[i].input );
+        ASSERT_EQ( json_token_fraction, token.type );
+        /* the conversion is exact, so the doubles are the same as the compiler's */
+        ASSERT_TRUE( token.value.fraction == numbers[i].value );
     }
+
+    ASSERT_TOKEN_ERROR( "Unexpected end of file", _first_token( "1e" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected end of file", _first_token( "1.5e-" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "1ex" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "1e+-5" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "1.e5" ) );
+    ASSERT_TOKEN_ERROR( "Fraction conversion failed", _first_token( "1e400" ) );
+    ASSERT_TOKEN_ERROR( "Fraction conversion failed", _first_token( "-1e99999999999999999999" ) );
 }
 
 
@@ -282,6 +431,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_ERROR( "Unexpected end of file", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* invalid decimal part */
     {
@@ -295,6 +445,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* invalid integer part */
     {
@@ -313,6 +464,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* zero */
     {
@@ -326,6 +478,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_FRACTION( 0.0, token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* zero */
     {
@@ -339,6 +492,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_FRACTION( 0.0, token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* valid decimal part */
     {
@@ -352,6 +506,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_FRACTION( 1230.0456789, token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* only decimal part */
     {
@@ -365,6 +520,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_FRACTION( 0.000124, token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* zero decimal part */
     {
@@ -378,6 +534,7 @@ TEST( fraction ) {
         ASSERT_TOKEN_FRACTION( 100.0, token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
 }
 
@@ -394,6 +551,7 @@ TEST( boolean ) {
         ASSERT_TOKEN_BOOLEAN( true, token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     {
         CSTR_STREAM( s, "false" );
@@ -406,6 +564,7 @@ TEST( boolean ) {
         ASSERT_TOKEN_BOOLEAN( false, token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* invalid */
     {
@@ -419,6 +578,7 @@ TEST( boolean ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     {
         CSTR_STREAM( s, "treu" );
@@ -431,6 +591,7 @@ TEST( boolean ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     {
         CSTR_STREAM( s, "truue" );
@@ -443,6 +604,7 @@ TEST( boolean ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     {
         CSTR_STREAM( s, "flase" );
@@ -455,6 +617,7 @@ TEST( boolean ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
 }
 
@@ -471,6 +634,7 @@ TEST( null ) {
         ASSERT_TOKEN_NULL( token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     /* invalid */
     {
@@ -484,6 +648,7 @@ TEST( null ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     {
         CSTR_STREAM( s, "nul" );
@@ -496,6 +661,7 @@ TEST( null ) {
         ASSERT_TOKEN_ERROR( "Unexpected end of file", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
     {
         CSTR_STREAM( s, "nlul" );
@@ -508,9 +674,56 @@ TEST( null ) {
         ASSERT_TOKEN_ERROR( "Unexpected character", token );
 
         tokenizer_release( &tokenizer );
+        stream_release( &s );
     }
 }
 
+TEST( Literals ) {
+    /* every position of the literals relative to the 16 byte buffer, so some of them cross a refill */
+    static const json_token_type_t expected[] = {
+        json_token_array_open, json_token_boolean, json_token_comma, json_token_boolean, json_token_comma,
+        json_token_null, json_token_comma, json_token_boolean, json_token_array_close, json_token_eof,
+    };
+    for( int offset = 0; offset < 20; offset++ ) {
+        char input[64];
+        snprintf( input, sizeof( input ), "%*s[true, false,null ,\n  true]", offset, "" );
+        BUFFER( input );
+        uint8_t data[16];
+        stream_t s;
+        STREAM_INIT_BUFFER( &s, _stream_cstr_in_cb, &buffer, data, sizeof( data ) );
+        tokenizer_t tokenizer;
+        tokenizer_init( &tokenizer, &s );
+
+        int booleans = 0;
+        for( size_t i = 0; i < ASIZE( expected ); i++ ) {
+            json_token_t token = tokenizer_get_next( &tokenizer );
+            ASSERT_EQ( expected[i], token.type );
+            if( token.type == json_token_boolean ) {
+                /* true, false, true */
+                bool even = booleans % 2 == 0;
+                ASSERT_EQ( even, token.value.boolean );
+                booleans += 1;
+            }
+        }
+
+        /* the position counts the bytes matched outside the FSM */
+        int line, column;
+        stream_position( &s, &line, &column );
+        ASSERT_EQ( 1, line );
+        ASSERT_EQ( 7, column );
+
+        tokenizer_release( &tokenizer );
+        stream_release( &s );
+    }
+
+    /* literals that don't match take the FSM and its errors */
+    ASSERT_TOKEN_ERROR( "Unexpected end of file", _first_token( "  fals" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "nulL" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "faLse " ) );
+    json_token_t token = _first_token( "\t\tfalse}" );
+    ASSERT_TOKEN_BOOLEAN( false, token );
+}
+
 TEST( Mix ) {
     const char *input = "{, :   [\"this\", \"is\", \"a\", \n \"test\",   123, 0] }:::";
     BUFFER( input );
@@ -591,4 +804,355 @@ TEST( Mix ) {
     ASSERT_EQ( json_token_eof, token.type );
 
     tokenizer_release( &tokenizer );
+    stream_release( &s );
+}
+
+TEST( StringViews ) {
+    /* the stream buffer holds 16 bytes, so the last string crosses two refills */
+    const char *input = "\"view\" \"esc\\naped\" \"crosses the end of the buffer\" \"\"";
+    BUFFER( input );
+    uint8_t data[16];
+    stream_t s;
+    STREAM_INIT_BUFFER( &s, _stream_cstr_in_cb, &buffer, data, sizeof( data ) );
+
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+
+    /* strings without escapes point into the stream buffer */
+    json_token_t token = tokenizer_get_next( &tokenizer );
+    ASSERT_FALSE( token.value.string.copied );
+    ASSERT_TRUE( token.value.string.data == ( char * )&data[1] );
+    ASSERT_TOKEN_STR( "view", token );
+
+    /* escapes and refills copy the string */
+    token = tokenizer_get_next( &tokenizer );
+    ASSERT_TRUE( token.value.string.copied );
+    ASSERT_TOKEN_STR( "esc\naped", token );
+
+    token = tokenizer_get_next( &tokenizer );
+    ASSERT_TRUE( token.value.string.copied );
+    ASSERT_TOKEN_STR( "crosses the end of the buffer", token );
+
+    token = tokenizer_get_next( &tokenizer );
+    ASSERT_FALSE( token.value.string.copied );
+    ASSERT_TOKEN_STR( "", token );
+
+    token = tokenizer_get_next( &tokenizer );
+    ASSERT_EQ( json_token_eof, token.type );
+
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+}
+
+/** Checks the first token of \c input is the string \c expected, reading it through a 16 byte buffer. */
+static bool _first_string_is( const char *input, const char *expected, size_t expected_len ) {
+    BUFFER( input );
+    uint8_t data[16];
+    stream_t s;
+    STREAM_INIT_BUFFER( &s, _stream_cstr_in_cb, &buffer, data, sizeof( data ) );
+
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+    json_token_t token = tokenizer_get_next( &tokenizer );
+    bool equal = token.type == json_token_string && token.value.string.len == expected_len &&
+                 memcmp( token.value.string.data, expected, expected_len ) == 0;
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+    return equal;
+}
+
+TEST( UnicodeEscapes ) {
+    static const struct {
+        const char *input;
+        const char *expected;
+        size_t expected_len;
+    } strings[] = {
+        { "\"\\u0041\\u00e9\\u20AC\\ud83d\\ude00\"", "A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", 10 },
+        { "\"caf\\u00e9 \\u00fcber\\n\\u0000!\"", "caf\xc3\xa9 \xc3\xbc" "ber\n\0!", 14 },
+        { "\"\\t\\\"\\u007f\\u0080\\u07ff\\u0800\\uffff\\/\"", "\t\"\x7f\xc2\x80\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf/", 14 },
+        { "\"\\uDBFF\\uDFFF\\uD800\\uDC00x\"", "\xf4\x8f\xbf\xbf\xf0\x90\x80\x80x", 9 },
+    };
+    /* every position relative to the 16 byte buffer, so escapes are decoded from the buffer or a byte at a time */
+    for( size_t i = 0; i < ASIZE( strings ); i++ ) {
+        for( int offset = 0; offset < 16; offset++ ) {
+            char input[128];
+            snprintf( input, sizeof( input ), "%*s%s", offset, "", strings[i].input );
+            ASSERT_TRUE( _first_string_is( input, strings[i].expected, strings[i].expected_len ) );
+        }
+    }
+
+    CSTR_STREAM( s, "\"\\u00e9t\\u00e9\" \"\\ud83d\\ude00\\ud83d\\ude01\"" );
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+    json_token_t token = tokenizer_get_next( &tokenizer );
+    ASSERT_TOKEN_STR( "\xc3\xa9t\xc3\xa9", token );
+    token = tokenizer_get_next( &tokenizer );
+    ASSERT_TOKEN_STR( "\xf0\x9f\x98\x80\xf0\x9f\x98\x81", token );
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+
+    /* surrogates must come in pairs */
+    for( int offset = 0; offset < 16; offset++ ) {
+        static const char *unpaired[] = {
+            "\"\\ud83d\"", "\"\\ud83dx\"", "\"\\ud83d\\n\"", "\"\\ud83d\\u0041\"", "\"\\ude00\"", "\"\\ud83d\\ud83d\"",
+        };
+        for( size_t i = 0; i < ASIZE( unpaired ); i++ ) {
+            char input[64];
+            snprintf( input, sizeof( input ), "%*s%s", offset, "", unpaired[i] );
+            ASSERT_TOKEN_ERROR( "Invalid surrogate pair", _first_token( input ) );
+        }
+    }
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "\"\\u12G4\"" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected character", _first_token( "\"\\u12\"" ) );
+    ASSERT_TOKEN_ERROR( "Unexpected end of file", _first_token( "\"\\u12" ) );
+}
+
+TEST( NoAllocations ) {
+    /* the same document twice, the first one grows the scratch buffers of the tokenizer */
+    const char *document = "{\"key\": \"value\", \"escaped \\\"key\\\"\": [\"a\\tlonger escaped string value\", 12345, "
+                           "1.5, true, false, null]}\n";
+    char input[512];
+    snprintf( input, sizeof( input ), "%s%s", document, document );
+    CSTR_STREAM( s, input );
+
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+
+    size_t num_tokens = 0;
+    size_t allocations = 0;
+    for( ;; ) {
+        json_token_t token = tokenizer_get_next( &tokenizer );
+        ASSERT_NE( json_token_error, token.type );
+        if( token.type == json_token_eof ) {
+            break;
+        }
+        token_release( &token );
+
+        /* counts from the end of the first document */
+        num_tokens += 1;
+        if( num_tokens == 21 ) {
+            ASSERT_EQ( json_token_object_close, token.type );
+            allocations = _allocations;
+        }
+    }
+    ASSERT_EQ( 42, num_tokens );
+    ASSERT_EQ( allocations, _allocations );
+
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+}
+
+/** Reads the tokens of \c input one at a time through a buffer of \c buffer_size bytes (0 for the default size),
+ *  keeping a copy of their strings and their positions. */
+static size_t _read_tokens( const char *input, size_t buffer_size, bool use_index, json_token_t *tokens,
+                            char strings[][32], int ( *positions )[2], size_t cap ) {
+    BUFFER( input );
+    stream_t s;
+    STREAM_INIT_BUFFER( &s, _stream_cstr_in_cb, &buffer, NULL, buffer_size );
+    tokenizer_t tokenizer;
+    tokenizer_init( &tokenizer, &s );
+    tokenizer.use_index = use_index;
+
+    size_t n = 0;
+    while( n < cap ) {
+        tokens[n] = tokenizer_get_next( &tokenizer );
+        tokenizer_position( &tokenizer, &positions[n][0], &positions[n][1] );
+        if( tokens[n].type == json_token_string ) {
+            snprintf( strings[n], sizeof( strings[n] ), "%.*s", ( int )tokens[n].value.string.len,
+                      tokens[n].value.string.data );
+        }
+        if( tokens[n++].type == json_token_eof ) {
+            break;
+        }
+    }
+
+    tokenizer_release( &tokenizer );
+    stream_release( &s );
+    return n;
+}
+
+TEST( Batch ) {
+    const char *input = "{\"key\": [1234, -2.5e3, \"a string\", null, true, \"esc\\\"aped\", {}, \"\"],\n"
+                        " \"other\": false, \"copied\\n\": \"view\", \"last\": 0}";
+    json_token_t expected[64];
+    char strings[64][32];
+    int positions[64][2];
+    size_t num_expected = _read_tokens( input, 0, false, expected, strings, positions, ASIZE( expected ) );
+    ASSERT_EQ( json_token_eof, expected[num_expected - 1].type );
+
+    /* buffers that make tokens cross refills, and batches that end anywhere */
+    const size_t buffer_sizes[] = { 0, 16, 7, 3, 1 };
+    const size_t caps[] = { 1, 3, 64 };
+    for( size_t b = 0; b < ASIZE( buffer_sizes ); b++ ) {
+        for( size_t c = 0; c < ASIZE( caps ); c++ ) {
+            BUFFER( input );
+            stream_t s;
+            STREAM_INIT_BUFFER( &s, _stream_cstr_in_cb, &buffer, NULL, buffer_sizes[b] );
+            tokenizer_t tokenizer;
+            tokenizer_init( &tokenizer, &s );
+
+            size_t i = 0;
+            while( i < num_expected ) {
+                json_token_t batch[64];
+                size_t n = tokenizer_get_batch( &tokenizer, batch, caps[c] );
+                ASSERT_TRUE( n >= 1 && n <= caps[c] && i + n <= num_expected );
+
+                /* every string of the batch is still valid after reading the others */
+                for( size_t k = 0; k < n; k++, i++ ) {
+                    ASSERT_EQ( expected[i].type, batch[k].type );
+                    switch( batch[k].type ) {
+                        case json_token_string:
+                            ASSERT_TOKEN_STR( strings[i], batch[k] );
+                            /* only the last string of a batch can be in the scratch buffer */
+                            ASSERT_TRUE( !batch[k].value.string.copied || k == n - 1 );
+                            break;
+                        case json_token_integer:
+                            ASSERT_EQ( expected[i].value.integer, batch[k].value.integer );
+                            break;
+                        case json_token_fraction:
+                            ASSERT_TOKEN_FRACTION( expected[i].value.fraction, batch[k] );
+                            break;
+                        case json_token_boolean:
+                            ASSERT_TOKEN_BOOLEAN( expected[i].value.boolean, batch[k] );
+                            break;
+                        default:
+                            break;
+                    }
+
+                    int line, column;
+                    tokenizer_batch_position( &tokenizer, k, &line, &column );
+                    ASSERT_EQ( positions[i][0], line );
+                    ASSERT_EQ( positions[i][1], column );
+                }
+            }
+
+            tokenizer_release( &tokenizer );
+            stream_release( &s );
+        }
+    }
+}
+
+TEST( Index ) {
+    /* plain and escaped strings, literals and errors, at every position relative to the blocks of the index */
+    static const char *documents[] = {
+        "{\"key\": [1234, -2.5e3, \"a string\", null, true, \"esc\\\"aped\", {}, \"\\\\\", \"\"],\n"
+        " \"other\": false, \"caf\xc3\xa9\": \"\\u00e9\", \"last\": [[], {\"a\": \"b\"}]}",
+        "[\"a long string that goes on past the end of the first block of the index, and more\", \"x\"]",
+        "[\"before\", \"control \x01 character\", \"after\", \"and after\", \"and after\"]",
+        "[\"before\", \"invalid \xff byte\", \"after\", \"and after\", \"and after\", \"and after\"]",
+        "[\"before\", \"unterminated, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18]",
+    };
+    const size_t buffer_sizes[] = { 0, 100, 128 };
+    for( size_t d = 0; d < ASIZE( documents ); d++ ) {
+        for( size_t b = 0; b < ASIZE( buffer_sizes ); b++ ) {
+            for( int padding = 0; padding < 70; padding += 3 ) {
+                char input[512];
+                snprintf( input, sizeof( input ), "%*s%s", padding, "", documents[d] );
+
+                json_token_t expected[64], tokens[64];
+                static char expected_strings[64][32], strings[64][32];
+                int expected_positions[64][2], positions[64][2];
+                size_t num_expected = _read_tokens( input, buffer_sizes[b], false, expected, expected_strings,
+                                                    expected_positions, ASIZE( expected ) );
+                size_t num_tokens = _read_tokens( input, buffer_sizes[b], true, tokens, strings, positions,
+                                                  ASIZE( tokens ) );
+                ASSERT_EQ( num_expected, num_tokens );
+                for( size_t i = 0; i < num_tokens; i++ ) {
+                    ASSERT_EQ( expected[i].type, tokens[i].type );
+                    if( tokens[i].type == json_token_string ) {
+                        ASSERT_EQ( 0, strcmp( expected_strings[i], strings[i] ) );
+                    } else if( tokens[i].type == json_token_error ) {
+                        ASSERT_EQ( 0, strcmp( expected[i].value.error_msg, tokens[i].value.error_msg ) );
+                    }
+                    ASSERT_EQ( expected_positions[i][0], positions[i][0] );
+                    ASSERT_EQ( expected_positions[i][1], positions[i][1] );
+                }
+            }
+        }
+    }
+}
+
+TEST( LazyNumbers ) {
+    static const struct {
+        const char *raw;
+        uint8_t flags;
+    } numbers[] = {
+        { "0", 0 }, { "-0", JSON_NUMBER_NEGATIVE }, { "1234", 0 }, { "000042", 0 },
+        { "-2.5e3", JSON_NUMBER_NEGATIVE | JSON_NUMBER_FRACTION | JSON_NUMBER_EXPONENT },
+        { "1E+5", JSON_NUMBER_EXPONENT }, { "0.5", JSON_NUMBER_FRACTION }, { "1e-400", JSON_NUMBER_EXPONENT },
+        /* numbers the eager tokenizer rejects are kept as they are */
+        { "18446744073709551616", 0 }, { "-123456789012345678901234567890", JSON_NUMBER_NEGATIVE },
+        { "1e400", JSON_NUMBER_EXPONENT },
+    };
+    char input[512] = "[";
+    for( size_t i = 0; i < ASIZE( numbers ); i++ ) {
+        strcat( input, numbers[i].raw );
+        strcat( input, i + 1 < ASIZE( numbers ) ? ", " : "]" );
+    }
+
+    /* numbers that cross refills are copied, and end the batch like copied strings */
+    const size_t buffer_sizes[] = { 0, 16, 7, 3, 1 };
+    const size_t caps[] = { 1, 64 };
+    for( size_t b = 0; b < ASIZE( buffer_sizes ); b++ ) {
+        for( size_t c = 0; c < ASIZE( caps ); c++ ) {
+            BUFFER( input );
+            stream_t s;
+            STREAM_INIT_BUFFER( &s, _stream_cstr_in_cb, &buffer, NULL, buffer_sizes[b] );
+            tokenizer_t tokenizer;
+            tokenizer_init( &tokenizer, &s );
+            tokenizer.lazy_numbers = true;
+
+            size_t num_numbers = 0;
+            bool eof = false;
+            while( !eof ) {
+                json_token_t batch[64];
+                size_t n = tokenizer_get_batch( &tokenizer, batch, caps[c] );
+                for( size_t k = 0; k < n; k++ ) {
+                    ASSERT_NE( json_token_error, batch[k].type );
+                    eof = batch[k].type == json_token_eof;
+                    if( batch[k].type != json_token_number ) {
+                        continue;
+                    }
+                    ASSERT_TRUE( num_numbers < ASIZE( numbers ) );
+                    size_t len;
+                    const char *raw = json_number_raw( &batch[k].value.number, &len );
+                    ASSERT_EQ( strlen( numbers[num_numbers].raw ), len );
+                    ASSERT_EQ( 0, memcmp( numbers[num_numbers].raw, raw, len ) );
+                    ASSERT_EQ( numbers[num_numbers].flags, batch[k].value.number.flags );
+                    ASSERT_TRUE( !batch[k].value.number.copied || k == n - 1 );
+                    num_numbers += 1;
+                }
+            }
+            ASSERT_EQ( ASIZE( numbers ), num_numbers );
+
+            tokenizer_release( &tokenizer );
+            stream_release( &s );
+        }
+    }
+
+    /* the same numbers are invalid */
+    static const struct {
+        const char *input;
+        const char *error_msg;
+    } errors[] = {
+        { "-", "Unexpected end of file" }, { "-a", "Unexpected character" }, { "1e", "Unexpected end of file" },
+        { "1.e5 ", "Unexpected character" }, { "1e+-5 ", "Unexpected character" }, { "[1.5e-]", "Unexpected character" },
+    };
+    for( size_t i = 0; i < ASIZE( errors ); i++ ) {
+        BUFFER( errors[i].input );
+        stream_t s;
+        STREAM_INIT( &s, _stream_cstr_in_cb, &buffer );
+        tokenizer_t tokenizer;
+        tokenizer_init( &tokenizer, &s );
+        tokenizer.lazy_numbers = true;
+
+        json_token_t token = tokenizer_get_next( &tokenizer );
+        if( token.type == json_token_array_open ) {
+            token = tokenizer_get_next( &tokenizer );
+        }
+        ASSERT_TOKEN_ERROR( errors[i].error_msg, token );
+
+        tokenizer_release( &tokenizer );
+        stream_release( &s );
+    }
 }
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json_utf8.h"
+#include "scunit.h"
+
+
+#define ASIZE( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
+
+
+/** Kernels the CPU supports, \c NULL validates a byte at a time. */
+static json_utf8_scan_t _kernels[3];
+
+static size_t _get_kernels( void ) {
+    size_t num_kernels = 0;
+    _kernels[num_kernels++] = NULL;
+#ifdef __SSE2__
+    _kernels[num_kernels++] = json_utf8_scan_sse2;
+#endif
+#ifdef JSON_UTF8_AVX2
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        _kernels[num_kernels++] = json_utf8_scan_avx2;
+    }
+#endif
+    return num_kernels;
+}
+
+/** Validates \c data in one go, padded with ASCII on both sides so the kernels see whole blocks around it.
+ *
+ *  @return Offset of the first invalid byte in \c data, \c data_len if it is valid or -1 if it ends in the middle
+ *          of a sequence.
+ */
+static long _validate( json_utf8_scan_t scan, const char *data, size_t data_len, size_t padding ) {
+    char buffer[256];
+    memset( buffer, 'x', sizeof( buffer ) );
+    memcpy( &buffer[padding], data, data_len );
+
+    json_utf8_state_t state = { 0 };
+    size_t valid = json_utf8_validate_scan( scan, &state, ( const uint8_t * )buffer, padding + data_len );
+    if( valid == padding + data_len && state.needed > 0 ) {
+        return -1;
+    }
+    return ( long )valid - ( long )padding;
+}
+
+TEST( Sequences ) {
+    static const struct {
+        const char *data;
+        long expected;
+    } cases[] = {
+        { "plain ASCII", 11 },
+        { "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", 14 },
+        /* smallest and largest code point of each length */
+        { "\x01\x7f", 2 },
+        { "\xc2\x80\xdf\xbf", 4 },
+        { "\xe0\xa0\x80\xef\xbf\xbf", 6 },
+        { "\xf0\x90\x80\x80\xf4\x8f\xbf\xbf", 8 },
+        /* around the surrogates */
+        { "\xed\x9f\xbf\xee\x80\x80", 6 },
+        { "ab\xed\xa0\x80", 3 },
+        { "ab\xed\xbf\xbf", 3 },
+        /* overlong */
+        { "ab\xc0\xaf", 2 },
+        { "ab\xc1\xbf", 2 },
+        { "ab\xe0\x9f\xbf", 3 },
+        { "ab\xf0\x8f\xbf\xbf", 3 },
+        /* past U+10FFFF */
+        { "ab\xf4\x90\x80\x80", 3 },
+        { "ab\xf5\x80\x80\x80", 2 },
+        { "ab\xff", 2 },
+        /* continuations without a lead byte, or missing */
+        { "ab\x80", 2 },
+        { "\xc3\xa9\xa9", 2 },
+        { "ab\xc3" "a", 3 },
+        { "ab\xe2\x82" "a", 4 },
+        { "ab\xf0\x9f\x98\xf0\x9f\x98\x80", 5 },
+        /* incomplete at the end */
+        { "ab\xe2\x82", -1 },
+        { "ab\xf0", -1 },
+    };
+
+    size_t num_kernels = _get_kernels();
+    for( size_t k = 0; k < num_kernels; k++ ) {
+        for( size_t i = 0; i < ASIZE( cases ); i++ ) {
+            size_t len = strlen( cases[i].data );
+            /* every position relative to the blocks of the kernels */
+            for( size_t padding = 0; padding < 70; padding++ ) {
+                ASSERT_EQ( cases[i].expected, _validate( _kernels[k], cases[i].data, len, padding ) );
+            }
+        }
+    }
+}
+
+TEST( KernelsMatchScalar ) {
+    /* pieces of valid sequences and single bytes, so most inputs are valid for a while and some aren't */
+    static const char *pieces[] = {
+        "a", "0123456789abcdef", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xed\x9f\xbf", "\x80", "\xc3",
+        "\xe2\x82", "\xf4\x90", "\xed\xa0", "\xe0\x80",
+    };
+    size_t num_kernels = _get_kernels();
+    unsigned seed = 1;
+
+    for( int round = 0; round < 20000; round++ ) {
+        char data[200];
+        size_t len = 0;
+        for( ;; ) {
+            seed = seed * 1103515245 + 12345;
+            /* mostly the valid pieces */
+            size_t piece = ( seed >> 16 ) % 64;
+            const char *p = pieces[piece < 60 ? piece % 6 : 6 + piece % 6];
+            size_t piece_len = strlen( p );
+            if( len + piece_len > sizeof( data ) ) {
+                break;
+            }
+            memcpy( &data[len], p, piece_len );
+            len += piece_len;
+        }
+
+        long expected = _validate( NULL, data, len, 0 );
+        for( size_t k = 1; k < num_kernels; k++ ) {
+            ASSERT_EQ( expected, _validate( _kernels[k], data, len, 0 ) );
+        }
+
+        /* split anywhere, so the sequences continue in the next call */
+        size_t split = ( seed >> 8 ) % ( len + 1 );
+        json_utf8_state_t state = { 0 };
+        size_t valid = json_utf8_validate( &state, ( const uint8_t * )data, split );
+        if( valid == split ) {
+            valid = split + json_utf8_validate( &state, ( const uint8_t * )&data[split], len - split );
+        }
+        ASSERT_EQ( expected, valid == len && state.needed > 0 ? -1 : ( long )valid );
+    }
+}
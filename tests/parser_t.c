@@ -1,7 +1,9 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "parser.h"
 #include "scunit.h"
 #include "varray.h"
-#include <string.h>
 
 
 #define MIN( x, y ) ( ( x ) < ( y ) ? ( x ) : ( y ) )
@@ -36,6 +38,9 @@ struct buffer {
         _default_null_handler, \
         _default_boolean_handler )
 
+/** Options used by the assertions below (the defaults unless a test changes them). */
+static json_options_t _options;
+
 #define ASSERT_EVENT_SEQUENCE( obtained_varray, ... ) \
     do { \
         enum parser_event expected[] = { __VA_ARGS__ }; \
@@ -49,8 +54,9 @@ struct buffer {
         struct test_handler_ctx thc = { 0 }; \
         varray_init( thc.events, 10 ); \
         json_handler_t handler = DEFAULT_HANDLER( &thc ); \
+        handler.number = _default_number_handler; \
         BUFFER( json_cstr ); \
-        if( json_parse( &handler, _read_from_buffer, &buffer ) ) { \
+        if( json_parse_ex( &handler, _read_from_buffer, &buffer, &_options ) ) { \
             ASSERT_EVENT_SEQUENCE( thc.events, __VA_ARGS__ ); \
         } else { \
             printf( "[ PARSE ERROR ] %s at %d:%d\n", thc.error_msg, thc.error_line, thc.error_column ); \
@@ -65,8 +71,9 @@ struct buffer {
         struct test_handler_ctx thc = { 0 }; \
         varray_init( thc.events, 10 ); \
         json_handler_t handler = DEFAULT_HANDLER( &thc ); \
+        handler.number = _default_number_handler; \
         BUFFER( json_cstr ); \
-        ASSERT_FALSE( json_parse( &handler, _read_from_buffer, &buffer ) ); \
+        ASSERT_FALSE( json_parse_ex( &handler, _read_from_buffer, &buffer, &_options ) ); \
         if( strcmp( expected_error_msg, thc.error_msg ) != 0 ) { \
             printf( "[ WRONG ERROR ] %s at %d:%d\n", thc.error_msg, thc.error_line, thc.error_column ); \
             ASSERT_TRUE( false ); \
@@ -95,6 +102,7 @@ enum parser_event {
     event_array_end,
     event_integer,
     event_fraction,
+    event_number,
     event_string,
     event_boolean,
     event_null,
@@ -109,6 +117,8 @@ struct test_handler_ctx {
     int error_line;
     /** Expected error column (in case an error was found). */
     int error_column;
+    /** Characters of the last number passed to the number handler. */
+    char last_number[64];
 };
 
 static void _default_error_handler( void *ctx, const char *error_msg, int line, int column ) {
@@ -154,6 +164,14 @@ static bool _default_fraction_handler( void *ctx, fraction_t fraction ) {
     varray_push( thc->events, event_fraction );
     return true;
 }
+static bool _default_number_handler( void *ctx, const json_number_t *number ) {
+    struct test_handler_ctx *thc = ctx;
+    varray_push( thc->events, event_number );
+    size_t len;
+    const char *raw = json_number_raw( number, &len );
+    snprintf( thc->last_number, sizeof( thc->last_number ), "%.*s", ( int )len, raw );
+    return true;
+}
 static bool _default_string_handler( void *ctx, const char *string ) {
     struct test_handler_ctx *thc = ctx;
     varray_push( thc->events, event_string );
@@ -303,3 +321,172 @@ TEST( Error ) {
     ASSERT_PARSE_ERROR( "[123,]", "Unexpected token", 1, 7 );
     ASSERT_PARSE_ERROR( "[123,456,]", "Unexpected token", 1, 11 );
 }
+
+TEST( BufferSize ) {
+    /* tokens and lines split across refills of tiny buffers */
+    const size_t sizes[] = { 1, 2, 3, 7 };
+    for( size_t i = 0; i < ASIZE( sizes ); i++ ) {
+        _options.buffer_size = sizes[i];
+        ASSERT_PARSED_SEQUENCE( "{\"key\": [1234, 2.5, \"a string\", null]}",
+                                event_object_start,
+                                event_object_key,
+                                event_array_start,
+                                event_integer,
+                                event_fraction,
+                                event_string,
+                                event_null,
+                                event_array_end,
+                                event_object_end );
+        ASSERT_PARSE_ERROR( "{\n\n\n\"key\"  123}", "Unexpected token", 4, 12 );
+        ASSERT_PARSE_ERROR( "[123,456,]", "Unexpected token", 1, 11 );
+    }
+    _options.buffer_size = 0;
+}
+
+TEST( ParseReadAhead ) {
+    _options.buffer_size = 3;
+    _options.read_ahead = 2;
+    ASSERT_PARSED_SEQUENCE( "{\"key\": [1234, 2.5, \"a string\", null]}",
+                            event_object_start,
+                            event_object_key,
+                            event_array_start,
+                            event_integer,
+                            event_fraction,
+                            event_string,
+                            event_null,
+                            event_array_end,
+                            event_object_end );
+    ASSERT_PARSE_ERROR( "{\n\n\n\"key\"  123}", "Unexpected token", 4, 12 );
+    _options.buffer_size = 0;
+    _options.read_ahead = 0;
+}
+
+TEST( ValidateUtf8 ) {
+    /* invalid UTF-8 is only rejected if asked */
+    ASSERT_PARSED_SEQUENCE( "[\"ab\xff\"]", event_array_start, event_string, event_array_end );
+
+    /* sequences split across refills of tiny buffers too, the column is the one after the invalid byte */
+    const size_t sizes[] = { 0, 1, 2, 3, 7 };
+    _options.validate_utf8 = true;
+    for( size_t i = 0; i < ASIZE( sizes ); i++ ) {
+        _options.buffer_size = sizes[i];
+        ASSERT_PARSED_SEQUENCE( "{\"caf\xc3\xa9\": [\"\xe2\x82\xac 5\", \"\xf0\x9f\x98\x80\\n\xf0\x9f\x98\x80\"]}",
+                                event_object_start,
+                                event_object_key,
+                                event_array_start,
+                                event_string,
+                                event_string,
+                                event_array_end,
+                                event_object_end );
+        ASSERT_PARSE_ERROR( "[\"ab\xff and more\"]", "Invalid UTF-8", 1, 6 );
+        ASSERT_PARSE_ERROR( "[\"ab\",\n \"\xed\xa0\x80\"]", "Invalid UTF-8", 2, 5 );
+        ASSERT_PARSE_ERROR( "[\"ab\xc3\"]", "Invalid UTF-8", 1, 7 );
+        ASSERT_PARSE_ERROR( "[\"ab\xc3\\n\"]", "Invalid UTF-8", 1, 7 );
+        ASSERT_PARSE_ERROR( "[\"ab\\\xff\"]", "Invalid UTF-8", 1, 7 );
+        /* strings read from the structural index are validated too */
+        ASSERT_PARSE_ERROR( "[\"ab\xff\", \"a long enough string to fill the first block of the index\"]", "Invalid UTF-8",
+                            1, 6 );
+        /* the other errors of the tokenizer are reported as unexpected tokens like without validation */
+        ASSERT_PARSE_ERROR( "[\"ab\", 1.e5]", "Unexpected token", 1, 11 );
+    }
+    _options.buffer_size = 0;
+    _options.validate_utf8 = false;
+}
+
+TEST( ParseLazyNumbers ) {
+    /* every number goes to the number handler, even those too large to convert */
+    const size_t sizes[] = { 0, 1, 3, 7 };
+    _options.lazy_numbers = true;
+    for( size_t i = 0; i < ASIZE( sizes ); i++ ) {
+        _options.buffer_size = sizes[i];
+        ASSERT_PARSED_SEQUENCE( "{\"key\": [1234, -2.5e3, 123456789012345678901234567890, 1e400]}",
+                                event_object_start,
+                                event_object_key,
+                                event_array_start,
+                                event_number,
+                                event_number,
+                                event_number,
+                                event_number,
+                                event_array_end,
+                                event_object_end );
+        ASSERT_PARSE_ERROR( "[1,\n 1.e5]", "Unexpected token", 2, 5 );
+    }
+    _options.buffer_size = 0;
+
+    /* and is passed as it was written */
+    struct test_handler_ctx thc = { 0 };
+    varray_init( thc.events, 10 );
+    json_handler_t handler = DEFAULT_HANDLER( &thc );
+    handler.number = _default_number_handler;
+    BUFFER( "[1, -18446744073709551616.50]" );
+    ASSERT_TRUE( json_parse_ex( &handler, _read_from_buffer, &buffer, &_options ) );
+    ASSERT_EQ( 0, strcmp( "-18446744073709551616.50", thc.last_number ) );
+    varray_release( thc.events );
+
+    /* handlers without a number callback get converted numbers */
+    {
+        varray_init( thc.events, 10 );
+        json_handler_t handler = DEFAULT_HANDLER( &thc );
+        ASSERT_TRUE( handler.number == NULL );
+        BUFFER( "[1, 2.5]" );
+        ASSERT_TRUE( json_parse_ex( &handler, _read_from_buffer, &buffer, &_options ) );
+        ASSERT_EVENT_SEQUENCE( thc.events, event_array_start, event_integer, event_fraction, event_array_end );
+        varray_release( thc.events );
+    }
+    _options.lazy_numbers = false;
+
+    /* numbers that are not lazy have the same errors */
+    ASSERT_PARSE_ERROR( "[1,\n 1.e5]", "Unexpected token", 2, 5 );
+}
+
+TEST( File ) {
+    const char *path = "parser_t.json.tmp";
+    FILE *file = fopen( path, "w" );
+    ASSERT_TRUE( file != NULL );
+    fputs( "{\"key\": [1, \"two\"],\n\"other\": }", file );
+    fclose( file );
+
+    struct test_handler_ctx thc = { 0 };
+    varray_init( thc.events, 10 );
+    json_handler_t handler = DEFAULT_HANDLER( &thc );
+
+    /* parses from the mapping and reports positions like the streaming parser */
+    ASSERT_FALSE( json_parse_file( &handler, path, NULL ) );
+    remove( path );
+    ASSERT_EQ( 0, strcmp( "Unexpected token", thc.error_msg ) );
+    ASSERT_EQ( 2, thc.error_line );
+    ASSERT_EQ( 11, thc.error_column );
+    ASSERT_EVENT_SEQUENCE( thc.events,
+                           event_object_start,
+                           event_object_key,
+                           event_array_start,
+                           event_integer,
+                           event_string,
+                           event_array_end,
+                           event_object_key,
+                           event_error );
+
+    /* missing files are reported as errors */
+    ASSERT_FALSE( json_parse_file( &handler, "parser_t.missing.tmp", NULL ) );
+    ASSERT_EQ( 0, strcmp( "Can't read file", thc.error_msg ) );
+    varray_release( thc.events );
+
+    /* files that can't be mapped, like pipes, are read */
+    int fds[2];
+    ASSERT_EQ( 0, pipe( fds ) );
+    ASSERT_EQ( 9, write( fds[1], "[1, true]", 9 ) );
+    close( fds[1] );
+    char pipe_path[32];
+    snprintf( pipe_path, sizeof( pipe_path ), "/dev/fd/%d", fds[0] );
+    varray_init( thc.events, 10 );
+    ASSERT_TRUE( json_parse_file( &handler, pipe_path, NULL ) );
+    close( fds[0] );
+    ASSERT_EVENT_SEQUENCE( thc.events, event_array_start, event_integer, event_boolean, event_array_end );
+    varray_release( thc.events );
+
+    /* and files of /proc, which are regular files of size 0 */
+    varray_init( thc.events, 10 );
+    ASSERT_TRUE( json_parse_file( &handler, "/proc/sys/kernel/pid_max", NULL ) );
+    ASSERT_EVENT_SEQUENCE( thc.events, event_integer );
+    varray_release( thc.events );
+}
@@ -0,0 +1,633 @@
+#define _POSIX_C_SOURCE 200112L
+#include <string.h>
+#include <unistd.h>
+#ifdef JAYSON_ZLIB
+#include <zlib.h>
+#endif
+#ifdef JAYSON_ZSTD
+#include <zstd.h>
+#endif
+#include "scunit.h"
+#include "stream.h"
+
+
+#define MIN( x, y ) ( ( x ) < ( y ) ? ( x ) : ( y ) )
+#define ASIZE( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
+
+
+/** Input that is handed to the stream in chunks of at most \c chunk bytes. */
+struct chunked_buffer {
+    const char *data;
+    size_t data_len;
+    size_t chunk;
+    size_t pos;
+};
+
+static ssize_t _chunked_in_cb( struct chunked_buffer *b, void *data, size_t data_len ) {
+    size_t bytes_to_output = MIN( MIN( data_len, b->chunk ), b->data_len - b->pos );
+    memcpy( data, b->data + b->pos, bytes_to_output );
+    b->pos += bytes_to_output;
+    return bytes_to_output;
+}
+
+static ssize_t _failing_in_cb( void *ctx, void *data, size_t data_len ) {
+    return -1;
+}
+
+#define ASSERT_POSITION( expected_line, expected_column, s ) \
+    do { \
+        int line, column; \
+        stream_position( s, &line, &column ); \
+        ASSERT_EQ( expected_line, line ); \
+        ASSERT_EQ( expected_column, column ); \
+    } while( 0 )
+
+#define CHUNKED_STREAM( var_name, cstr, chunk_size ) \
+    struct chunked_buffer buffer = { .data = cstr, .data_len = strlen( cstr ), .chunk = chunk_size }; \
+    stream_t var_name; \
+    STREAM_INIT( &var_name, _chunked_in_cb, &buffer )
+
+
+TEST( GetAndPut ) {
+    CHUNKED_STREAM( s, "ab", 1 );
+    uint8_t c;
+
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( 'a', c );
+
+    /* only the last byte can be put back, and only once */
+    ASSERT_FALSE( stream_put( &s, 'x' ) );
+    ASSERT_TRUE( stream_put( &s, 'a' ) );
+    ASSERT_FALSE( stream_put( &s, 'a' ) );
+
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( 'a', c );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( 'b', c );
+    ASSERT_FALSE( stream_get( &s, &c ) );
+    ASSERT_TRUE( s.finished );
+    ASSERT_FALSE( s.error );
+    stream_release( &s );
+}
+
+TEST( Spans ) {
+    CHUNKED_STREAM( s, "0123456789", 4 );
+    const uint8_t *data;
+    size_t data_len;
+
+    /* spans never go past the data returned by a single read */
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 4, data_len );
+    ASSERT_EQ( 0, memcmp( data, "0123", 4 ) );
+
+    /* peeking doesn't consume */
+    stream_consume( &s, 3 );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 1, data_len );
+    ASSERT_EQ( '3', data[0] );
+    stream_consume( &s, 1 );
+
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 4, data_len );
+    ASSERT_EQ( 0, memcmp( data, "4567", 4 ) );
+    stream_consume( &s, 4 );
+
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 2, data_len );
+    stream_consume( &s, 2 );
+
+    ASSERT_FALSE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_TRUE( s.finished );
+    stream_release( &s );
+}
+
+TEST( LineAndColumn ) {
+    CHUNKED_STREAM( s, "ab\ncd\n\nefg", 3 );
+    const uint8_t *data;
+    size_t data_len;
+    uint8_t c;
+
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    stream_consume( &s, data_len );
+    ASSERT_POSITION( 1, 0, &s );
+
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( 'd', c );
+    ASSERT_POSITION( 1, 2, &s );
+
+    /* bytes put back are not counted twice */
+    ASSERT_TRUE( stream_put( &s, 'd' ) );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 'd', data[0] );
+    stream_consume( &s, data_len );
+    ASSERT_POSITION( 2, 0, &s );
+
+    while( stream_get( &s, &c ) );
+    ASSERT_POSITION( 3, 3, &s );
+    stream_release( &s );
+}
+
+TEST( LazyPosition ) {
+    char input[1000];
+    for( size_t i = 0; i < sizeof( input ) - 1; i++ ) {
+        input[i] = ( i * 7919 ) % 13 == 0 ? '\n' : 'x';
+    }
+    input[sizeof( input ) - 1] = '\0';
+    CHUNKED_STREAM( s, input, 37 );
+    const uint8_t *data;
+    size_t data_len;
+
+    /* positions match a byte by byte count after any mix of consumes, refills and compactions */
+    int line = 0, column = 0;
+    size_t consumed = 0;
+    for( size_t step = 1; stream_peek_span( &s, &data, &data_len ); step++ ) {
+        size_t n = step % data_len + 1;
+        for( size_t i = 0; i < n; i++ ) {
+            line += input[consumed + i] == '\n';
+            column = input[consumed + i] == '\n' ? 0 : column + 1;
+        }
+        stream_consume( &s, n );
+        consumed += n;
+        if( step % 3 == 0 ) {
+            ASSERT_POSITION( line, column, &s );
+            ASSERT_EQ( consumed, stream_offset( &s ) );
+        }
+        if( step % 5 == 0 ) {
+            stream_ensure( &s, 40 );
+        }
+    }
+    ASSERT_EQ( sizeof( input ) - 1, consumed );
+    ASSERT_POSITION( line, column, &s );
+    stream_release( &s );
+}
+
+TEST( InputError ) {
+    stream_t s;
+    STREAM_INIT( &s, _failing_in_cb, NULL );
+    uint8_t c;
+
+    ASSERT_FALSE( stream_get( &s, &c ) );
+    ASSERT_TRUE( s.error );
+    stream_release( &s );
+}
+
+TEST( Ensure ) {
+    CHUNKED_STREAM( s, "0123456789", 3 );
+    const uint8_t *data;
+    size_t data_len;
+    uint8_t c;
+
+    /* joins several reads into a contiguous span */
+    ASSERT_TRUE( stream_ensure( &s, 5 ) );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 6, data_len );
+    ASSERT_EQ( 0, memcmp( data, "012345", 6 ) );
+
+    /* the bytes left are moved to the start of the buffer keeping the last one consumed */
+    stream_consume( &s, 4 );
+    ASSERT_TRUE( stream_ensure( &s, 4 ) );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_TRUE( data == s.buffer + 1 );
+    ASSERT_EQ( 0, memcmp( data, "45678", 5 ) );
+    ASSERT_TRUE( stream_put( &s, '3' ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( '3', c );
+    ASSERT_POSITION( 0, 4, &s );
+    ASSERT_EQ( 4, stream_offset( &s ) );
+
+    /* fails at the end of the input leaving the remaining bytes readable */
+    ASSERT_FALSE( stream_ensure( &s, 10 ) );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 6, data_len );
+    stream_consume( &s, data_len );
+    ASSERT_FALSE( stream_ensure( &s, 1 ) );
+    ASSERT_POSITION( 0, 10, &s );
+    ASSERT_EQ( 10, stream_offset( &s ) );
+    stream_release( &s );
+}
+
+TEST( EnsureTooLarge ) {
+    struct chunked_buffer buffer = { .data = "0123456789", .data_len = 10, .chunk = 10 };
+    uint8_t storage[4];
+    stream_t s;
+    ASSERT_TRUE( STREAM_INIT_BUFFER( &s, _chunked_in_cb, &buffer, storage, sizeof( storage ) ) );
+    uint8_t c;
+
+    ASSERT_TRUE( stream_ensure( &s, 4 ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+
+    /* one byte of the buffer is kept for stream_put */
+    ASSERT_FALSE( stream_ensure( &s, 4 ) );
+    ASSERT_TRUE( stream_ensure( &s, 3 ) );
+    ASSERT_FALSE( s.finished );
+    stream_release( &s );
+}
+
+TEST( MarkAndRewind ) {
+    CHUNKED_STREAM( s, "true\nfalse\nnull", 3 );
+    const uint8_t *data;
+    size_t data_len;
+    uint8_t c;
+
+    /* rewinds within the same buffer without moving the data */
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    stream_mark( &s );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( 'u', c );
+    ASSERT_TRUE( stream_rewind( &s ) );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_TRUE( data == s.buffer + 1 );
+    ASSERT_EQ( 0, memcmp( data, "ru", 2 ) );
+
+    /* rewinds across several refills, the bytes read again are counted once */
+    for( int i = 0; i < 8; i++ ) {
+        ASSERT_TRUE( stream_get( &s, &c ) );
+    }
+    ASSERT_EQ( 's', c );
+    ASSERT_EQ( 9, stream_offset( &s ) );
+    ASSERT_POSITION( 1, 4, &s );
+    ASSERT_TRUE( stream_rewind( &s ) );
+    ASSERT_EQ( 1, stream_offset( &s ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( 'r', c );
+    ASSERT_POSITION( 1, 4, &s );
+
+    /* the stream can't put back bytes before the mark */
+    ASSERT_TRUE( stream_rewind( &s ) );
+    ASSERT_FALSE( stream_put( &s, 't' ) );
+
+    /* the data before the position can be dropped after releasing the mark */
+    stream_release_mark( &s );
+    ASSERT_FALSE( stream_rewind( &s ) );
+    char rest[16] = { 0 };
+    for( size_t i = 0; stream_get( &s, &c ); i++ ) {
+        rest[i] = c;
+    }
+    ASSERT_EQ( 0, strcmp( rest, "rue\nfalse\nnull" ) );
+    ASSERT_POSITION( 2, 4, &s );
+    stream_release( &s );
+}
+
+TEST( MarkWindow ) {
+    struct chunked_buffer buffer = { .data = "0123456789", .data_len = 10, .chunk = 3 };
+    uint8_t storage[4];
+    stream_t s;
+    ASSERT_TRUE( STREAM_INIT_BUFFER( &s, _chunked_in_cb, &buffer, storage, sizeof( storage ) ) );
+    uint8_t c;
+
+    /* the data after the mark is kept while it fits in the buffer */
+    stream_mark( &s );
+    for( int i = 0; i < 4; i++ ) {
+        ASSERT_TRUE( stream_get( &s, &c ) );
+    }
+    ASSERT_TRUE( stream_rewind( &s ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( '0', c );
+
+    /* the mark is dropped when it doesn't */
+    stream_mark( &s );
+    for( int i = 0; i < 5; i++ ) {
+        ASSERT_TRUE( stream_get( &s, &c ) );
+    }
+    ASSERT_EQ( '5', c );
+    ASSERT_FALSE( stream_rewind( &s ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( '6', c );
+    stream_release( &s );
+}
+
+TEST( CallerBuffer ) {
+    struct chunked_buffer buffer = { .data = "0123456789", .data_len = 10, .chunk = 10 };
+    uint8_t storage[4];
+    stream_t s;
+    ASSERT_TRUE( STREAM_INIT_BUFFER( &s, _chunked_in_cb, &buffer, storage, sizeof( storage ) ) );
+    const uint8_t *data;
+    size_t data_len;
+
+    /* reads never go past the caller buffer */
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_TRUE( data == storage );
+    ASSERT_EQ( 4, data_len );
+    stream_consume( &s, data_len );
+
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 0, memcmp( data, "4567", 4 ) );
+    stream_consume( &s, data_len );
+
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 2, data_len );
+    stream_consume( &s, data_len );
+    ASSERT_FALSE( stream_peek_span( &s, &data, &data_len ) );
+
+    /* the caller buffer is not freed */
+    stream_release( &s );
+}
+
+TEST( AlignedBuffer ) {
+    stream_t s;
+    ASSERT_TRUE( STREAM_INIT_BUFFER( &s, _failing_in_cb, NULL, NULL, 100 ) );
+    ASSERT_EQ( 100, s.buffer_size );
+    uintptr_t misalignment = ( uintptr_t )s.buffer & ( STREAM_BUFFER_ALIGNMENT - 1 );
+    ASSERT_EQ( 0, misalignment );
+    stream_release( &s );
+
+    /* 0 selects the default size */
+    ASSERT_TRUE( STREAM_INIT_BUFFER( &s, _failing_in_cb, NULL, NULL, 0 ) );
+    ASSERT_EQ( STREAM_DEFAULT_BUFFER_SIZE, s.buffer_size );
+    stream_release( &s );
+}
+
+TEST( ReadAhead ) {
+    struct chunked_buffer buffer = { .data = "ab\ncd\n\nefg", .data_len = 10, .chunk = 3 };
+    stream_t s;
+    ASSERT_TRUE( stream_init_readahead( &s, ( stream_read_cb_t )_chunked_in_cb, &buffer, 2, 2 ) );
+    uint8_t c;
+    char read[16] = { 0 };
+
+    /* the reads of the background thread are split in stream buffers */
+    for( size_t i = 0; stream_get( &s, &c ); i++ ) {
+        read[i] = c;
+    }
+    ASSERT_EQ( 0, strcmp( read, buffer.data ) );
+    ASSERT_TRUE( s.finished );
+    ASSERT_POSITION( 3, 3, &s );
+    stream_release( &s );
+
+    /* errors of the background reads are reported by the stream */
+    ASSERT_TRUE( stream_init_readahead( &s, _failing_in_cb, NULL, 0, 4 ) );
+    ASSERT_FALSE( stream_get( &s, &c ) );
+    ASSERT_TRUE( s.error );
+    stream_release( &s );
+}
+
+TEST( ReadAheadStop ) {
+    struct chunked_buffer buffer = { .data = "0123456789", .data_len = 10, .chunk = 1 };
+    stream_t s;
+    ASSERT_TRUE( stream_init_readahead( &s, ( stream_read_cb_t )_chunked_in_cb, &buffer, 1, 2 ) );
+    uint8_t c;
+
+    /* releasing before the end of the input stops the thread */
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( '0', c );
+    stream_release( &s );
+}
+
+/** Reads the whole stream checking it matches \c expected. */
+static bool _read_all( stream_t *s, const char *expected, size_t expected_len ) {
+    const uint8_t *data;
+    size_t data_len;
+    size_t total = 0;
+    while( stream_peek_span( s, &data, &data_len ) ) {
+        if( total + data_len > expected_len || memcmp( data, expected + total, data_len ) != 0 ) {
+            return false;
+        }
+        total += data_len;
+        stream_consume( s, data_len );
+    }
+    return total == expected_len && !s->error;
+}
+
+TEST( ReadAheadSwap ) {
+    struct chunked_buffer buffer = { .data = "0123456789abcdef", .data_len = 16, .chunk = 4 };
+    stream_t s;
+    ASSERT_TRUE( stream_init_readahead( &s, ( stream_read_cb_t )_chunked_in_cb, &buffer, 4, 2 ) );
+    const uint8_t *data;
+    size_t data_len;
+
+    /* the buffers filled in the background become the stream buffer, they are not copied to it */
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    const uint8_t *first = data;
+    ASSERT_EQ( 0, memcmp( data, "0123", 4 ) );
+    stream_consume( &s, data_len );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_TRUE( data != first );
+    ASSERT_TRUE( data == s.buffer );
+    ASSERT_EQ( 0, memcmp( data, "4567", 4 ) );
+
+    /* the data after a mark is kept, which copies the refills */
+    stream_consume( &s, 2 );
+    stream_mark( &s );
+    stream_consume( &s, 2 );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 0, memcmp( data, "89", 2 ) );
+    stream_consume( &s, data_len );
+    ASSERT_TRUE( stream_rewind( &s ) );
+    stream_release_mark( &s );
+    ASSERT_TRUE( _read_all( &s, "6789abcdef", 10 ) );
+    stream_release( &s );
+}
+
+TEST( FileDescriptor ) {
+    char expected[10000];
+    for( size_t i = 0; i < sizeof( expected ); i++ ) {
+        expected[i] = ( i % 16 == 15 ) ? '\n' : "0123456789abcdef"[i % 16];
+    }
+    const char *path = "stream_t.fd.tmp";
+    FILE *file = fopen( path, "wb" );
+    ASSERT_TRUE( file != NULL );
+    fwrite( expected, 1, sizeof( expected ), file );
+    fclose( file );
+
+    /* the data is the same with any number of reads in flight, with io_uring or read */
+    const size_t depths[] = { 0, 1, 4, 32 };
+    for( size_t i = 0; i < ASIZE( depths ); i++ ) {
+        file = fopen( path, "rb" );
+        ASSERT_TRUE( file != NULL );
+        stream_t s;
+        ASSERT_TRUE( stream_init_fd( &s, fileno( file ), 1000, depths[i] ) );
+        if( depths[i] == 0 ) {
+            ASSERT_FALSE( stream_uses_uring( &s ) );
+        }
+        ASSERT_TRUE( _read_all( &s, expected, sizeof( expected ) ) );
+        ASSERT_POSITION( sizeof( expected ) / 16, 0, &s );
+        stream_release( &s );
+        fclose( file );
+    }
+
+    /* releasing with reads in flight */
+    file = fopen( path, "rb" );
+    ASSERT_TRUE( file != NULL );
+    stream_t s;
+    uint8_t c;
+    ASSERT_TRUE( stream_init_fd( &s, fileno( file ), 100, 8 ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    stream_release( &s );
+    fclose( file );
+    remove( path );
+}
+
+TEST( FileDescriptorSwap ) {
+    const char *path = "stream_t.swap.tmp";
+    FILE *file = fopen( path, "wb" );
+    ASSERT_TRUE( file != NULL );
+    fputs( "0123456789abcdef", file );
+    fclose( file );
+
+    file = fopen( path, "rb" );
+    ASSERT_TRUE( file != NULL );
+    remove( path );
+    stream_t s;
+    ASSERT_TRUE( stream_init_fd( &s, fileno( file ), 4, 2 ) );
+    if( !stream_uses_uring( &s ) ) {
+        /* nothing is swapped with read */
+        stream_release( &s );
+        fclose( file );
+        return;
+    }
+    const uint8_t *data;
+    size_t data_len;
+
+    /* the registered buffers of the completed reads become the stream buffer, they are not copied to it */
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    const uint8_t *first = data;
+    ASSERT_EQ( 0, memcmp( data, "0123", 4 ) );
+    stream_consume( &s, data_len );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_TRUE( data != first );
+    ASSERT_TRUE( data == s.buffer );
+    ASSERT_EQ( 0, memcmp( data, "4567", 4 ) );
+
+    /* the data after a mark is kept, which copies the refills */
+    stream_consume( &s, 2 );
+    stream_mark( &s );
+    stream_consume( &s, 2 );
+    ASSERT_TRUE( stream_peek_span( &s, &data, &data_len ) );
+    ASSERT_EQ( 0, memcmp( data, "89", 2 ) );
+    stream_consume( &s, data_len );
+    ASSERT_TRUE( stream_rewind( &s ) );
+    stream_release_mark( &s );
+    ASSERT_TRUE( _read_all( &s, "6789abcdef", 10 ) );
+    stream_release( &s );
+    fclose( file );
+}
+
+TEST( Pipe ) {
+    int fds[2];
+    ASSERT_EQ( 0, pipe( fds ) );
+    const char *input = "[1, 2, 3]\n";
+    ASSERT_EQ( 1, write( fds[1], input, 1 ) );
+
+    stream_t s;
+    uint8_t c;
+    ASSERT_TRUE( stream_init_fd( &s, fds[0], 0, 4 ) );
+    ASSERT_TRUE( stream_get( &s, &c ) );
+    ASSERT_EQ( '[', c );
+
+    /* the read of the next buffer waits for the writer, it's cancelled on release */
+    stream_release( &s );
+
+    ASSERT_TRUE( stream_init_fd( &s, fds[0], 4, 4 ) );
+    ASSERT_EQ( ( ssize_t )strlen( input ) - 1, write( fds[1], input + 1, strlen( input ) - 1 ) );
+    close( fds[1] );
+    ASSERT_TRUE( _read_all( &s, input + 1, strlen( input ) - 1 ) );
+    stream_release( &s );
+    close( fds[0] );
+}
+
+TEST( DecompressPlain ) {
+    /* input that is not compressed is passed through, even if it's shorter than the magic bytes */
+    const char *inputs[] = { "[1, 2, 3]\n", "[]", "" };
+    for( size_t i = 0; i < ASIZE( inputs ); i++ ) {
+        CHUNKED_STREAM( raw, inputs[i], 1 );
+        stream_t s;
+        ASSERT_TRUE( stream_init_decompress( &s, ( stream_read_cb_t )stream_read, &raw, 4 ) );
+        ASSERT_TRUE( _read_all( &s, inputs[i], strlen( inputs[i] ) ) );
+        ASSERT_EQ( stream_compression_none, stream_decoder_format( s.in_cb_ctx ) );
+        stream_release( &s );
+    }
+
+    ASSERT_EQ( stream_compression_gzip, stream_detect_compression( ( const uint8_t * )"\x1f\x8b\x08", 3 ) );
+    ASSERT_EQ( stream_compression_zstd, stream_detect_compression( ( const uint8_t * )"\x28\xb5\x2f\xfd", 4 ) );
+    ASSERT_EQ( stream_compression_none, stream_detect_compression( ( const uint8_t * )"\x28\xb5", 2 ) );
+}
+
+#ifdef JAYSON_ZLIB
+/** Compresses \c data as a gzip member at \c out, returns its size. */
+static size_t _gzip( const char *data, size_t data_len, uint8_t *out, size_t out_len ) {
+    z_stream z = { 0 };
+    deflateInit2( &z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY );
+    z.next_in = ( uint8_t * )data;
+    z.avail_in = data_len;
+    z.next_out = out;
+    z.avail_out = out_len;
+    deflate( &z, Z_FINISH );
+    deflateEnd( &z );
+    return out_len - z.avail_out;
+}
+
+TEST( DecompressGzip ) {
+    char expected[20000];
+    for( size_t i = 0; i < sizeof( expected ); i++ ) {
+        expected[i] = ( i % 16 == 15 ) ? '\n' : "0123456789abcdef"[( i * 7 ) % 16];
+    }
+
+    /* two members, as written by concatenating gzip files */
+    uint8_t compressed[2 * sizeof( expected )];
+    size_t half = sizeof( expected ) / 2;
+    size_t compressed_len = _gzip( expected, half, compressed, sizeof( compressed ) );
+    compressed_len += _gzip( expected + half, sizeof( expected ) - half, compressed + compressed_len,
+                             sizeof( compressed ) - compressed_len );
+
+    /* the output is the same whatever the size of the compressed reads and of the stream buffer */
+    const size_t chunks[] = { 1, 7, 4096 };
+    for( size_t i = 0; i < ASIZE( chunks ); i++ ) {
+        struct chunked_buffer raw = { .data = ( char * )compressed, .data_len = compressed_len, .chunk = chunks[i] };
+        stream_t s;
+        ASSERT_TRUE( stream_init_decompress( &s, ( stream_read_cb_t )_chunked_in_cb, &raw, 1000 ) );
+        ASSERT_TRUE( _read_all( &s, expected, sizeof( expected ) ) );
+        ASSERT_EQ( stream_compression_gzip, stream_decoder_format( s.in_cb_ctx ) );
+        ASSERT_POSITION( sizeof( expected ) / 16, 0, &s );
+        stream_release( &s );
+    }
+
+    /* truncated input is an error */
+    struct chunked_buffer raw = { .data = ( char * )compressed, .data_len = compressed_len - 10, .chunk = 100 };
+    stream_t s;
+    ASSERT_TRUE( stream_init_decompress( &s, ( stream_read_cb_t )_chunked_in_cb, &raw, 1000 ) );
+    ASSERT_FALSE( _read_all( &s, expected, sizeof( expected ) ) );
+    ASSERT_TRUE( s.error );
+    stream_release( &s );
+}
+#endif
+
+#ifdef JAYSON_ZSTD
+TEST( DecompressZstd ) {
+    ASSERT_TRUE( stream_decompression_supported( stream_compression_zstd ) );
+    static char expected[300000];
+    for( size_t i = 0; i < sizeof( expected ); i++ ) {
+        expected[i] = ( i % 16 == 15 ) ? '\n' : "0123456789abcdef"[( i * i / 7 ) % 16];
+    }
+
+    /* a frame of several blocks without a checksum, so the decoder consumes all the input before its output is
+     * flushed */
+    static uint8_t compressed[sizeof( expected )];
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ASSERT_TRUE( cctx != NULL );
+    ZSTD_CCtx_setParameter( cctx, ZSTD_c_checksumFlag, 0 );
+    size_t compressed_len = ZSTD_compress2( cctx, compressed, sizeof( compressed ), expected, sizeof( expected ) );
+    ZSTD_freeCCtx( cctx );
+    ASSERT_FALSE( ZSTD_isError( compressed_len ) );
+
+    /* the output is the same whatever the size of the compressed reads and of the stream buffer */
+    const size_t chunks[] = { 1, 7, 4096, sizeof( compressed ) };
+    for( size_t i = 0; i < ASIZE( chunks ); i++ ) {
+        struct chunked_buffer raw = { .data = ( char * )compressed, .data_len = compressed_len, .chunk = chunks[i] };
+        stream_t s;
+        ASSERT_TRUE( stream_init_decompress( &s, ( stream_read_cb_t )_chunked_in_cb, &raw, 1000 ) );
+        ASSERT_TRUE( _read_all( &s, expected, sizeof( expected ) ) );
+        ASSERT_EQ( stream_compression_zstd, stream_decoder_format( s.in_cb_ctx ) );
+        ASSERT_POSITION( sizeof( expected ) / 16, 0, &s );
+        stream_release( &s );
+    }
+
+    /* truncated input is an error */
+    struct chunked_buffer raw = { .data = ( char * )compressed, .data_len = compressed_len - 10, .chunk = 100 };
+    stream_t s;
+    ASSERT_TRUE( stream_init_decompress( &s, ( stream_read_cb_t )_chunked_in_cb, &raw, 1000 ) );
+    ASSERT_FALSE( _read_all( &s, expected, sizeof( expected ) ) );
+    ASSERT_TRUE( s.error );
+    stream_release( &s );
+}
+#endif
@@ -69,3 +69,23 @@ TEST( struct ) {
 
     varray_release( a );
 }
+
+TEST( extend ) {
+    char *a;
+    varray_init( a, 2 );
+
+    varray_extend( a, "abc", 3 );
+    ASSERT_EQ( 3, varray_len( a ) );
+    ASSERT_EQ( 4, varray_cap( a ) );
+
+    /* grows as much as needed in a single step */
+    varray_extend( a, "0123456789", 10 );
+    ASSERT_EQ( 13, varray_len( a ) );
+    ASSERT_EQ( 16, varray_cap( a ) );
+    ASSERT_EQ( 0, memcmp( a, "abc0123456789", 13 ) );
+
+    varray_push( a, 'x' );
+    ASSERT_EQ( 'x', varray_last( a ) );
+
+    varray_release( a );
+}
@@ -0,0 +1,234 @@
+/**
+ * Generates a direct threaded version of the tokenizer FSM.
+ *
+ * Includes the tokenizer state table with its own \c STATE, \c STATE_FAST_PATH and \c TRANSITION macros, which keep the names of the
+ * states and actions, and prints a C function with a \c switch per state that calls every action directly. The
+ * output is meant to be included by json_tokenizer.c (see \c JAYSON_GENERATED_TOKENIZER), where the compiler can
+ * inline the actions into the loop.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+
+#define ASIZE( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
+
+/** Transition value that matches any input. */
+#define ANY NULL
+
+/** Transition with the names of its next state and action. */
+struct gen_transition {
+    /** Name of the next state. */
+    const char *next_state;
+    /** Values that trigger the transition (or \c ANY). */
+    const char *values;
+    /** Number of values in \c values. */
+    size_t values_len;
+    /** Name of the action (or "NULL"). */
+    const char *action;
+    /** Name of the action for runs of values (or \c NULL). */
+    const char *span_action;
+};
+
+/** State with the names of its transitions. */
+struct gen_state {
+    /** State name. */
+    const char *name;
+    /** End of file transition. */
+    struct gen_transition transition_eof;
+    /** Input transitions. */
+    const struct gen_transition *transitions;
+    /** Number of transitions in \c transitions. */
+    size_t num_transitions;
+    /** Name of the fast path (or \c NULL). */
+    const char *fast_path;
+    /** Name of the state after the fast path handles some input. */
+    const char *fast_path_state;
+};
+
+#define STATE( _name, _transition_eof, ... ) \
+    { \
+        .name = "state_id_" #_name, \
+        .transition_eof = _transition_eof, \
+        .transitions = ( const struct gen_transition[] ){ __VA_ARGS__ }, \
+        .num_transitions = ASIZE( ( ( const struct gen_transition[] ){ __VA_ARGS__ } ) ), \
+    }
+
+#define STATE_FAST_PATH( _name, _fast_path, _fast_path_state, _transition_eof, ... ) \
+    { \
+        .name = "state_id_" #_name, \
+        .transition_eof = _transition_eof, \
+        .transitions = ( const struct gen_transition[] ){ __VA_ARGS__ }, \
+        .num_transitions = ASIZE( ( ( const struct gen_transition[] ){ __VA_ARGS__ } ) ), \
+        .fast_path = #_fast_path, \
+        .fast_path_state = "state_id_" #_fast_path_state, \
+    }
+
+#define TRANSITION( _next_state, _values, _action ) \
+    { \
+        .next_state = "state_id_" #_next_state, \
+        .values = _values, \
+        .values_len = sizeof( _values ) - 1, \
+        .action = #_action, \
+    }
+
+/* the generated code calls the span action with a run of one value, so the action sees where it is in the buffer */
+#define TRANSITION_SPAN( _next_state, _values, _action, _span_action ) \
+    { \
+        .next_state = "state_id_" #_next_state, \
+        .values = _values, \
+        .values_len = sizeof( _values ) - 1, \
+        .action = #_action, \
+        .span_action = #_span_action, \
+    }
+
+#define TRANSITION_EOF( _next_state, _action ) \
+    { \
+        .next_state = "state_id_" #_next_state, \
+        .action = #_action, \
+    }
+
+static const struct gen_state _states[] = {
+#include "json_tokenizer_states.h"
+};
+
+
+/** Checks if taking a transition to \c state ends the FSM run. */
+static bool _is_final( const char *state ) {
+    return strcmp( state, "state_id_end" ) == 0 || strcmp( state, "state_id_error" ) == 0;
+}
+
+/** Prints the code that returns \c state, consuming the bytes of the span that were handled unless it's the end of
+ *  the input. */
+static void _print_return( const char *state, const char *indent, bool eof ) {
+    if( !eof ) {
+        printf( "%sstream_consume( stream, p - data );\n", indent );
+    }
+    printf( "%sreturn %s;\n", indent, state );
+}
+
+/** Prints the code that takes a transition, \c indent is the indentation of the generated lines. */
+static void _print_transition( const struct gen_state *state, const struct gen_transition *t, const char *indent, bool eof ) {
+    char inner[64];
+    snprintf( inner, sizeof( inner ), "%s    ", indent );
+    if( t->span_action != NULL && !eof ) {
+        printf( "%sif( !%s( ctx, p - 1, 1 ) ) {\n", indent, t->span_action );
+        _print_return( "FSM_ERROR_TRANSITION", inner, eof );
+        printf( "%s}\n", indent );
+    } else if( strcmp( t->action, "NULL" ) != 0 ) {
+        printf( "%sif( !%s( ctx%s ) ) {\n", indent, t->action, eof ? "" : ", c" );
+        _print_return( "FSM_ERROR_TRANSITION", inner, eof );
+        printf( "%s}\n", indent );
+    }
+
+    if( eof || _is_final( t->next_state ) ) {
+        _print_return( t->next_state, indent, eof );
+    } else if( strcmp( t->next_state, state->name ) == 0 ) {
+        printf( "%scontinue;\n", indent );
+    } else {
+        printf( "%sstate = %s;\n", indent, t->next_state );
+        printf( "%scontinue;\n", indent );
+    }
+}
+
+/** Prints the \c case labels of the bytes in \c t that were not taken by a previous transition. */
+static bool _print_cases( const struct gen_transition *t, bool *taken ) {
+    bool any = false;
+    for( size_t i = 0; i < t->values_len; i++ ) {
+        unsigned char c = t->values[i];
+        if( !taken[c] ) {
+            taken[c] = true;
+            printf( "                        case 0x%02x:\n", c );
+            any = true;
+        }
+    }
+    return any;
+}
+
+static void _print_state( const struct gen_state *state ) {
+    bool taken[256] = { false };
+    const struct gen_transition *any = NULL;
+
+    printf( "                case %s:\n", state->name );
+    if( state->fast_path != NULL ) {
+        /* the byte of the state was already read */
+        printf( "                    if( ( handled = %s( ctx, p - 1, data + data_len - ( p - 1 ) ) ) > 0 ) {\n",
+                state->fast_path );
+        printf( "                        p += handled - 1;\n" );
+        if( _is_final( state->fast_path_state ) ) {
+            _print_return( state->fast_path_state, "                        ", false );
+        } else {
+            printf( "                        state = %s;\n", state->fast_path_state );
+            printf( "                        continue;\n" );
+        }
+        printf( "                    }\n" );
+    }
+    printf( "                    switch( c ) {\n" );
+    for( size_t i = 0; i < state->num_transitions && any == NULL; i++ ) {
+        const struct gen_transition *t = &state->transitions[i];
+        if( t->values == ANY ) {
+            any = t;
+        } else if( _print_cases( t, taken ) ) {
+            _print_transition( state, t, "                            ", false );
+        }
+    }
+    printf( "                        default:\n" );
+    if( any != NULL ) {
+        _print_transition( state, any, "                            ", false );
+    } else {
+        _print_return( "FSM_ERROR_NO_MATCH", "                            ", false );
+    }
+    printf( "                    }\n" );
+}
+
+int main( int argc, const char *argv[] ) {
+    printf( "/* Generated by tool/fsmgen.c from json_tokenizer_states.h, do not edit. */\n\n" );
+    printf( "static state_id_t _fsm_run_generated( stream_t *stream, struct fsm_ctx *ctx, bool refill ) {\n" );
+    printf( "    const uint8_t *data;\n" );
+    printf( "    size_t data_len;\n" );
+    for( size_t i = 0; i < ASIZE( _states ); i++ ) {
+        if( _states[i].fast_path != NULL ) {
+            printf( "    size_t handled;\n" );
+            break;
+        }
+    }
+    printf( "    state_id_t state = FSM_INITIAL_STATE;\n\n" );
+    /* like fsm_run_buffered if it can't read more input */
+    printf( "    if( !refill && stream->bytes_left == 0 ) {\n" );
+    printf( "        return FSM_BUFFER_END;\n" );
+    printf( "    }\n" );
+    printf( "    while( stream_peek_span( stream, &data, &data_len ) ) {\n" );
+    printf( "        const uint8_t *p = data;\n" );
+    printf( "        while( p < data + data_len ) {\n" );
+    printf( "            uint8_t c = *p++;\n" );
+    printf( "            switch( state ) {\n" );
+    for( size_t i = 0; i < ASIZE( _states ); i++ ) {
+        _print_state( &_states[i] );
+    }
+    printf( "                default:\n" );
+    _print_return( "FSM_ERROR_STATE", "                    ", false );
+    printf( "            }\n" );
+    printf( "        }\n" );
+    printf( "        if( !refill ) {\n" );
+    printf( "            return FSM_BUFFER_END;\n" );
+    printf( "        }\n" );
+    printf( "        stream_consume( stream, data_len );\n" );
+    printf( "    }\n\n" );
+
+    printf( "    if( stream->error ) {\n" );
+    printf( "        return FSM_ERROR_STREAM;\n" );
+    printf( "    }\n\n" );
+
+    printf( "    /* executes the end of file transition */\n" );
+    printf( "    switch( state ) {\n" );
+    for( size_t i = 0; i < ASIZE( _states ); i++ ) {
+        printf( "        case %s:\n", _states[i].name );
+        _print_transition( &_states[i], &_states[i].transition_eof, "            ", true );
+    }
+    printf( "        default:\n" );
+    printf( "            return FSM_ERROR_STATE;\n" );
+    printf( "    }\n" );
+    printf( "}\n" );
+    return 0;
+}
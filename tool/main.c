@@ -2,8 +2,13 @@
  * Entrypoint for the command line tool.
  */
 
-#include "parser.h"
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "parser.h"
 
 
 struct handler_ctx {
@@ -67,6 +72,13 @@ static bool _print_fraction_handler( void *ctx, fraction_t fraction ) {
     printf( "%f\n", fraction );
     return true;
 }
+static bool _print_number_handler( void *ctx, const json_number_t *number ) {
+    _print_indentation( ctx );
+    size_t len;
+    const char *raw = json_number_raw( number, &len );
+    printf( "%.*s\n", ( int )len, raw );
+    return true;
+}
 static bool _print_string_handler( void *ctx, const char *string ) {
     _print_indentation( ctx );
     printf( "\"%s\"\n", string );
@@ -104,6 +116,9 @@ static bool _dummy_integer_handler( void *ctx, integer_t integer ) {
 static bool _dummy_fraction_handler( void *ctx, fraction_t fraction ) {
     return true;
 }
+static bool _dummy_number_handler( void *ctx, const json_number_t *number ) {
+    return true;
+}
 static bool _dummy_string_handler( void *ctx, const char *string ) {
     return true;
 }
@@ -118,49 +133,143 @@ static bool _dummy_boolean_handler( void *ctx, bool boolean ) {
  * Constructs and returns the JSON handler that prints through STDOUT.
  */
 static json_handler_t _get_print_handler( struct handler_ctx *ctx ) {
-    return ( json_handler_t ) HANDLER_INIT( ctx,
-                                            _print_error_handler,
-                                            _print_object_start_handler,
-                                            _print_object_key_handler,
-                                            _print_object_end_handler,
-                                            _print_array_start_handler,
-                                            _print_array_end_handler,
-                                            _print_integer_handler,
-                                            _print_fraction_handler,
-                                            _print_string_handler,
-                                            _print_null_handler,
-                                            _print_boolean_handler );
+    json_handler_t handler = HANDLER_INIT( ctx,
+                                           _print_error_handler,
+                                           _print_object_start_handler,
+                                           _print_object_key_handler,
+                                           _print_object_end_handler,
+                                           _print_array_start_handler,
+                                           _print_array_end_handler,
+                                           _print_integer_handler,
+                                           _print_fraction_handler,
+                                           _print_string_handler,
+                                           _print_null_handler,
+                                           _print_boolean_handler );
+    handler.number = _print_number_handler;
+    return handler;
 }
 
 /**
  * Constructs and returns the JSON handler that doesn't do nothing.
  */
 static json_handler_t _get_dummy_handler( struct handler_ctx *ctx ) {
-    return ( json_handler_t ) HANDLER_INIT( ctx,
-                                            _print_error_handler,
-                                            _dummy_object_start_handler,
-                                            _dummy_object_key_handler,
-                                            _dummy_object_end_handler,
-                                            _dummy_array_start_handler,
-                                            _dummy_array_end_handler,
-                                            _dummy_integer_handler,
-                                            _dummy_fraction_handler,
-                                            _dummy_string_handler,
-                                            _dummy_null_handler,
-                                            _dummy_boolean_handler );
+    json_handler_t handler = HANDLER_INIT( ctx,
+                                           _print_error_handler,
+                                           _dummy_object_start_handler,
+                                           _dummy_object_key_handler,
+                                           _dummy_object_end_handler,
+                                           _dummy_array_start_handler,
+                                           _dummy_array_end_handler,
+                                           _dummy_integer_handler,
+                                           _dummy_fraction_handler,
+                                           _dummy_string_handler,
+                                           _dummy_null_handler,
+                                           _dummy_boolean_handler );
+    handler.number = _dummy_number_handler;
+    return handler;
 } 
 
 
-static ssize_t _read_stdin( void *ctx, void *data, size_t data_len ) {
-    return fread( data, 1, data_len, stdin );
+static ssize_t _read_file( void *ctx, void *data, size_t data_len ) {
+    return fread( data, 1, data_len, ctx );
+}
+
+
+static void _print_usage( const char *program ) {
+    fprintf( stderr, "Usage: %s [-p|--profile] [-b|--buffer-size SIZE] [-r|--read-ahead N] [-u|--io-depth N] [-H|--huge-pages] [-z|--decompress] [-U|--validate-utf8] [-n|--lazy-numbers] [FILE]\n", program );
+    fprintf( stderr, "Parses JSON from FILE (memory mapped unless -b or -r is given) or from STDIN.\n\n" );
+    fprintf( stderr, "  -p, --profile           prints the FSM profiling counters after parsing\n" );
+    fprintf( stderr, "  -b, --buffer-size SIZE  size of the input buffer in bytes (K and M suffixes allowed)\n" );
+    fprintf( stderr, "  -r, --read-ahead N      reads up to N buffers ahead of the parser in another thread\n" );
+    fprintf( stderr, "  -u, --io-depth N        reads FILE or STDIN with up to N reads in flight with io_uring\n" );
+    fprintf( stderr, "  -H, --huge-pages        maps FILE with huge pages where possible\n" );
+    fprintf( stderr, "  -z, --decompress        decompresses gzip or zstd input, detected by its first bytes\n" );
+    fprintf( stderr, "  -U, --validate-utf8     rejects strings that are not valid UTF-8\n" );
+    fprintf( stderr, "  -n, --lazy-numbers      passes numbers to the handler without converting them\n" );
+}
+
+/** Parses a size like "4096", "64K" or "1M", returns 0 if it's not valid. */
+static size_t _parse_size( const char *str ) {
+    char *end;
+    unsigned long long size = strtoull( str, &end, 10 );
+    if( *end == 'K' || *end == 'k' ) {
+        size <<= 10;
+        end++;
+    } else if( *end == 'M' || *end == 'm' ) {
+        size <<= 20;
+        end++;
+    }
+    return ( end == str || *end != '\0' ) ? 0 : size;
 }
 
 
 int main( int argc, const char *argv[] ) {
+    bool profile = false;
+    json_options_t options = { 0 };
+    const char *path = NULL;
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp( argv[i], "-p" ) == 0 || strcmp( argv[i], "--profile" ) == 0 ) {
+            profile = true;
+        } else if( ( strcmp( argv[i], "-b" ) == 0 || strcmp( argv[i], "--buffer-size" ) == 0 ) && i + 1 < argc &&
+                   ( options.buffer_size = _parse_size( argv[i + 1] ) ) != 0 ) {
+            i++;
+        } else if( ( strcmp( argv[i], "-r" ) == 0 || strcmp( argv[i], "--read-ahead" ) == 0 ) && i + 1 < argc &&
+                   ( options.read_ahead = _parse_size( argv[i + 1] ) ) != 0 ) {
+            i++;
+        } else if( ( strcmp( argv[i], "-u" ) == 0 || strcmp( argv[i], "--io-depth" ) == 0 ) && i + 1 < argc &&
+                   ( options.io_depth = _parse_size( argv[i + 1] ) ) != 0 ) {
+            i++;
+        } else if( strcmp( argv[i], "-H" ) == 0 || strcmp( argv[i], "--huge-pages" ) == 0 ) {
+            options.mmap_flags |= STREAM_MMAP_HUGE_PAGES;
+        } else if( strcmp( argv[i], "-z" ) == 0 || strcmp( argv[i], "--decompress" ) == 0 ) {
+            options.decompress = true;
+        } else if( strcmp( argv[i], "-U" ) == 0 || strcmp( argv[i], "--validate-utf8" ) == 0 ) {
+            options.validate_utf8 = true;
+        } else if( strcmp( argv[i], "-n" ) == 0 || strcmp( argv[i], "--lazy-numbers" ) == 0 ) {
+            options.lazy_numbers = true;
+        } else if( argv[i][0] != '-' && path == NULL ) {
+            path = argv[i];
+        } else {
+            _print_usage( argv[0] );
+            return 2;
+        }
+    }
+
     struct handler_ctx ctx = {
         .nesting_level = 0,
     };
     json_handler_t handler = _get_dummy_handler( &ctx );
 
-    return( json_parse( &handler, _read_stdin, stdin ) == true );
+    bool success;
+    if( options.io_depth > 0 ) {
+        int fd = path != NULL ? open( path, O_RDONLY ) : STDIN_FILENO;
+        if( fd < 0 ) {
+            perror( path );
+            return 2;
+        }
+        success = json_parse_fd( &handler, fd, &options );
+        close( fd );
+    } else if( path != NULL && options.buffer_size == 0 && options.read_ahead == 0 ) {
+        success = json_parse_file( &handler, path, &options );
+    } else {
+        /* the mapping is the buffer, so files are read through one when its size or read-ahead are asked for */
+        FILE *file = path != NULL ? fopen( path, "rb" ) : stdin;
+        if( file == NULL ) {
+            perror( path );
+            return 2;
+        }
+        success = json_parse_ex( &handler, _read_file, file, &options );
+        if( file != stdin ) {
+            fclose( file );
+        }
+    }
+
+    if( profile ) {
+#ifdef JAYSON_FSM_PROFILE
+        json_profile_dump( stderr );
+#else
+        fprintf( stderr, "Profiling is not available, build with PROFILE=1.\n" );
+#endif
+    }
+    return( success == true );
 }